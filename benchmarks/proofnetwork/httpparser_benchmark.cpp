@@ -0,0 +1,152 @@
+// clazy:skip
+
+#include "proofnetwork/httpparser_p.h"
+
+#include <QTest>
+
+using namespace Proof;
+
+namespace {
+QByteArray typicalHead(const QByteArray &requestLine)
+{
+    return requestLine
+           + "\r\nHost: localhost:9000\r\n"
+             "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko)\r\n"
+             "Accept: application/json, text/plain, */*\r\n"
+             "Accept-Encoding: gzip, deflate\r\n"
+             "Accept-Language: en-US,en;q=0.9\r\n"
+             "Authorization: Basic dXNlcjpwYXNz\r\n"
+             "Proof-Application: station\r\n"
+             "Connection: keep-alive\r\n";
+}
+
+HttpParser::Result parseWhole(HttpParser &parser, const QByteArray &data)
+{
+    HttpParser::Result result = parser.parseNextPart(data);
+    if (result == HttpParser::Result::HeadersReady)
+        result = parser.parseNextPart(QByteArray());
+    return result;
+}
+
+QByteArray chunked(const QByteArray &body, int chunkSize)
+{
+    QByteArray result;
+    for (int i = 0; i < body.size(); i += chunkSize) {
+        const QByteArray chunk = body.mid(i, chunkSize);
+        result += QByteArray::number(chunk.size(), 16) + "\r\n" + chunk + "\r\n";
+    }
+    return result + "0\r\n\r\n";
+}
+} // namespace
+
+class HttpParserBenchmark : public QObject
+{
+    Q_OBJECT
+private slots:
+    void parseGet()
+    {
+        const QByteArray request = typicalHead("GET /orders/items/42/history?from=2019-01-01 HTTP/1.1") + "\r\n";
+        HttpParser::Result result = HttpParser::Result::NeedMore;
+        QBENCHMARK {
+            HttpParser parser;
+            result = parseWhole(parser, request);
+        }
+        QCOMPARE(result, HttpParser::Result::Success);
+    }
+
+    //Same request received by small network packets
+    void parseGetByParts()
+    {
+        const QByteArray request = typicalHead("GET /orders/items/42/history?from=2019-01-01 HTTP/1.1") + "\r\n";
+        QVector<QByteArray> parts;
+        for (int i = 0; i < request.size(); i += 64)
+            parts << request.mid(i, 64);
+        HttpParser::Result result = HttpParser::Result::NeedMore;
+        QBENCHMARK {
+            HttpParser parser;
+            for (const QByteArray &part : qAsConst(parts))
+                result = parseWhole(parser, part);
+        }
+        QCOMPARE(result, HttpParser::Result::Success);
+    }
+
+    //Keep-alive connection with pipelined requests, parser is reused
+    void parsePipelined()
+    {
+        const QByteArray single = typicalHead("GET /orders/42 HTTP/1.1") + "\r\n";
+        const QByteArray request = single.repeated(16);
+        int parsed = 0;
+        QBENCHMARK {
+            HttpParser parser;
+            parsed = 0;
+            HttpParser::Result result = parseWhole(parser, request);
+            while (result == HttpParser::Result::Success) {
+                ++parsed;
+                parser.reset();
+                result = parser.hasPendingData() ? parseWhole(parser, QByteArray()) : HttpParser::Result::NeedMore;
+            }
+        }
+        QCOMPARE(parsed, 16);
+    }
+
+    void parseContentLengthBody_data()
+    {
+        QTest::addColumn<int>("size");
+        QTest::newRow("1K") << 1024;
+        QTest::newRow("64K") << 64 * 1024;
+        QTest::newRow("1M") << 1024 * 1024;
+    }
+
+    void parseContentLengthBody()
+    {
+        QFETCH(int, size);
+        const QByteArray body(size, 'x');
+        const QByteArray request = typicalHead("POST /orders HTTP/1.1") + "Content-Type: application/json\r\n"
+                                   + "Content-Length: " + QByteArray::number(size) + "\r\n\r\n" + body;
+        HttpParser::Result result = HttpParser::Result::NeedMore;
+        QBENCHMARK {
+            HttpParser parser;
+            result = parseWhole(parser, request);
+        }
+        QCOMPARE(result, HttpParser::Result::Success);
+    }
+
+    void parseChunkedBody_data()
+    {
+        QTest::addColumn<int>("size");
+        QTest::newRow("1K") << 1024;
+        QTest::newRow("64K") << 64 * 1024;
+        QTest::newRow("1M") << 1024 * 1024;
+    }
+
+    void parseChunkedBody()
+    {
+        QFETCH(int, size);
+        const QByteArray request = typicalHead("POST /orders HTTP/1.1") + "Transfer-Encoding: chunked\r\n\r\n"
+                                   + chunked(QByteArray(size, 'x'), 8 * 1024);
+        HttpParser::Result result = HttpParser::Result::NeedMore;
+        QBENCHMARK {
+            HttpParser parser;
+            result = parseWhole(parser, request);
+        }
+        QCOMPARE(result, HttpParser::Result::Success);
+    }
+
+    void headerLookup()
+    {
+        HttpParser parser;
+        QCOMPARE(parseWhole(parser, typicalHead("GET /orders/42 HTTP/1.1") + "\r\n"), HttpParser::Result::Success);
+        QByteArray authorization;
+        QByteArray application;
+        QBENCHMARK {
+            authorization = parser.header(HttpParser::Header::Authorization);
+            application = parser.header("proof-application");
+        }
+        QCOMPARE(authorization, QByteArray("Basic dXNlcjpwYXNz"));
+        QCOMPARE(application, QByteArray("station"));
+    }
+};
+
+QTEST_GUILESS_MAIN(HttpParserBenchmark)
+
+#include "httpparser_benchmark.moc"
@@ -0,0 +1,136 @@
+// clazy:skip
+
+#include "proofnetwork/httpparser_p.h"
+#include "proofnetwork/restrouter_p.h"
+
+#include <QMetaMethod>
+#include <QTcpSocket>
+#include <QTest>
+#include <QUrlQuery>
+
+using namespace Proof;
+
+class DispatchTarget : public QObject
+{
+    Q_OBJECT
+public:
+    int calls = 0;
+
+public slots:
+    void rest_get_Orders_Items(QTcpSocket *, const QStringList &, const QStringList &, const QUrlQuery &,
+                               const QByteArray &)
+    {
+        ++calls;
+    }
+};
+
+class RestRouterBenchmark : public QObject
+{
+    Q_OBJECT
+private slots:
+    void initTestCase()
+    {
+        //Some noise to make table look like one from real service
+        for (int i = 0; i < 50; ++i) {
+            RestRouter::Route noise;
+            noise.name = QByteArray("rest_get_Entity") + QByteArray::number(i);
+            router.addRoute({"get", QStringLiteral("entity-%1").arg(i), QStringLiteral("details")}, noise);
+            router.addRoute({"post", QStringLiteral("entity-%1").arg(i)}, noise);
+        }
+        RestRouter::Route route;
+        route.name = "rest_get_Orders_Items";
+        route.methodIndex = target.metaObject()->indexOfMethod(
+            "rest_get_Orders_Items(QTcpSocket*,QStringList,QStringList,QUrlQuery,QByteArray)");
+        QVERIFY(route.methodIndex >= 0);
+        router.addRoute({"get", "orders", "items"}, route);
+
+        QCOMPARE(HttpParser::Result::Success,
+                 request.parseNextPart("GET /orders/items/42/history?from=2019-01-01 HTTP/1.1\r\n"
+                                       "Host: localhost\r\nAuthorization: Basic dXNlcjpwYXNz\r\n\r\n"));
+    }
+
+    void findRoute()
+    {
+        const QByteArray path = "/orders/items";
+        const RestRouter::Route *route = nullptr;
+        QBENCHMARK {
+            route = router.findRoute("GET", path);
+        }
+        QVERIFY(route);
+    }
+
+    void findRouteWithVariableParts()
+    {
+        const QByteArray path = "/orders/items/42/history";
+        int variablePartsStart = 0;
+        QStringList variableParts;
+        QBENCHMARK {
+            router.findRoute("GET", path, &variablePartsStart);
+            variableParts = RestRouter::variableParts(path, variablePartsStart);
+        }
+        QCOMPARE(variableParts, QStringList({"42", "history"}));
+    }
+
+    void findMissingRoute()
+    {
+        const QByteArray path = "/entity-49/unknown";
+        const RestRouter::Route *route = nullptr;
+        QBENCHMARK {
+            route = router.findRoute("GET", path);
+        }
+        QVERIFY(!route);
+    }
+
+    //Everything server does for each request after it is parsed
+    void dispatchByIndex()
+    {
+        target.calls = 0;
+        QBENCHMARK {
+            QByteArray uri = request.rawUri();
+            int queryStart = uri.indexOf('?');
+            QByteArray path = QByteArray::fromRawData(uri.constData(), queryStart);
+            int variablePartsStart = 0;
+            const RestRouter::Route *route = router.findRoute(request.rawMethod(), path, &variablePartsStart);
+            QTcpSocket *socket = nullptr;
+            QStringList headers = request.headers();
+            QStringList variableParts = RestRouter::variableParts(path, variablePartsStart);
+            QUrlQuery query(QString::fromUtf8(uri.constData() + queryStart + 1, uri.size() - queryStart - 1));
+            QByteArray body = request.body();
+            void *args[] = {nullptr, &socket, &headers, &variableParts, &query, &body};
+            QMetaObject::metacall(&target, QMetaObject::InvokeMetaMethod, route->methodIndex, args);
+        }
+        QVERIFY(target.calls > 0);
+    }
+
+    //Same as above but with slot resolved by name, how it was done before routing table
+    void dispatchByName()
+    {
+        target.calls = 0;
+        QBENCHMARK {
+            QByteArray uri = request.rawUri();
+            int queryStart = uri.indexOf('?');
+            QByteArray path = QByteArray::fromRawData(uri.constData(), queryStart);
+            int variablePartsStart = 0;
+            const RestRouter::Route *route = router.findRoute(request.rawMethod(), path, &variablePartsStart);
+            QTcpSocket *socket = nullptr;
+            QStringList variableParts = RestRouter::variableParts(path, variablePartsStart);
+            QUrlQuery query(QString::fromUtf8(uri.constData() + queryStart + 1, uri.size() - queryStart - 1));
+            // clang-format off
+            QMetaObject::invokeMethod(&target, route->name.constData(), Qt::DirectConnection,
+                                      Q_ARG(QTcpSocket*, socket), Q_ARG(QStringList, request.headers()),
+                                      Q_ARG(QStringList, variableParts), Q_ARG(QUrlQuery, query),
+                                      Q_ARG(QByteArray, request.body()));
+            // clang-format on
+        }
+        QVERIFY(target.calls > 0);
+    }
+
+private:
+    RestRouter router;
+    DispatchTarget target;
+    HttpParser request;
+};
+
+QTEST_GUILESS_MAIN(RestRouterBenchmark)
+
+#include "restrouter_benchmark.moc"
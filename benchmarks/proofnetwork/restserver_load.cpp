@@ -0,0 +1,319 @@
+// clazy:skip
+
+#include "proofcore/coreapplication.h"
+#include "proofcore/logs.h"
+
+#include "proofnetwork/abstractrestserver.h"
+
+#include <QCommandLineParser>
+#include <QDeadlineTimer>
+#include <QElapsedTimer>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTcpSocket>
+#include <QThread>
+#include <QTimer>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <vector>
+
+// Loopback load generator for AbstractRestServer.
+// Starts sample server and drives it with configurable number of connections from several client threads,
+// prints single json object with throughput and latency percentiles to stdout.
+
+namespace {
+struct LoadOptions
+{
+    quint16 port = 9190;
+    int connections = 16;
+    int clientThreads = 2;
+    int serverThreads = 5;
+    int durationMsecs = 5000;
+    int warmupMsecs = 500;
+    int requestSize = 0;
+    int responseSize = 16;
+    bool keepAlive = true;
+};
+
+class LoadServer : public Proof::AbstractRestServer
+{
+    Q_OBJECT
+public:
+    LoadServer(quint16 port, int responseSize) : Proof::AbstractRestServer(port), m_response(responseSize, 'x') {}
+
+public slots:
+    NO_AUTH_REQUIRED void rest_get_Payload(QTcpSocket *socket, const QStringList &, const QStringList &,
+                                           const QUrlQuery &, const QByteArray &)
+    {
+        sendAnswer(socket, m_response, QStringLiteral("text/plain"));
+    }
+
+    NO_AUTH_REQUIRED void rest_post_Payload(QTcpSocket *socket, const QStringList &, const QStringList &,
+                                            const QUrlQuery &, const QByteArray &)
+    {
+        sendAnswer(socket, m_response, QStringLiteral("text/plain"));
+    }
+
+private:
+    QByteArray m_response;
+};
+
+//Lives in client thread, sends next request as soon as previous answer is received
+class LoadConnection : public QObject
+{
+    Q_OBJECT
+public:
+    LoadConnection(const LoadOptions &options, const QByteArray &request, std::atomic_int *running)
+        : m_options(options), m_request(request), m_running(running)
+    {}
+
+    void start()
+    {
+        m_warmupDeadline = QDeadlineTimer(m_options.warmupMsecs);
+        m_deadline = QDeadlineTimer(m_options.warmupMsecs + m_options.durationMsecs);
+        m_socket = new QTcpSocket(this);
+        m_socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+        connect(m_socket, &QTcpSocket::connected, this, [this] { m_socket->write(m_request); });
+        connect(m_socket, &QTcpSocket::readyRead, this, &LoadConnection::onReadyRead);
+        connect(m_socket, qOverload<QAbstractSocket::SocketError>(&QTcpSocket::error), this,
+                &LoadConnection::onError);
+        sendRequest(true);
+    }
+
+    void finish()
+    {
+        if (m_finished)
+            return;
+        m_finished = true;
+        m_socket->abort();
+        --*m_running;
+    }
+
+    std::vector<qint64> latencies;
+    qint64 requests = 0;
+    qint64 errors = 0;
+
+private:
+    void sendRequest(bool reconnect)
+    {
+        if (m_finished)
+            return;
+        if (m_deadline.hasExpired()) {
+            finish();
+            return;
+        }
+        m_timer.start();
+        if (reconnect) {
+            m_socket->abort();
+            m_socket->connectToHost(QHostAddress::LocalHost, m_options.port);
+        } else {
+            m_socket->write(m_request);
+        }
+    }
+
+    void onReadyRead()
+    {
+        m_buffer += m_socket->readAll();
+        if (m_expectedSize < 0) {
+            const int headEnd = m_buffer.indexOf("\r\n\r\n");
+            if (headEnd < 0)
+                return;
+            const QByteArray head = m_buffer.left(headEnd).toLower();
+            const int lengthStart = head.indexOf("\r\ncontent-length:");
+            const int lengthEnd = head.indexOf("\r\n", lengthStart + 2);
+            if (!head.startsWith("http/1.1 200") || lengthStart < 0) {
+                ++errors;
+                m_buffer.clear();
+                sendRequest(true);
+                return;
+            }
+            m_expectedSize = headEnd + 4
+                             + head.mid(lengthStart + 17, lengthEnd < 0 ? -1 : lengthEnd - lengthStart - 17)
+                                   .trimmed()
+                                   .toInt();
+        }
+        if (m_buffer.size() < m_expectedSize)
+            return;
+
+        if (m_warmupDeadline.hasExpired()) {
+            latencies.push_back(m_timer.nsecsElapsed() / 1000);
+            ++requests;
+        }
+        m_buffer.remove(0, m_expectedSize);
+        m_expectedSize = -1;
+        sendRequest(!m_options.keepAlive);
+    }
+
+    void onError(QAbstractSocket::SocketError error)
+    {
+        if (m_finished)
+            return;
+        //Keep-alive connection can be closed by server between requests, it is not an error
+        if (error != QAbstractSocket::RemoteHostClosedError || !m_buffer.isEmpty())
+            ++errors;
+        m_buffer.clear();
+        m_expectedSize = -1;
+        QTimer::singleShot(0, this, [this] { sendRequest(true); });
+    }
+
+    const LoadOptions m_options;
+    const QByteArray m_request;
+    std::atomic_int *m_running;
+    QTcpSocket *m_socket = nullptr;
+    QByteArray m_buffer;
+    int m_expectedSize = -1;
+    QElapsedTimer m_timer;
+    QDeadlineTimer m_warmupDeadline;
+    QDeadlineTimer m_deadline;
+    bool m_finished = false;
+};
+
+qint64 percentile(const std::vector<qint64> &sorted, double rank)
+{
+    if (sorted.empty())
+        return 0;
+    const auto index = static_cast<size_t>(rank * static_cast<double>(sorted.size() - 1));
+    return sorted[index];
+}
+
+QByteArray loadRequest(const LoadOptions &options)
+{
+    const QByteArray connection = options.keepAlive ? "keep-alive" : "close";
+    if (!options.requestSize)
+        return "GET /payload HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: " + connection + "\r\n\r\n";
+    return "POST /payload HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: " + connection
+           + "\r\nContent-Type: application/octet-stream\r\nContent-Length: "
+           + QByteArray::number(options.requestSize) + "\r\n\r\n" + QByteArray(options.requestSize, 'x');
+}
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    Proof::CoreApplication app(argc, argv, QStringLiteral("Opensoft"), QStringLiteral("proof_restserver_load"));
+    Proof::Logs::setRulesFromString(QStringLiteral("proof.*=false"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Loopback load generator for AbstractRestServer"));
+    parser.addHelpOption();
+    const QCommandLineOption portOption(QStringLiteral("port"), QStringLiteral("Server port."), QStringLiteral("port"),
+                                        QStringLiteral("9190"));
+    const QCommandLineOption connectionsOption(QStringLiteral("connections"), QStringLiteral("Client connections."),
+                                               QStringLiteral("count"), QStringLiteral("16"));
+    const QCommandLineOption clientThreadsOption(QStringLiteral("client-threads"),
+                                                 QStringLiteral("Threads that drive client connections."),
+                                                 QStringLiteral("count"), QStringLiteral("2"));
+    const QCommandLineOption serverThreadsOption(QStringLiteral("server-threads"),
+                                                 QStringLiteral("Suggested max count of server workers."),
+                                                 QStringLiteral("count"), QStringLiteral("5"));
+    const QCommandLineOption durationOption(QStringLiteral("duration"), QStringLiteral("Measured time in msecs."),
+                                            QStringLiteral("msecs"), QStringLiteral("5000"));
+    const QCommandLineOption warmupOption(QStringLiteral("warmup"),
+                                          QStringLiteral("Time in msecs before measurement starts."),
+                                          QStringLiteral("msecs"), QStringLiteral("500"));
+    const QCommandLineOption requestSizeOption(QStringLiteral("request-size"),
+                                               QStringLiteral("Request body size, 0 sends GET requests."),
+                                               QStringLiteral("bytes"), QStringLiteral("0"));
+    const QCommandLineOption responseSizeOption(QStringLiteral("response-size"),
+                                                QStringLiteral("Answer body size."), QStringLiteral("bytes"),
+                                                QStringLiteral("16"));
+    const QCommandLineOption noKeepAliveOption(QStringLiteral("no-keep-alive"),
+                                               QStringLiteral("Open new connection for each request."));
+    parser.addOptions({portOption, connectionsOption, clientThreadsOption, serverThreadsOption, durationOption,
+                       warmupOption, requestSizeOption, responseSizeOption, noKeepAliveOption});
+    parser.process(*qApp);
+
+    LoadOptions options;
+    options.port = static_cast<quint16>(parser.value(portOption).toUInt());
+    options.connections = qMax(1, parser.value(connectionsOption).toInt());
+    options.clientThreads = qBound(1, parser.value(clientThreadsOption).toInt(), options.connections);
+    options.serverThreads = qMax(1, parser.value(serverThreadsOption).toInt());
+    options.durationMsecs = qMax(1, parser.value(durationOption).toInt());
+    options.warmupMsecs = qMax(0, parser.value(warmupOption).toInt());
+    options.requestSize = qMax(0, parser.value(requestSizeOption).toInt());
+    options.responseSize = qMax(0, parser.value(responseSizeOption).toInt());
+    options.keepAlive = !parser.isSet(noKeepAliveOption);
+
+    LoadServer server(options.port, options.responseSize);
+    server.setSuggestedMaxThreadsCount(options.serverThreads);
+    server.setMaxRequestsPerConnection(0);
+    server.setCompressionLevel(0);
+    server.startListen();
+    QElapsedTimer timer;
+    timer.start();
+    while (!server.isListening() && timer.elapsed() < 10000)
+        QThread::msleep(10);
+    if (!server.isListening()) {
+        std::fprintf(stderr, "Server can't start on port %d\n", options.port);
+        return 1;
+    }
+
+    const QByteArray request = loadRequest(options);
+    std::atomic_int running{options.connections};
+    std::vector<QThread *> threads;
+    std::vector<LoadConnection *> connections;
+    for (int i = 0; i < options.clientThreads; ++i) {
+        threads.push_back(new QThread);
+        threads.back()->start();
+    }
+    for (int i = 0; i < options.connections; ++i) {
+        auto connection = new LoadConnection(options, request, &running);
+        connection->moveToThread(threads[static_cast<size_t>(i % options.clientThreads)]);
+        QMetaObject::invokeMethod(connection, [connection] { connection->start(); }, Qt::QueuedConnection);
+        connections.push_back(connection);
+    }
+
+    QDeadlineTimer hardDeadline(options.warmupMsecs + options.durationMsecs + 10000);
+    while (running > 0 && !hardDeadline.hasExpired())
+        QThread::msleep(10);
+
+    std::vector<qint64> latencies;
+    qint64 requests = 0;
+    qint64 errors = 0;
+    //Sockets should be closed in their own threads
+    for (LoadConnection *connection : connections)
+        QMetaObject::invokeMethod(connection, [connection] { connection->finish(); }, Qt::BlockingQueuedConnection);
+    for (QThread *thread : threads) {
+        thread->quit();
+        thread->wait();
+    }
+    //Client threads are stopped, so their results can be read directly
+    for (LoadConnection *connection : connections) {
+        latencies.insert(latencies.end(), connection->latencies.cbegin(), connection->latencies.cend());
+        requests += connection->requests;
+        errors += connection->errors;
+        delete connection;
+    }
+    for (QThread *thread : threads)
+        delete thread;
+    server.stopListen();
+
+    std::sort(latencies.begin(), latencies.end());
+    qint64 latenciesSum = 0;
+    for (qint64 latency : latencies)
+        latenciesSum += latency;
+    const qint64 latenciesMean = latencies.empty() ? 0 : latenciesSum / static_cast<qint64>(latencies.size());
+
+    QJsonObject result{
+        {QStringLiteral("connections"), options.connections},
+        {QStringLiteral("client_threads"), options.clientThreads},
+        {QStringLiteral("server_threads"), options.serverThreads},
+        {QStringLiteral("keep_alive"), options.keepAlive},
+        {QStringLiteral("request_size"), options.requestSize},
+        {QStringLiteral("response_size"), options.responseSize},
+        {QStringLiteral("duration_ms"), options.durationMsecs},
+        {QStringLiteral("requests"), requests},
+        {QStringLiteral("errors"), errors},
+        {QStringLiteral("requests_per_second"), static_cast<double>(requests) * 1000.0 / options.durationMsecs},
+        {QStringLiteral("latency_us"),
+         QJsonObject{{QStringLiteral("mean"), latenciesMean},
+                     {QStringLiteral("p50"), percentile(latencies, 0.5)},
+                     {QStringLiteral("p99"), percentile(latencies, 0.99)},
+                     {QStringLiteral("p999"), percentile(latencies, 0.999)},
+                     {QStringLiteral("max"), latencies.empty() ? 0 : latencies.back()}}}};
+    std::printf("%s\n", QJsonDocument(result).toJson(QJsonDocument::Compact).constData());
+    return errors && !requests ? 1 : 0;
+}
+
+#include "restserver_load.moc"
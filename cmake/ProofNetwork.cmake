@@ -6,8 +6,14 @@ proof_add_target_sources(Network
     src/proofnetwork/qmlwrappers/networkdataentityqmlwrapper.cpp
     src/proofnetwork/proofnetwork_init.cpp
     src/proofnetwork/abstractrestserver.cpp
+    src/proofnetwork/epollsocket.cpp
     src/proofnetwork/urlquerybuilder.cpp
     src/proofnetwork/httpparser.cpp
+    src/proofnetwork/httpcompression.cpp
+    src/proofnetwork/localsocketnetworkreply.cpp
+    src/proofnetwork/restrouter.cpp
+    src/proofnetwork/restresponsecache.cpp
+    src/proofnetwork/restservermetrics.cpp
     src/proofnetwork/proofservicerestapi.cpp
     src/proofnetwork/abstractamqpclient.cpp
     src/proofnetwork/jsonamqpclient.cpp
@@ -44,6 +50,7 @@ proof_add_target_headers(Network
     include/proofnetwork/simplejsonamqpclient.h
     include/proofnetwork/baserestapi.h
     include/proofnetwork/restapihelpers.h
+    include/proofnetwork/restroutehelpers.h
     include/proofnetwork/networkdataentityhelpers.h
     include/proofnetwork/errormessagesregistry.h
 )
@@ -54,7 +61,13 @@ proof_add_target_private_headers(Network
     include/private/proofnetwork/user_p.h
     include/private/proofnetwork/qmlwrappers/userqmlwrapper_p.h
     include/private/proofnetwork/urlquerybuilder_p.h
+    include/private/proofnetwork/epollsocket_p.h
     include/private/proofnetwork/httpparser_p.h
+    include/private/proofnetwork/httpcompression_p.h
+    include/private/proofnetwork/localsocketnetworkreply_p.h
+    include/private/proofnetwork/restrouter_p.h
+    include/private/proofnetwork/restresponsecache_p.h
+    include/private/proofnetwork/restservermetrics_p.h
     include/private/proofnetwork/proofservicerestapi_p.h
     include/private/proofnetwork/abstractamqpclient_p.h
     include/private/proofnetwork/jsonamqpclient_p.h
@@ -62,8 +75,10 @@ proof_add_target_private_headers(Network
     include/private/proofnetwork/baserestapi_p.h
 )
 
+find_package(ZLIB REQUIRED)
+
 proof_add_module(Network
     QT_LIBS Core Network
     PROOF_LIBS Core
-    OTHER_LIBS qca-qt5 qamqp
+    OTHER_LIBS qca-qt5 qamqp ZLIB::ZLIB
 )
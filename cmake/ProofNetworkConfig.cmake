@@ -1,6 +1,7 @@
 include(CMakeFindDependencyMacro)
 
 list(APPEND CMAKE_PREFIX_PATH "${CMAKE_CURRENT_LIST_DIR}/3rdparty")
+find_dependency(ZLIB REQUIRED)
 find_dependency(Qt5Core CONFIG REQUIRED)
 find_dependency(Qt5Network CONFIG REQUIRED)
 find_dependency(qamqp CONFIG REQUIRED)
@@ -0,0 +1,126 @@
+/* Copyright 2018, OpenSoft Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright notice, this list of
+ * conditions and the following disclaimer in the documentation and/or other materials provided
+ * with the distribution.
+ *     * Neither the name of OpenSoft Inc. nor the names of its contributors may be used to endorse
+ * or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#ifndef PROOF_EPOLLSOCKET_P_H
+#define PROOF_EPOLLSOCKET_P_H
+
+#include "proofnetwork/proofnetwork_global.h"
+
+#include <QByteArray>
+#include <QTcpSocket>
+
+#include <functional>
+
+class QSocketNotifier;
+
+namespace Proof {
+
+class EpollSocket;
+
+// Waits for readiness of all EpollSocket connections of one thread with single epoll descriptor, so event loop
+// gets one notification per batch of ready connections instead of one per socket notifier.
+// Should be created and deleted in thread that owns its sockets. Works only on Linux, isValid() is false elsewhere.
+class PROOF_NETWORK_EXPORT EpollPoller : public QObject
+{
+public:
+    explicit EpollPoller(QObject *parent = nullptr);
+    EpollPoller(const EpollPoller &) = delete;
+    EpollPoller &operator=(const EpollPoller &) = delete;
+    EpollPoller(EpollPoller &&) = delete;
+    EpollPoller &operator=(EpollPoller &&) = delete;
+    ~EpollPoller();
+
+    bool isValid() const;
+    //Called for socket with newly received data instead of readyRead(), so owner is driven directly by
+    //poller events without queued signal per event. Handler can write to socket and close it, but not delete it
+    void setReadyReadHandler(const std::function<void(EpollSocket *)> &handler);
+
+private:
+    friend class EpollSocket;
+    bool watch(EpollSocket *socket, bool read, bool write, bool add);
+    void unwatch(EpollSocket *socket);
+    void processEvents();
+
+    int m_descriptor = -1;
+    QSocketNotifier *m_notifier = nullptr;
+    std::function<void(EpollSocket *)> m_readyReadHandler;
+};
+
+// Accepted connection that is read and written with system calls when EpollPoller reports it as ready.
+// Looks like connected QTcpSocket for rest server methods and answer helpers, but supports only reading, writing,
+// read buffer limit, disconnectFromHost(), close() and abort(). Addresses, socket options and waitFor* methods are
+// not supported. bytesWritten() is emitted asynchronously, readyRead() (if poller has no handler for it)
+// and disconnected() are emitted by poller.
+class PROOF_NETWORK_EXPORT EpollSocket : public QTcpSocket
+{
+public:
+    explicit EpollSocket(EpollPoller *poller);
+    EpollSocket(const EpollSocket &) = delete;
+    EpollSocket &operator=(const EpollSocket &) = delete;
+    EpollSocket(EpollSocket &&) = delete;
+    EpollSocket &operator=(EpollSocket &&) = delete;
+    ~EpollSocket();
+
+    //Takes ownership of connected descriptor, it is closed if false is returned
+    bool setDescriptor(qintptr descriptor);
+
+    qint64 bytesAvailable() const override;
+    qint64 bytesToWrite() const override;
+    void disconnectFromHost() override;
+    void close() override;
+    //QAbstractSocket::abort() is not virtual and ends up in close(), which sends pending data first,
+    //so it should be called through EpollSocket pointer to drop them
+    void abort();
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override;
+    qint64 writeData(const char *data, qint64 size) override;
+
+private:
+    friend class EpollPoller;
+    void onReadable();
+    void onWritable();
+    void onFailed(int errorCode);
+    //Returns false if socket is failed
+    bool sendPending();
+    void updateWatch();
+    void scheduleBytesWritten(qint64 bytes);
+    void closeDescriptor(bool notify);
+    qint64 unreadSize() const;
+
+    EpollPoller *m_poller;
+    int m_descriptor = -1;
+    QByteArray m_readBuffer;
+    int m_readPosition = 0;
+    QByteArray m_writeBuffer;
+    int m_writePosition = 0;
+    qint64 m_pendingBytesWritten = 0;
+    bool m_closing = false;
+    bool m_readWatched = false;
+    bool m_writeWatched = false;
+};
+
+} // namespace Proof
+
+#endif // PROOF_EPOLLSOCKET_P_H
@@ -0,0 +1,58 @@
+/* Copyright 2018, OpenSoft Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright notice, this list of
+ * conditions and the following disclaimer in the documentation and/or other materials provided
+ * with the distribution.
+ *     * Neither the name of OpenSoft Inc. nor the names of its contributors may be used to endorse
+ * or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#ifndef PROOF_HTTPCOMPRESSION_P_H
+#define PROOF_HTTPCOMPRESSION_P_H
+
+#include "proofnetwork/proofnetwork_global.h"
+
+#include <QByteArray>
+
+namespace Proof {
+
+// Content coding of rest server answers
+class PROOF_NETWORK_EXPORT HttpCompression
+{
+public:
+    enum class Encoding
+    {
+        Identity,
+        Gzip,
+        Deflate
+    };
+
+    HttpCompression() = delete;
+
+    //Picks best supported coding from Accept-Encoding header value, gzip is preferred when q-values are equal
+    static Encoding negotiate(const QByteArray &acceptEncoding);
+    //Types that are usually compressed already (images, archives, etc.) are not worth compression
+    static bool isCompressible(const QByteArray &contentType);
+    static QByteArray encodingName(Encoding encoding);
+    //Returns empty array if compression fails, level is zlib one (1-9)
+    static QByteArray compress(const QByteArray &data, Encoding encoding, int level);
+};
+
+} // namespace Proof
+
+#endif // PROOF_HTTPCOMPRESSION_P_H
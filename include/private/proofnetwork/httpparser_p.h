@@ -25,49 +25,136 @@
 #ifndef PROOF_HTTPPARSER_P_H
 #define PROOF_HTTPPARSER_P_H
 
+#include "proofnetwork/proofnetwork_global.h"
+
 #include <QByteArray>
+#include <QPair>
+#include <QSharedPointer>
 #include <QStringList>
+#include <QVector>
+
+#include <array>
+
+class QTemporaryFile;
 
 namespace Proof {
 
-class HttpParser
+// Incremental parser that works over single buffer and stores only offsets of request parts.
+// Raw accessors return views over internal buffer, they are valid until reset() is called.
+// Bodies bigger than spill threshold are written to temporary file and body() returns view over its memory mapping.
+class PROOF_NETWORK_EXPORT HttpParser
 {
 public:
     enum class Result
     {
         NeedMore,
         Error,
-        Success
+        Success,
+        //Returned once when head is parsed and body is expected, parsing of body continues with next call
+        HeadersReady
+    };
+
+    enum class Header
+    {
+        ContentLength,
+        Connection,
+        Authorization,
+        TransferEncoding,
+        Expect,
+        AcceptEncoding,
+        IfNoneMatch,
+        IfModifiedSince,
+        Range,
+        IfRange,
+        RequestTimeout,
+        HeadersCount
     };
 
     HttpParser();
-    Result parseNextPart(QByteArray data);
+    Result parseNextPart(const QByteArray &data);
+    //Limits both Content-Length and sum of chunks sizes, 0 means QByteArray limit
+    void setMaxBodySize(qlonglong size);
+    //Body is spilled to temporary file if Content-Length or received chunks are bigger than this size, 0 disables it
+    void setBodySpillThreshold(qlonglong size);
+    //Prepares parser for next request on same connection, already received data is kept
+    void reset();
+    bool hasPendingData() const;
 
     QString method() const;
     QString uri() const;
     QStringList headers() const;
     QByteArray body() const;
+    //Returns body received so far and drops it from parser, used for streaming of big bodies
+    QByteArray takeBody();
+    //Temporary file that backs body() if it was spilled, mapping stays valid while this pointer is referenced
+    QSharedPointer<QTemporaryFile> spilledBody() const;
+    bool keepAlive() const;
+    bool isHttp11() const;
+
+    QByteArray rawMethod() const;
+    QByteArray rawUri() const;
+    QByteArray header(Header header) const;
+    QByteArray header(const QByteArray &name) const;
 
     QString error() const;
+    int errorHttpCode() const;
 
 private:
-    Result initialState(QByteArray &data);
-    Result headersState(QByteArray &data);
-    Result bodyState(QByteArray &data);
+    struct Span
+    {
+        int start = 0;
+        int length = 0;
+    };
+    struct HeaderSpan
+    {
+        Span name;
+        Span value;
+    };
+
+    Result initialState();
+    Result headersState();
+    Result bodyState();
+    Result chunkSizeState();
+    Result chunkDataState();
+    Result chunkDataEndState();
+    Result trailersState();
+
+    int nextLineEnd();
+    Result parseHeaderLine(int lineEnd);
+    QByteArray view(const Span &span) const;
+    bool spill(const char *data, int size);
+    Result mapSpilledBody();
+    void dropSpilledBody();
+    Result fail(int httpCode, const QString &error);
 
 private:
-    using State = Result (HttpParser::*)(QByteArray &);
+    using State = Result (HttpParser::*)();
 
     State m_state = &HttpParser::initialState;
-    QByteArray m_data;
+    QByteArray m_buffer;
+    QByteArray m_head;
+    int m_pos = 0;
+    int m_lineStart = 0;
     qulonglong m_contentLength = 0;
-    QString m_method;
-    QString m_uri;
-    QStringList m_headers;
+    qulonglong m_bodyTaken = 0;
+    qulonglong m_chunkRemaining = 0;
+    qlonglong m_maxBodySize = 0;
+    qlonglong m_spillThreshold = 0;
+    bool m_chunked = false;
+    QByteArray m_body;
+    QSharedPointer<QTemporaryFile> m_spillFile;
+    int m_spilledSize = 0;
+    const char *m_spilledData = nullptr;
+    QVector<QPair<QByteArray, QByteArray>> m_trailers;
+    Span m_method;
+    Span m_uri;
+    QVector<HeaderSpan> m_headers;
+    std::array<int, static_cast<int>(Header::HeadersCount)> m_knownHeaders;
     QString m_error;
-
-    static const QRegExp FIRST_LINE_REG_EXP;
-    static const QRegExp HEADER_REG_EXP;
+    int m_errorHttpCode = 400;
+    bool m_http11 = false;
+    bool m_connectionClose = false;
+    bool m_connectionKeepAlive = false;
 };
 
 } // namespace Proof
@@ -0,0 +1,92 @@
+/* Copyright 2018, OpenSoft Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright notice, this list of
+ * conditions and the following disclaimer in the documentation and/or other materials provided
+ * with the distribution.
+ *     * Neither the name of OpenSoft Inc. nor the names of its contributors may be used to endorse
+ * or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#ifndef PROOF_LOCALSOCKETNETWORKREPLY_P_H
+#define PROOF_LOCALSOCKETNETWORKREPLY_P_H
+
+#include "proofnetwork/proofnetwork_global.h"
+
+#include <QByteArray>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+
+class QLocalSocket;
+
+namespace Proof {
+
+// Reply of http request sent over Unix domain socket, is used by RestClient instead of QNetworkAccessManager one
+// when local socket path is set. Each request uses its own connection, redirects and content decoding are not
+// supported. Whole body is available when reply is finished.
+class PROOF_NETWORK_EXPORT LocalSocketNetworkReply : public QNetworkReply
+{
+    Q_OBJECT
+public:
+    LocalSocketNetworkReply(const QString &socketPath, const QByteArray &verb, const QNetworkRequest &request,
+                            const QByteArray &body, QObject *parent = nullptr);
+    LocalSocketNetworkReply(const LocalSocketNetworkReply &) = delete;
+    LocalSocketNetworkReply &operator=(const LocalSocketNetworkReply &) = delete;
+    LocalSocketNetworkReply(LocalSocketNetworkReply &&) = delete;
+    LocalSocketNetworkReply &operator=(LocalSocketNetworkReply &&) = delete;
+    ~LocalSocketNetworkReply();
+
+    void abort() override;
+    qint64 bytesAvailable() const override;
+    bool isSequential() const override;
+
+    static QByteArray serializeRequest(const QByteArray &verb, const QNetworkRequest &request, const QByteArray &body);
+    static NetworkError errorForStatusCode(int statusCode);
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override;
+    qint64 writeData(const char *data, qint64 maxSize) override;
+
+private:
+    enum class State
+    {
+        Head,
+        Body,
+        ChunkSize,
+        ChunkData,
+        ChunkEnd,
+        Trailers,
+        Done
+    };
+
+    void onReadyRead();
+    void onDisconnected();
+    void parseHead(const QByteArray &head);
+    void finishReply();
+    void failReply(NetworkError code, const QString &errorString);
+
+    QLocalSocket *m_socket = nullptr;
+    QByteArray m_buffer;
+    QByteArray m_content;
+    qint64 m_contentPos = 0;
+    qint64 m_bodyLeft = -1;
+    State m_state = State::Head;
+};
+
+} // namespace Proof
+
+#endif // PROOF_LOCALSOCKETNETWORKREPLY_P_H
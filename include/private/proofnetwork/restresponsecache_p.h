@@ -0,0 +1,114 @@
+/* Copyright 2018, OpenSoft Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright notice, this list of
+ * conditions and the following disclaimer in the documentation and/or other materials provided
+ * with the distribution.
+ *     * Neither the name of OpenSoft Inc. nor the names of its contributors may be used to endorse
+ * or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#ifndef PROOF_RESTRESPONSECACHE_P_H
+#define PROOF_RESTRESPONSECACHE_P_H
+
+#include "proofnetwork/proofnetwork_global.h"
+
+#include <QByteArray>
+#include <QDeadlineTimer>
+#include <QHash>
+#include <QReadWriteLock>
+#include <QString>
+
+#include <atomic>
+#include <optional>
+
+namespace Proof {
+
+// Answers of cacheable rest server methods keyed by request method and uri. Shared by all worker threads,
+// lookups take only read lock.
+class PROOF_NETWORK_EXPORT RestResponseCache
+{
+public:
+    struct Answer
+    {
+        QByteArray body;
+        QString contentType;
+        //Contains ETag header as well
+        QHash<QString, QString> headers;
+        QByteArray etag;
+        //Compressed variants of body keyed by Content-Encoding value, added after first answer with such coding
+        QHash<QByteArray, QByteArray> encodedBodies;
+    };
+
+    explicit RestResponseCache(int maxEntries = 1024);
+    RestResponseCache(const RestResponseCache &) = delete;
+    RestResponseCache &operator=(const RestResponseCache &) = delete;
+    RestResponseCache(RestResponseCache &&) = delete;
+    RestResponseCache &operator=(RestResponseCache &&) = delete;
+    ~RestResponseCache();
+
+    int ttl() const;
+    //0 means that answers are kept until invalidated, applies only to answers inserted after change
+    void setTtl(int msecs);
+    int count() const;
+
+    //Expired entry is dropped when found
+    std::optional<Answer> find(const QByteArray &key);
+    //Changed by each invalidation that affects route. Should be taken before method is called
+    //and passed to insert(), so answer built before invalidation is not stored after it
+    quint64 generation(const QByteArray &routeName) const;
+    //Expired entries are dropped about once a second and when cache is full,
+    //arbitrary entry is evicted if cache is full and nothing is expired.
+    //Answer is returned but not stored if route generation differs from passed one
+    Answer insert(const QByteArray &key, const QByteArray &routeName, const QByteArray &body,
+                  const QString &contentType, const QHash<QString, QString> &headers,
+                  std::optional<quint64> generation = std::nullopt);
+    //Stored only if entry with such etag is still in cache
+    void insertEncodedBody(const QByteArray &key, const QByteArray &etag, const QByteArray &encoding,
+                           const QByteArray &body);
+    void invalidate();
+    void invalidate(const QByteArray &routeName);
+
+    //Weak validator, answer can be sent with different content codings
+    static QByteArray etag(const QByteArray &body);
+    //Weak comparison of If-None-Match header value with etag
+    static bool isNotModified(const QByteArray &ifNoneMatch, const QByteArray &etag);
+
+private:
+    struct Entry
+    {
+        Answer answer;
+        QByteArray routeName;
+        QDeadlineTimer expiration;
+    };
+
+    quint64 routeGeneration(const QByteArray &routeName) const;
+    //Should be called under write lock
+    void purgeExpired();
+
+    const int maxEntries;
+    std::atomic_int m_ttl;
+    mutable QReadWriteLock lock;
+    QHash<QByteArray, Entry> entries;
+    QDeadlineTimer nextPurge;
+    quint64 globalGeneration = 0;
+    QHash<QByteArray, quint64> routeGenerations;
+};
+
+} // namespace Proof
+
+#endif // PROOF_RESTRESPONSECACHE_P_H
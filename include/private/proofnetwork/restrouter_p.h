@@ -0,0 +1,100 @@
+/* Copyright 2018, OpenSoft Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright notice, this list of
+ * conditions and the following disclaimer in the documentation and/or other materials provided
+ * with the distribution.
+ *     * Neither the name of OpenSoft Inc. nor the names of its contributors may be used to endorse
+ * or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#ifndef PROOF_RESTROUTER_P_H
+#define PROOF_RESTROUTER_P_H
+
+#include "proofnetwork/proofnetwork_global.h"
+#include "proofnetwork/restroutehelpers.h"
+
+#include <QByteArray>
+#include <QStringList>
+#include <QVector>
+
+namespace Proof {
+
+// Routing table of rest methods. It is filled once before server starts listening and is only read after that,
+// so lookups can be done from all worker threads without locking.
+// Lookup works directly over raw request bytes and doesn't allocate.
+class PROOF_NETWORK_EXPORT RestRouter
+{
+public:
+    struct Route
+    {
+        QByteArray name;
+        QStringList tags;
+        //Set for methods found by moc
+        int methodIndex = -1;
+        //Set for typed routes, they are matched only by whole path
+        RestRouteInvoker invoker = nullptr;
+        QVector<QByteArray> queryParameters;
+        //Set for moc methods that return Future<RestResponse> or CancelableFuture<RestResponse>
+        bool returnsFuture = false;
+        bool returnsCancelableFuture = false;
+
+        bool hasTag(const QString &tag) const { return tags.contains(tag); }
+    };
+
+    RestRouter();
+
+    void clear();
+    bool isEmpty() const;
+    //First segment is http verb, all segments are expected to be in lower case.
+    //Segments like {int}, {uint} or {string} match any path segment of such type, literal segments have priority.
+    void addRoute(const QStringList &segments, const Route &route);
+    //Path should not contain query. Route found by longest matched prefix is returned,
+    //offset of the rest of path is stored to variablePartsStart, values matched by parameters are stored to pathValues
+    const Route *findRoute(const QByteArray &verb, const QByteArray &path, int *variablePartsStart = nullptr,
+                           QVarLengthArray<QByteArray, 4> *pathValues = nullptr) const;
+
+    int routesCount() const;
+    //Index of route returned by findRoute(), stays the same until router is cleared
+    int routeIndex(const Route *route) const;
+    QVector<QByteArray> routeNames() const;
+
+    static QStringList variableParts(const QByteArray &path, int start);
+    static void queryValues(const QByteArray &query, const QVector<QByteArray> &names,
+                            QVarLengthArray<QByteArray, 4> &values);
+
+private:
+    struct Node
+    {
+        QByteArray segment;
+        int firstChild = -1;
+        int nextSibling = -1;
+        int route = -1;
+        bool isParameter = false;
+    };
+
+    int findChild(int node, const char *segment, int length) const;
+    int findParameterChild(int node, const char *segment, int length) const;
+    int addChild(int node, const QByteArray &segment, bool isParameter);
+
+    QVector<Node> m_nodes;
+    QVector<Route> m_routes;
+};
+
+} // namespace Proof
+
+#endif // PROOF_RESTROUTER_P_H
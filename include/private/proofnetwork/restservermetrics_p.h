@@ -0,0 +1,107 @@
+/* Copyright 2018, OpenSoft Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright notice, this list of
+ * conditions and the following disclaimer in the documentation and/or other materials provided
+ * with the distribution.
+ *     * Neither the name of OpenSoft Inc. nor the names of its contributors may be used to endorse
+ * or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#ifndef PROOF_RESTSERVERMETRICS_P_H
+#define PROOF_RESTSERVERMETRICS_P_H
+
+#include "proofnetwork/proofnetwork_global.h"
+
+#include <QByteArray>
+#include <QVector>
+
+#include <atomic>
+#include <memory>
+
+namespace Proof {
+
+// Per-route counters of rest server. Each worker thread owns its own instance and is the only writer to it,
+// so counters are updated without locked instructions. Readers can merge instances from any thread at any time,
+// values can be a bit behind but are never torn.
+class PROOF_NETWORK_EXPORT RestServerMetrics
+{
+public:
+    enum class Phase
+    {
+        Parse,
+        Dispatch,
+        Write
+    };
+
+    //One more route is allocated for requests that were not matched to any route
+    explicit RestServerMetrics(int routesCount);
+    RestServerMetrics(const RestServerMetrics &) = delete;
+    RestServerMetrics &operator=(const RestServerMetrics &) = delete;
+    RestServerMetrics(RestServerMetrics &&) = delete;
+    RestServerMetrics &operator=(RestServerMetrics &&) = delete;
+    ~RestServerMetrics();
+
+    int routesCount() const;
+    int unmatchedRoute() const;
+
+    void requestStarted(int route);
+    void requestFinished(int route);
+    void answerStarted(int route, int returnCode);
+    void bytesReceived(int route, qint64 bytes);
+    void bytesSent(int route, qint64 bytes);
+    void addDuration(int route, Phase phase, qint64 usecs);
+
+    //Route names are expected in the same order as routes in router, unmatched route is named "unmatched".
+    //Routes without requests are skipped.
+    static QByteArray toPrometheus(const QVector<const RestServerMetrics *> &metrics,
+                                   const QVector<QByteArray> &routeNames);
+
+private:
+    static constexpr int PHASES_COUNT = 3;
+    static constexpr int BUCKETS_COUNT = 16;
+    //1xx, 2xx, 3xx, 4xx, 5xx and others
+    static constexpr int STATUS_CLASSES_COUNT = 6;
+
+    struct Histogram
+    {
+        //Last bucket is +Inf
+        std::atomic<quint64> buckets[BUCKETS_COUNT + 1] = {};
+        std::atomic<quint64> count{0};
+        std::atomic<quint64> sumUsecs{0};
+    };
+
+    struct RouteMetrics
+    {
+        std::atomic<qint64> inFlight{0};
+        std::atomic<quint64> receivedBytes{0};
+        std::atomic<quint64> sentBytes{0};
+        std::atomic<quint64> answers[STATUS_CLASSES_COUNT] = {};
+        Histogram phases[PHASES_COUNT];
+    };
+
+    RouteMetrics *routeMetrics(int route) const;
+
+    static const qint64 BUCKET_BOUNDS_USECS[BUCKETS_COUNT];
+
+    std::unique_ptr<RouteMetrics[]> m_routes;
+    int m_routesCount = 0;
+};
+
+} // namespace Proof
+
+#endif // PROOF_RESTSERVERMETRICS_P_H
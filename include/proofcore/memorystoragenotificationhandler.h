@@ -32,6 +32,8 @@
 #include <QMultiMap>
 #include <QString>
 
+#include <functional>
+
 namespace Proof {
 class MemoryStorageNotificationHandlerPrivate;
 class PROOF_CORE_EXPORT MemoryStorageNotificationHandler : public AbstractNotificationHandler
@@ -39,11 +41,32 @@ class PROOF_CORE_EXPORT MemoryStorageNotificationHandler : public AbstractNotifi
     Q_OBJECT
     Q_DECLARE_PRIVATE(MemoryStorageNotificationHandler)
 public:
+    struct Message
+    {
+        quint64 id;
+        QDateTime time;
+        QString text;
+        ErrorNotifier::Severity severity;
+    };
+
     explicit MemoryStorageNotificationHandler(const QString &appId);
 
     QMultiMap<QDateTime, QString> messages() const;
     QPair<QDateTime, QString> lastMessage() const;
 
+    //Visits stored messages from newest to oldest without copying them.
+    //Starts from message that precedes one with beforeId (or from newest one if beforeId is 0),
+    //stops at messages older than since, after limit visited messages (negative means no limit)
+    //or when visitor returns false. Messages less severe than minSeverity are skipped.
+    //Storage is locked while visiting, so visitor should be fast. Returns number of visited messages
+    int forEachRecentMessage(const std::function<bool(const Message &)> &visitor, quint64 beforeId = 0,
+                             const QDateTime &since = QDateTime(), int limit = -1,
+                             ErrorNotifier::Severity minSeverity = ErrorNotifier::Severity::Info) const;
+
+    //Oldest messages are dropped if storage grows bigger than this number, 0 (default) means no limit
+    int maxMessagesCount() const;
+    void setMaxMessagesCount(int count);
+
     void notify(const QString &message, ErrorNotifier::Severity severity, const QString &packId) override;
 
     static QString id();
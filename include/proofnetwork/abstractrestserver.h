@@ -29,24 +29,77 @@
 
 #include "proofnetwork/proofnetwork_global.h"
 #include "proofnetwork/proofnetwork_types.h"
+#include "proofnetwork/restroutehelpers.h"
 
+#include <QDeadlineTimer>
+#include <QHash>
 #include <QScopedPointer>
+#include <QSharedPointer>
 #include <QStringList>
 #include <QTcpServer>
 #include <QUrlQuery>
 
+#include <functional>
+
 #ifndef Q_MOC_RUN
 #    define NO_AUTH_REQUIRED
+#    define STREAMING_BODY
+#    define HIGH_PRIORITY
+#    define CACHEABLE
 #endif
 
 namespace Proof {
 using HealthStatusMap = QMap<QString, QPair<QDateTime, QVariant>>;
+//Receives next body chunk, reading from socket is paused until returned future is filled, false stops reading
+using RequestBodyConsumer = std::function<Future<bool>(const QByteArray &chunk, bool isLast)>;
+
+//Answer of methods that return Future<RestResponse> instead of answering to socket by themselves
+struct RestResponse
+{
+    RestResponse() = default;
+    RestResponse(const QByteArray &body, const QString &contentType, int returnCode = 200,
+                 const QString &reason = QString())
+        : body(body), contentType(contentType), returnCode(returnCode), reason(reason)
+    {}
+    RestResponse(const QByteArray &body, const QString &contentType, const QHash<QString, QString> &headers,
+                 int returnCode = 200, const QString &reason = QString())
+        : body(body), contentType(contentType), headers(headers), returnCode(returnCode), reason(reason)
+    {}
+
+    QByteArray body;
+    QString contentType;
+    QHash<QString, QString> headers;
+    int returnCode = 200;
+    QString reason;
+};
+
+//Canceled when client disconnects or request deadline passes before method answers.
+//Copies share same state, default constructed token has no deadline and is canceled only by cancel()
+class PROOF_NETWORK_EXPORT RestCancellationToken
+{
+public:
+    RestCancellationToken();
+    explicit RestCancellationToken(const QDeadlineTimer &deadline);
+
+    bool isCanceled() const;
+    //Forever if request has no deadline
+    QDeadlineTimer deadline() const;
+    //Filled with true when token is canceled, is never filled if request is answered before that
+    Future<bool> canceled() const;
+    void cancel();
+
+private:
+    struct Data;
+    QSharedPointer<Data> d;
+};
 
 class AbstractRestServerPrivate;
 class PROOF_NETWORK_EXPORT AbstractRestServer : public QTcpServer
 {
     Q_OBJECT
     Q_DECLARE_PRIVATE(AbstractRestServer)
+    friend struct RestRouteHelpers;
+
 public:
     explicit AbstractRestServer();
     explicit AbstractRestServer(quint16 port);
@@ -62,6 +115,29 @@ public:
     QString pathPrefix() const;
     int port() const;
     RestAuthType authType() const;
+    int keepAliveTimeout() const;
+    int maxRequestsPerConnection() const;
+    qlonglong maxRequestBodySize() const;
+    qlonglong requestBodySpillThreshold() const;
+    int maxInFlightRequests() const;
+    int maxQueuedRequestsPerWorker() const;
+    int maxOpenSockets() const;
+    int idleWorkerTimeout() const;
+    RestServerIoBackend ioBackend() const;
+    int workerThreadsCount() const;
+    int compressionThreshold() const;
+    int compressionLevel() const;
+    int responseCacheTtl() const;
+    int healthStatusCacheTtl(bool quick = false) const;
+    int requestTimeout() const;
+    bool batchRequestsEnabled() const;
+    QString localSocketPath() const;
+    bool isListeningLocalSocket() const;
+    QString handoffSocketPath() const;
+    int handoffDrainTimeout() const;
+    bool isDraining() const;
+    QStringList executorPools() const;
+    QString routeExecutorPool(const QString &routeName) const;
 
     void setUserName(const QString &userName);
     void setPassword(const QString &password);
@@ -69,14 +145,79 @@ public:
     void setPort(quint16 port);
     void setSuggestedMaxThreadsCount(int count = -1);
     void setAuthType(RestAuthType authType);
+    //0 disables keep-alive, each connection will be closed after first answer
+    void setKeepAliveTimeout(int msecs);
+    //0 means no limit
+    void setMaxRequestsPerConnection(int count);
+    //Applies to both Content-Length and chunked bodies, 0 means no limit
+    void setMaxRequestBodySize(qlonglong bytes);
+    //Bodies bigger than this are written to temporary file and passed to methods as view over its memory mapping.
+    //View stays valid until answer is sent (or until returned future is filled), methods that keep body longer
+    //should copy it. Doesn't apply to STREAMING_BODY methods, 0 disables spilling
+    void setRequestBodySpillThreshold(qlonglong bytes);
+    //Requests over these limits are answered with 503 and Retry-After without calling method,
+    //methods marked with HIGH_PRIORITY are never rejected. 0 means no limit
+    void setMaxInFlightRequests(int count);
+    void setMaxQueuedRequestsPerWorker(int count);
+    //Connections over this limit are still accepted, but only HIGH_PRIORITY methods are served on them
+    //and connection is closed after first answer
+    void setMaxOpenSockets(int count);
+    //Worker threads without connections for about this time are stopped, one worker is always kept.
+    //Should be called before startListen()
+    void setIdleWorkerTimeout(int msecs);
+    //Epoll backend reads and writes connections with system calls driven by one epoll descriptor per worker
+    //instead of QTcpSocket machinery. Methods still get QTcpSocket pointer, but it should be used only as handle
+    //for answer methods. Linux only, Qt backend is used elsewhere. Applies to connections accepted after call
+    void setIoBackend(RestServerIoBackend backend);
+    //Requests not answered during this time are answered with 504 and their cancellation tokens are canceled.
+    //Client can make deadline shorter with X-Request-Timeout header (in milliseconds). 0 means no server deadline
+    void setRequestTimeout(int msecs);
+    //Enables POST /system/batch, disabled by default
+    void setBatchRequestsEnabled(bool enabled);
+    //Unix domain socket that is listened by startListen() in addition to tcp port, connections to it are served
+    //same way as tcp ones. With port set to 0 only local socket is listened. Should be called before startListen()
+    void setLocalSocketPath(const QString &path);
+    //New process that starts listening with same handoff path takes tcp listening socket over from current one
+    //through this Unix domain socket, so no connections are dropped during restart. Current process stops accepting
+    //connections, emits listeningSocketHandedOff() and drains for handoffDrainTimeout() msecs.
+    //Local socket set with setLocalSocketPath() is not handed off. Should be called before startListen()
+    void setHandoffSocketPath(const QString &path);
+    void setHandoffDrainTimeout(int msecs);
+    //Methods of routes assigned to executor pool are called in its threads instead of worker that owns connection,
+    //so slow routes can't occupy workers needed by other ones. Answer is still written by owning worker.
+    //Methods called in pool should use socket only to pass it to answer methods and cancellationToken().
+    //Requests that find maxQueuedRequests requests already waiting for pool thread are answered with 503,
+    //HIGH_PRIORITY methods are never rejected. 0 means no limit. Existing pool is reconfigured
+    void addExecutorPool(const QString &name, int threadsCount, int maxQueuedRequests = 0);
+    //Route name is the same as for invalidateResponseCache(), empty pool name returns route to worker threads.
+    //Routes are bound to pools at startListen()
+    void setRouteExecutorPool(const QString &routeName, const QString &poolName);
+    //Answers not smaller than threshold are compressed with gzip or deflate if client accepts it.
+    //Level is zlib one (1-9), 0 disables compression. Chunked answers are sent as is
+    void setCompressionThreshold(int bytes);
+    void setCompressionLevel(int level);
+    //Answers of CACHEABLE methods are cached by request method and uri for this time, 0 means until invalidated
+    void setResponseCacheTtl(int msecs);
+    //Route name is method name for rest_ methods (e.g. "rest_get_Orders") and pattern for typed routes
+    void invalidateResponseCache();
+    void invalidateResponseCache(const QString &routeName);
+    //healthStatus() result is reused by GET /system/status during this time, 0 means fetching it for each request
+    void setHealthStatusCacheTtl(int msecs, bool quick = false);
 
     void setCustomHeader(const QString &header, const QString &value);
     QString customHeader(const QString &header) const;
     bool containsCustomHeader(const QString &header) const;
     void unsetCustomHeader(const QString &header);
 
+    //With handoff socket path set, blocks server thread while listening socket is taken over from previous process
+    //(up to 2 seconds if it doesn't answer), tcp port is listened as usual if takeover fails
     void startListen();
     void stopListen();
+    //Stops accepting connections and closes idle ones, connections with requests in progress are closed after
+    //their answers. drainProgress() is emitted until all connections are closed or deadline passes.
+    //Returned future is filled with false if some connections are still open at deadline.
+    //Server is not restarted by itself, startListen() should be called to serve new connections again
+    Future<bool> drain(int msecs);
 
 signals:
     void userNameChanged(const QString &arg);
@@ -84,24 +225,75 @@ signals:
     void pathPrefixChanged(const QString &arg);
     void portChanged(int arg);
     void authTypeChanged(Proof::RestAuthType arg);
+    void drainProgress(int inFlightRequests, int openSockets);
+    void listeningSocketHandedOff();
 
 protected slots:
-    NO_AUTH_REQUIRED void rest_get_System_Status(QTcpSocket *socket, const QStringList &headers,
-                                                 const QStringList &methodVariableParts, const QUrlQuery &query,
-                                                 const QByteArray &body);
+    NO_AUTH_REQUIRED HIGH_PRIORITY void rest_get_System_Status(QTcpSocket *socket, const QStringList &headers,
+                                                               const QStringList &methodVariableParts,
+                                                               const QUrlQuery &query, const QByteArray &body);
     NO_AUTH_REQUIRED void rest_get_System_RecentErrors(QTcpSocket *socket, const QStringList &headers,
                                                        const QStringList &methodVariableParts, const QUrlQuery &query,
                                                        const QByteArray &body);
+    NO_AUTH_REQUIRED HIGH_PRIORITY void rest_get_System_Metrics(QTcpSocket *socket, const QStringList &headers,
+                                                                const QStringList &methodVariableParts,
+                                                                const QUrlQuery &query, const QByteArray &body);
+    //Each item is checked for authorization by itself with headers of batch request
+    NO_AUTH_REQUIRED Future<RestResponse> rest_post_System_Batch(QTcpSocket *socket, const QStringList &headers,
+                                                                 const QStringList &methodVariableParts,
+                                                                 const QUrlQuery &query, const QByteArray &body);
 
 protected:
+    //GET /system/status waits for result at most 10 seconds, previous status is answered after that (503 if none).
+    //Status has generated_at field with time when returned snapshot was built, not time of request
     virtual Future<HealthStatusMap> healthStatus(bool quick) const;
 
+    //Registers typed route in addition to rest_ methods, should be called before startListen().
+    //Pattern looks like "GET /orders/{id:int}/items?{limit:uint}&{filter}", parameter type can be omitted.
+    //Handler signature is void(QTcpSocket *, <path parameters>, <query parameters>[, const QByteArray &body]),
+    //supported parameter types are integral, floating point, bool and QString, query ones can be std::optional.
+    //Request is answered with 400 if some parameter can't be converted.
+    //Handler can return Future<RestResponse> or CancelableFuture<RestResponse> instead of void, same as rest_ methods.
+    //Tags are the same as for rest_ methods (NO_AUTH_REQUIRED, STREAMING_BODY, HIGH_PRIORITY, CACHEABLE).
+    template <auto Method>
+    void route(const QString &pattern, const QStringList &tags = QStringList())
+    {
+        using Traits = RestRouteHelpers::MethodTraits<decltype(Method)>;
+        static_assert(std::is_base_of_v<AbstractRestServer, typename Traits::Class>,
+                      "Route handler should be a method of AbstractRestServer descendant");
+        static constexpr auto parameters = RestRouteHelpers::parameters<Traits>();
+        addTypedRoute(pattern, tags, parameters.data(), static_cast<int>(parameters.size()),
+                      &RestRouteHelpers::invoke<Method>);
+    }
+    void addTypedRoute(const QString &pattern, const QStringList &tags, const RestRouteParameter *parameters,
+                       int parametersCount, RestRouteInvoker invoker);
+
     void incomingConnection(qintptr socketDescriptor) override;
 
     void sendAnswer(QTcpSocket *socket, const QByteArray &body, const QString &contentType, int returnCode = 200,
                     const QString &reason = QString());
     void sendAnswer(QTcpSocket *socket, const QByteArray &body, const QString &contentType,
                     const QHash<QString, QString> &headers, int returnCode = 200, const QString &reason = QString());
+    //Answer is sent from socket's thread when future is filled, failed future is answered with 500.
+    //Methods can return these futures instead of void, then they are passed here automatically.
+    //CancelableFuture is canceled if client disconnects before it is filled.
+    void sendAnswer(QTcpSocket *socket, const Future<RestResponse> &response);
+    void sendAnswer(QTcpSocket *socket, const CancelableFuture<RestResponse> &response);
+    //On Linux file is copied to socket by kernel with sendfile(), elsewhere (and for epoll backend sockets)
+    //it is sent from memory mapped windows by chunks, so memory usage doesn't depend on its size.
+    //Single byte Range, If-Range, If-None-Match and If-Modified-Since request headers are supported,
+    //answer has ETag and Last-Modified headers. Missing file is answered with 404
+    void sendFile(QTcpSocket *socket, const QString &filePath,
+                  const QString &contentType = QStringLiteral("application/octet-stream"),
+                  const QHash<QString, QString> &headers = QHash<QString, QString>());
+    //Chunked answer is written with Transfer-Encoding: chunked and should be finished with finishChunkedAnswer().
+    //Future returned by writeAnswerChunk() is filled when socket is ready for next chunk,
+    //false means that socket is closed and there is no sense to continue.
+    void startChunkedAnswer(QTcpSocket *socket, const QString &contentType,
+                            const QHash<QString, QString> &headers = QHash<QString, QString>(), int returnCode = 200,
+                            const QString &reason = QString());
+    Future<bool> writeAnswerChunk(QTcpSocket *socket, const QByteArray &chunk);
+    void finishChunkedAnswer(QTcpSocket *socket);
     void sendErrorCode(QTcpSocket *socket, int returnCode, const QString &reason, int errorCode,
                        const QStringList &args = QStringList());
     template <class Enum>
@@ -116,6 +308,13 @@ protected:
     void sendConflict(QTcpSocket *socket, const QString &reason = QStringLiteral("Conflict"));
     void sendInternalError(QTcpSocket *socket);
     void sendNotImplemented(QTcpSocket *socket, const QString &reason = QStringLiteral("Not Implemented"));
+    //Methods marked with STREAMING_BODY are called right after headers with empty body,
+    //they should use this method to read body in chunks.
+    //For other methods whole body is passed to consumer as single chunk.
+    void readRequestBody(QTcpSocket *socket, const RequestBodyConsumer &consumer);
+    //Token of request that is currently handled at socket, should be called from method itself.
+    //Method and futures started by it can check it to stop work nobody will wait for
+    RestCancellationToken cancellationToken(QTcpSocket *socket);
     bool checkBasicAuth(const QString &encryptedAuth) const;
     QString parseAuth(QTcpSocket *socket, const QString &header);
 
@@ -57,7 +57,14 @@ enum class RestAuthType
     Wsse,
     BearerToken
 };
+
+enum class RestServerIoBackend
+{
+    Qt,
+    Epoll
+};
 } // namespace Proof
 
 Q_DECLARE_METATYPE(Proof::RestAuthType)
+Q_DECLARE_METATYPE(Proof::RestServerIoBackend)
 #endif // PROOFNETWORK_TYPES_H
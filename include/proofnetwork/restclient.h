@@ -85,6 +85,11 @@ public:
     int msecsForTimeout() const;
     void setMsecsForTimeout(int arg);
 
+    //Requests are sent over this Unix domain socket instead of TCP if it is set. Host is still sent in Host header,
+    //redirects are not followed and multipart requests and requests by full url always use TCP
+    QString localSocketPath() const;
+    void setLocalSocketPath(const QString &arg);
+
     bool followRedirects() const;
     void setFollowRedirects(bool arg);
 
@@ -123,6 +128,7 @@ signals:
     void authTypeChanged(Proof::RestAuthType arg);
     void msecsForTimeoutChanged(qlonglong arg);
     void followRedirectsChanged(bool arg);
+    void localSocketPathChanged(const QString &arg);
 };
 
 } // namespace Proof
@@ -0,0 +1,214 @@
+/* Copyright 2018, OpenSoft Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright notice, this list of
+ * conditions and the following disclaimer in the documentation and/or other materials provided
+ * with the distribution.
+ *     * Neither the name of OpenSoft Inc. nor the names of its contributors may be used to endorse
+ * or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#ifndef RESTROUTEHELPERS_H
+#define RESTROUTEHELPERS_H
+
+#include "proofnetwork/proofnetwork_global.h"
+
+#include <QByteArray>
+#include <QString>
+#include <QVarLengthArray>
+
+#include <array>
+#include <limits>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+class QTcpSocket;
+
+namespace Proof {
+class AbstractRestServer;
+
+//Raw values extracted by router for typed route, they are converted to handler arguments right before call
+struct RestRouteArguments
+{
+    QTcpSocket *socket = nullptr;
+    //In pattern order
+    QVarLengthArray<QByteArray, 4> pathValues;
+    //In pattern order, null if parameter is missing in request
+    QVarLengthArray<QByteArray, 4> queryValues;
+    QByteArray body;
+};
+
+struct RestRouteParameter
+{
+    const char *type;
+    bool optional;
+};
+
+//Returns false if some of arguments can't be converted to handler argument types
+using RestRouteInvoker = bool (*)(AbstractRestServer *, const RestRouteArguments &);
+
+struct RestRouteHelpers
+{
+    RestRouteHelpers() = delete;
+    RestRouteHelpers(const RestRouteHelpers &) = delete;
+    RestRouteHelpers &operator=(const RestRouteHelpers &) = delete;
+    RestRouteHelpers(RestRouteHelpers &&) = delete;
+    RestRouteHelpers &operator=(RestRouteHelpers &&) = delete;
+    ~RestRouteHelpers() = delete;
+
+    template <typename T>
+    struct IsOptional : std::false_type
+    {};
+    template <typename T>
+    struct IsOptional<std::optional<T>> : std::true_type
+    {};
+
+    template <typename... Args>
+    struct IsLastByteArray : std::false_type
+    {};
+    template <typename Last>
+    struct IsLastByteArray<Last> : std::is_same<std::decay_t<Last>, QByteArray>
+    {};
+    template <typename First, typename Second, typename... Rest>
+    struct IsLastByteArray<First, Second, Rest...> : IsLastByteArray<Second, Rest...>
+    {};
+
+    template <typename Method>
+    struct MethodTraits;
+    template <typename R, typename C, typename... Args>
+    struct MethodTraits<R (C::*)(QTcpSocket *, Args...)>
+    {
+        using Class = C;
+        using Result = R;
+        using Arguments = std::tuple<std::decay_t<Args>...>;
+        static constexpr bool hasBody = IsLastByteArray<Args...>::value;
+        static constexpr size_t parametersCount = sizeof...(Args) - (hasBody ? 1 : 0);
+    };
+
+    template <typename T>
+    static constexpr RestRouteParameter parameter()
+    {
+        if constexpr (IsOptional<T>::value) {
+            return {parameter<typename T::value_type>().type, true};
+        } else if constexpr (std::is_same_v<T, bool>) {
+            return {"bool", false};
+        } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+            return {"int", false};
+        } else if constexpr (std::is_integral_v<T>) {
+            return {"uint", false};
+        } else if constexpr (std::is_floating_point_v<T>) {
+            return {"double", false};
+        } else {
+            static_assert(std::is_same_v<T, QString>,
+                          "Only integral, floating point, bool and QString route parameters are supported");
+            return {"string", false};
+        }
+    }
+
+    template <typename Traits>
+    static constexpr auto parameters()
+    {
+        return parametersImpl<typename Traits::Arguments>(std::make_index_sequence<Traits::parametersCount>());
+    }
+
+    template <typename T>
+    static bool convert(const QByteArray &raw, T &result)
+    {
+        if constexpr (IsOptional<T>::value) {
+            if (raw.isNull()) {
+                result.reset();
+                return true;
+            }
+            typename T::value_type value;
+            if (!convert(raw, value))
+                return false;
+            result = std::move(value);
+            return true;
+        } else {
+            if (raw.isNull())
+                return false;
+            bool ok = false;
+            if constexpr (std::is_same_v<T, bool>) {
+                ok = raw == "true" || raw == "1" || raw == "false" || raw == "0";
+                result = raw == "true" || raw == "1";
+            } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+                qlonglong value = raw.toLongLong(&ok);
+                ok = ok && value >= std::numeric_limits<T>::min() && value <= std::numeric_limits<T>::max();
+                result = static_cast<T>(value);
+            } else if constexpr (std::is_integral_v<T>) {
+                qulonglong value = raw.toULongLong(&ok);
+                ok = ok && !raw.startsWith('-') && value <= std::numeric_limits<T>::max();
+                result = static_cast<T>(value);
+            } else if constexpr (std::is_floating_point_v<T>) {
+                result = static_cast<T>(raw.toDouble(&ok));
+            } else {
+                result = QString::fromUtf8(QByteArray::fromPercentEncoding(raw));
+                ok = true;
+            }
+            return ok;
+        }
+    }
+
+    template <auto Method>
+    static bool invoke(AbstractRestServer *server, const RestRouteArguments &args)
+    {
+        using Traits = MethodTraits<decltype(Method)>;
+        return invokeImpl<Method, Traits>(server, args,
+                                          std::make_index_sequence<std::tuple_size_v<typename Traits::Arguments>>());
+    }
+
+private:
+    template <typename Arguments, size_t... I>
+    static constexpr std::array<RestRouteParameter, sizeof...(I)> parametersImpl(std::index_sequence<I...>)
+    {
+        return {{parameter<std::tuple_element_t<I, Arguments>>()...}};
+    }
+
+    template <typename T>
+    static bool fetch(const RestRouteArguments &args, int index, T &result)
+    {
+        if constexpr (std::is_same_v<T, QByteArray>) {
+            Q_UNUSED(index)
+            result = args.body;
+            return true;
+        } else {
+            if (index < args.pathValues.count())
+                return convert(args.pathValues[index], result);
+            index -= args.pathValues.count();
+            return convert(index < args.queryValues.count() ? args.queryValues[index] : QByteArray(), result);
+        }
+    }
+
+    template <auto Method, typename Traits, size_t... I>
+    static bool invokeImpl(AbstractRestServer *server, const RestRouteArguments &args, std::index_sequence<I...>)
+    {
+        typename Traits::Arguments values;
+        if (!(fetch(args, static_cast<int>(I), std::get<I>(values)) && ...))
+            return false;
+        auto *typedServer = static_cast<typename Traits::Class *>(server);
+        if constexpr (std::is_void_v<typename Traits::Result>)
+            (typedServer->*Method)(args.socket, std::get<I>(values)...);
+        else
+            typedServer->sendAnswer(args.socket, (typedServer->*Method)(args.socket, std::get<I>(values)...));
+        return true;
+    }
+};
+} // namespace Proof
+
+#endif // RESTROUTEHELPERS_H
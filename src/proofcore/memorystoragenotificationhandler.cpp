@@ -30,6 +30,8 @@
 #include <QMutexLocker>
 #include <QTimer>
 
+#include <deque>
+
 static const qlonglong MSECS_TO_KEEP = 1000 * 60 * 60 * 24; //24 hours
 
 namespace Proof {
@@ -37,7 +39,11 @@ class MemoryStorageNotificationHandlerPrivate : public AbstractNotificationHandl
 {
     Q_DECLARE_PUBLIC(MemoryStorageNotificationHandler)
 
-    QMultiMap<QDateTime, QString> messages;
+    //Ordered by id, ids are sequential so message position can be calculated without search
+    std::deque<MemoryStorageNotificationHandler::Message> messages;
+    quint64 nextId = 1;
+    //0 means no limit
+    int maxMessagesCount = 0;
     QPair<QDateTime, QString> lastMessage;
     mutable QMutex mutex;
     QTimer *cleanupTimer = nullptr;
@@ -58,8 +64,8 @@ MemoryStorageNotificationHandler::MemoryStorageNotificationHandler(const QString
     connect(d->cleanupTimer, &QTimer::timeout, this, [d]() {
         QDateTime limiter = QDateTime::currentDateTimeUtc().addMSecs(-MSECS_TO_KEEP);
         d->mutex.lock();
-        while (!d->messages.isEmpty() && d->messages.firstKey() < limiter)
-            d->messages.remove(d->messages.firstKey());
+        while (!d->messages.empty() && d->messages.front().time < limiter)
+            d->messages.pop_front();
         d->mutex.unlock();
     });
     d->cleanupTimer->start();
@@ -69,7 +75,10 @@ QMultiMap<QDateTime, QString> MemoryStorageNotificationHandler::messages() const
 {
     Q_D_CONST(MemoryStorageNotificationHandler);
     QMutexLocker locker(&d->mutex);
-    return d->messages;
+    QMultiMap<QDateTime, QString> result;
+    for (const auto &message : d->messages)
+        result.insert(message.time, message.text);
+    return result;
 }
 
 QPair<QDateTime, QString> MemoryStorageNotificationHandler::lastMessage() const
@@ -79,15 +88,60 @@ QPair<QDateTime, QString> MemoryStorageNotificationHandler::lastMessage() const
     return d->lastMessage;
 }
 
+int MemoryStorageNotificationHandler::forEachRecentMessage(const std::function<bool(const Message &)> &visitor,
+                                                           quint64 beforeId, const QDateTime &since, int limit,
+                                                           ErrorNotifier::Severity minSeverity) const
+{
+    Q_D_CONST(MemoryStorageNotificationHandler);
+    QMutexLocker locker(&d->mutex);
+    if (d->messages.empty() || !limit)
+        return 0;
+    quint64 firstId = d->messages.front().id;
+    if (beforeId && beforeId <= firstId)
+        return 0;
+    auto it = d->messages.crbegin();
+    if (beforeId && beforeId <= d->messages.back().id)
+        it += static_cast<qint64>(d->messages.back().id - beforeId + 1);
+
+    int visited = 0;
+    for (; it != d->messages.crend(); ++it) {
+        if (since.isValid() && it->time < since)
+            break;
+        if (it->severity < minSeverity)
+            continue;
+        ++visited;
+        if (!visitor(*it) || visited == limit)
+            break;
+    }
+    return visited;
+}
+
+int MemoryStorageNotificationHandler::maxMessagesCount() const
+{
+    Q_D_CONST(MemoryStorageNotificationHandler);
+    QMutexLocker locker(&d->mutex);
+    return d->maxMessagesCount;
+}
+
+void MemoryStorageNotificationHandler::setMaxMessagesCount(int count)
+{
+    Q_D(MemoryStorageNotificationHandler);
+    QMutexLocker locker(&d->mutex);
+    d->maxMessagesCount = qMax(0, count);
+    while (d->maxMessagesCount && d->messages.size() > static_cast<size_t>(d->maxMessagesCount))
+        d->messages.pop_front();
+}
+
 void MemoryStorageNotificationHandler::notify(const QString &message, ErrorNotifier::Severity severity,
                                               const QString &packId)
 {
     Q_UNUSED(packId)
-    Q_UNUSED(severity)
     Q_D(MemoryStorageNotificationHandler);
     d->mutex.lock();
     d->lastMessage = qMakePair(QDateTime::currentDateTimeUtc(), message);
-    d->messages.insert(d->lastMessage.first, message);
+    d->messages.push_back({d->nextId++, d->lastMessage.first, message, severity});
+    if (d->maxMessagesCount && d->messages.size() > static_cast<size_t>(d->maxMessagesCount))
+        d->messages.pop_front();
     d->mutex.unlock();
 }
 
@@ -30,92 +30,634 @@
 #include "proofcore/proofglobal.h"
 #include "proofcore/proofobject.h"
 
+#include "proofnetwork/epollsocket_p.h"
+#include "proofnetwork/httpcompression_p.h"
 #include "proofnetwork/httpparser_p.h"
+#include "proofnetwork/restresponsecache_p.h"
+#include "proofnetwork/restrouter_p.h"
+#include "proofnetwork/restservermetrics_p.h"
 
+#include <QDeadlineTimer>
 #include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
 #include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <QLocalServer>
+#include <QLocale>
 #include <QMetaMethod>
 #include <QMetaObject>
 #include <QMutex>
 #include <QNetworkInterface>
-#include <QReadWriteLock>
+#include <QPointer>
+#include <QRandomGenerator>
+#include <QRunnable>
 #include <QSet>
+#include <QSharedPointer>
+#include <QSocketNotifier>
 #include <QSysInfo>
 #include <QTcpSocket>
+#include <QTemporaryFile>
+#include <QThreadPool>
+#include <QTimer>
 #include <QUrlQuery>
 
+#ifdef Q_OS_UNIX
+#    include <poll.h>
+#    include <sys/socket.h>
+#    include <sys/un.h>
+#    include <unistd.h>
+#endif
+
+#ifdef Q_OS_LINUX
+#    include <sys/sendfile.h>
+
+#    include <cerrno>
+#endif
+
 #include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <utility>
+#include <vector>
 
 static constexpr int MIN_THREADS_COUNT = 5;
+static constexpr int DEFAULT_KEEP_ALIVE_TIMEOUT = 15000;
+static constexpr int DEFAULT_MAX_REQUESTS_PER_CONNECTION = 1000;
+//Worker without sockets during two consecutive checks is stopped, checks are done twice per idle worker timeout
+static constexpr int DEFAULT_IDLE_WORKER_TIMEOUT = 60000;
+//Idle keep-alive sockets are closed by one sweep per worker, a quarter of keep-alive timeout is the allowed overshoot
+static constexpr int IDLE_SOCKETS_SWEEP_MIN_INTERVAL = 100;
+static constexpr int IDLE_SOCKETS_SWEEP_MAX_INTERVAL = 1000;
+//Limits amount of data read from socket while streamed body chunk is being consumed
+static constexpr qint64 STREAMING_READ_BUFFER_SIZE = 256 * 1024;
+//Bodies bigger than this are kept in memory mapped temporary files instead of memory
+static constexpr qlonglong DEFAULT_REQUEST_BODY_SPILL_THRESHOLD = 8 * 1024 * 1024;
+//Chunked answer writers are paused when socket has more than high watermark bytes to write
+//and resumed when it drops below low watermark
+static constexpr qint64 ANSWER_STREAM_HIGH_WATERMARK = 512 * 1024;
+static constexpr qint64 ANSWER_STREAM_LOW_WATERMARK = 128 * 1024;
+//Seconds in Retry-After header of answers rejected by admission limits
+static constexpr int LOAD_SHEDDING_RETRY_AFTER = 1;
+static constexpr int DEFAULT_COMPRESSION_THRESHOLD = 1024;
+static constexpr int DEFAULT_COMPRESSION_LEVEL = 6;
+//Bigger bodies are compressed in thread pool to not block other sockets of worker
+static constexpr int COMPRESSION_OFFLOAD_SIZE = 64 * 1024;
+//Bodies up to this size are copied to the same buffer with headers to be written at once
+static constexpr int SINGLE_WRITE_BODY_LIMIT = 64 * 1024;
+//Files are mapped by windows of this size and written to socket by chunks while it is below high watermark
+static constexpr qint64 FILE_MAP_WINDOW_SIZE = 16 * 1024 * 1024;
+static constexpr qint64 FILE_ANSWER_CHUNK_SIZE = 256 * 1024;
+//Network addresses and crashes in GET /system/status are refreshed in background with this interval,
+//crashes are also refreshed when crashes directory is changed
+static constexpr int STATUS_REFRESH_INTERVAL = 60000;
+//Changes of crashes directory (it is home dir, so there can be lots of them) are collected during this time
+static constexpr int CRASHES_REFRESH_DELAY = 1000;
+static constexpr int DEFAULT_HEALTH_STATUS_CACHE_TTL = 5000;
+static constexpr int DEFAULT_QUICK_HEALTH_STATUS_CACHE_TTL = 1000;
+//Requests waiting for healthStatus() longer than that get previous snapshot or 503
+static constexpr int HEALTH_STATUS_TIMEOUT = 10000;
+//GET /system/recent-errors is written by chunks of this number of messages, storage is locked only while chunk is built
+static constexpr int RECENT_ERRORS_CHUNK_SIZE = 256;
+static constexpr int MAX_BATCH_ITEMS = 100;
+static constexpr int DRAIN_PROGRESS_INTERVAL = 100;
+static constexpr int DEFAULT_HANDOFF_DRAIN_TIMEOUT = 30000;
+//Max time startListen() of new process is blocked by taking listening socket over from previous one
+static constexpr int HANDOFF_TIMEOUT = 2000;
 
 namespace {
 class WorkerThread;
 
-class MethodNode
+enum class AnswerStream
 {
-public:
-    MethodNode();
-    bool contains(const QString &name) const;
-    void clear();
+    None,
+    Chunked,
+    UntilClose,
+    File
+};
 
-    operator QString() const; // NOLINT(google-explicit-constructor)
-    MethodNode &operator[](const QString &name);
-    void setValue(const QString &value);
+enum class RangeResult
+{
+    Ignored,
+    Satisfiable,
+    Unsatisfiable
+};
 
-    QString tag() const;
-    void setTag(const QString &tag);
+//File that is being sent, end is exclusive
+struct FileAnswer
+{
+    QFile file;
+    qint64 position = 0;
+    qint64 end = 0;
+    uchar *window = nullptr;
+    qint64 windowStart = 0;
+    qint64 windowSize = 0;
+    //Some file systems don't support mapping, file is read by chunks then
+    bool mapFailed = false;
+    //Set for sockets with native descriptor on Linux, file is copied to socket by kernel with sendfile() then
+    bool useSendfile = false;
+    //Enabled only while socket is not writable and Qt has nothing to write to it
+    QScopedPointer<QSocketNotifier, QScopedPointerDeleteLater> writeNotifier;
+};
 
-private:
-    QHash<QString, MethodNode> m_nodes;
-    QString m_value;
-    QString m_tag;
+struct PrecomputedStatusLine
+{
+    int code;
+    const char *reason;
+    QByteArray line;
 };
 
-struct WorkerThreadInfo
+QByteArray statusLine(int returnCode, const QString &reason)
+{
+    //Status lines that are used by server itself and default reasons from send* methods
+    static const PrecomputedStatusLine precomputed[] = {
+        {200, "", QByteArrayLiteral("HTTP/1.1 200 \r\n")},
+        {200, "OK", QByteArrayLiteral("HTTP/1.1 200 OK\r\n")},
+        {206, "Partial Content", QByteArrayLiteral("HTTP/1.1 206 Partial Content\r\n")},
+        {304, "Not Modified", QByteArrayLiteral("HTTP/1.1 304 Not Modified\r\n")},
+        {400, "Bad Request", QByteArrayLiteral("HTTP/1.1 400 Bad Request\r\n")},
+        {401, "Unauthorized", QByteArrayLiteral("HTTP/1.1 401 Unauthorized\r\n")},
+        {404, "Not Found", QByteArrayLiteral("HTTP/1.1 404 Not Found\r\n")},
+        {409, "Conflict", QByteArrayLiteral("HTTP/1.1 409 Conflict\r\n")},
+        {413, "Payload Too Large", QByteArrayLiteral("HTTP/1.1 413 Payload Too Large\r\n")},
+        {500, "Internal Server Error", QByteArrayLiteral("HTTP/1.1 500 Internal Server Error\r\n")},
+        {501, "Not Implemented", QByteArrayLiteral("HTTP/1.1 501 Not Implemented\r\n")}};
+    for (const auto &status : precomputed) {
+        if (status.code == returnCode && reason == QLatin1String(status.reason))
+            return status.line;
+    }
+    return "HTTP/1.1 " + QByteArray::number(returnCode) + ' ' + reason.toUtf8() + "\r\n";
+}
+
+QHash<QString, QString> compressedAnswerHeaders(const QHash<QString, QString> &headers, const QByteArray &encoding)
+{
+    QHash<QString, QString> result = headers;
+    result[QStringLiteral("Content-Encoding")] = QString::fromLatin1(encoding);
+    result[QStringLiteral("Vary")] = QStringLiteral("Accept-Encoding");
+    return result;
+}
+
+QString httpDate(const QDateTime &time)
+{
+    return QLocale::c().toString(time.toUTC(), QStringLiteral("ddd, dd MMM yyyy hh:mm:ss 'GMT'"));
+}
+
+QDateTime fromHttpDate(const QByteArray &value)
+{
+    QDateTime result = QLocale::c().toDateTime(QString::fromLatin1(value.trimmed()),
+                                               QStringLiteral("ddd, dd MMM yyyy hh:mm:ss 'GMT'"));
+    result.setTimeSpec(Qt::UTC);
+    return result;
+}
+
+//Only single byte range is supported, whole file is sent for multiple ones
+RangeResult parseRange(const QByteArray &value, qint64 size, qint64 *start, qint64 *end)
+{
+    const QByteArray trimmed = value.trimmed();
+    if (!trimmed.startsWith("bytes=") || trimmed.contains(','))
+        return RangeResult::Ignored;
+    const QByteArray spec = trimmed.mid(6);
+    const int dash = spec.indexOf('-');
+    if (dash < 0)
+        return RangeResult::Ignored;
+    const QByteArray first = spec.left(dash).trimmed();
+    const QByteArray last = spec.mid(dash + 1).trimmed();
+    bool firstOk = false;
+    bool lastOk = false;
+    const qint64 firstPos = first.toLongLong(&firstOk);
+    const qint64 lastPos = last.toLongLong(&lastOk);
+
+    if (first.isEmpty()) {
+        //Suffix range, last bytes of file are requested
+        if (!lastOk || lastPos < 0)
+            return RangeResult::Ignored;
+        if (lastPos == 0 || size == 0)
+            return RangeResult::Unsatisfiable;
+        *start = qMax(0ll, size - lastPos);
+        *end = size;
+        return RangeResult::Satisfiable;
+    }
+    if (!firstOk || firstPos < 0 || (!last.isEmpty() && (!lastOk || lastPos < firstPos)))
+        return RangeResult::Ignored;
+    if (firstPos >= size)
+        return RangeResult::Unsatisfiable;
+    *start = firstPos;
+    *end = last.isEmpty() ? size : qMin(lastPos + 1, size);
+    return RangeResult::Satisfiable;
+}
+
+QString crashesDirPath()
+{
+    QByteArray homePath = qgetenv("HOME");
+    return homePath.isEmpty() ? QStringLiteral("/tmp") : QString::fromLocal8Bit(homePath);
+}
+
+QString lastCrashAt()
+{
+    QString result(QStringLiteral("N/A"));
+#if (defined(Q_OS_LINUX) && !defined(Q_OS_ANDROID)) || defined(Q_OS_MAC)
+    QDir homeDir(crashesDirPath());
+    QFileInfoList crashes = homeDir.entryInfoList({"proof_crash_*"}, QDir::Files);
+    if (!crashes.isEmpty()) {
+        QDateTime mostRecentCrash = crashes.first().lastModified();
+        for (const auto &crash : crashes) {
+            if (crash.lastModified() > mostRecentCrash)
+                mostRecentCrash = crash.lastModified();
+        }
+        result = mostRecentCrash.toUTC().toString(Qt::ISODate);
+    }
+#endif
+    return result;
+}
+
+const QStringList &severityNames()
+{
+    static const QStringList names = {QStringLiteral("info"), QStringLiteral("warning"), QStringLiteral("error"),
+                                      QStringLiteral("critical")};
+    return names;
+}
+
+QByteArray recentErrorJson(const Proof::MemoryStorageNotificationHandler::Message &message)
+{
+    return QJsonDocument(QJsonObject{{"timestamp", message.time.toString(Qt::ISODate)},
+                                     {"message", message.text},
+                                     {"severity", severityNames().value(static_cast<int>(message.severity))}})
+        .toJson(QJsonDocument::Compact);
+}
+
+//Socket of batch item, it is never connected and keeps everything written to it as answer
+class BatchItemSocket : public QTcpSocket
 {
-    WorkerThreadInfo() {}
-    explicit WorkerThreadInfo(WorkerThread *thread, long long socketCount) : thread(thread)
+public:
+    BatchItemSocket()
     {
-        this->socketCount = socketCount;
+        setSocketState(QAbstractSocket::ConnectedState);
+        setOpenMode(QIODevice::ReadWrite | QIODevice::Unbuffered);
     }
-    ~WorkerThreadInfo() {}
+    BatchItemSocket(const BatchItemSocket &) = delete;
+    BatchItemSocket &operator=(const BatchItemSocket &) = delete;
+    BatchItemSocket(BatchItemSocket &&) = delete;
+    BatchItemSocket &operator=(BatchItemSocket &&) = delete;
+    ~BatchItemSocket() { setSocketState(QAbstractSocket::UnconnectedState); }
 
-    WorkerThreadInfo(const WorkerThreadInfo &other) { *this = other; }
-    WorkerThreadInfo &operator=(const WorkerThreadInfo &other)
+    QByteArray takeAnswer() { return std::exchange(m_answer, QByteArray()); }
+
+protected:
+    qint64 readData(char *, qint64) override { return 0; }
+    qint64 writeData(const char *data, qint64 size) override
     {
-        thread = other.thread;
-        socketCount.store(other.socketCount);
-        return *this;
+        m_answer.append(data, static_cast<int>(size));
+        return size;
+    }
+
+private:
+    QByteArray m_answer;
+};
+
+//Headers of batch request that are not passed to its items
+bool isBatchHopHeader(const QByteArray &name)
+{
+    static const QSet<QByteArray> hopHeaders = {"content-length",    "transfer-encoding", "connection",
+                                                "keep-alive",        "expect",            "accept-encoding",
+                                                "if-none-match",     "if-modified-since", "range",
+                                                "if-range",          "x-request-timeout"};
+    return hopHeaders.contains(name.toLower());
+}
+
+//Returns empty array if item is malformed
+QByteArray batchItemRequest(const QJsonObject &item, const QStringList &headers, const QDeadlineTimer &deadline,
+                            QString *error)
+{
+    const QByteArray method = item.value(QStringLiteral("method")).toString(QStringLiteral("GET")).toUpper().toLatin1();
+    QByteArray path = item.value(QStringLiteral("path")).toString().toUtf8();
+    bool isValidMethod = !method.isEmpty()
+                         && std::all_of(method.cbegin(), method.cend(), [](char c) { return c >= 'A' && c <= 'Z'; });
+    if (!isValidMethod) {
+        *error = QStringLiteral("Wrong method");
+        return QByteArray();
     }
-    WorkerThreadInfo(WorkerThreadInfo &&other) noexcept { *this = other; }
-    WorkerThreadInfo &operator=(WorkerThreadInfo &&other) noexcept
+    if (!path.startsWith('/') || path.contains(' ') || path.contains('\r') || path.contains('\n')) {
+        *error = QStringLiteral("Wrong path");
+        return QByteArray();
+    }
+
+    const QJsonValue query = item.value(QStringLiteral("query"));
+    QByteArray encodedQuery;
+    if (query.isObject()) {
+        QUrlQuery urlQuery;
+        const QJsonObject queryObject = query.toObject();
+        for (auto it = queryObject.begin(); it != queryObject.end(); ++it)
+            urlQuery.addQueryItem(it.key(), it.value().toVariant().toString());
+        encodedQuery = urlQuery.toString(QUrl::FullyEncoded).toLatin1();
+    } else if (query.isString()) {
+        encodedQuery = QUrl::toPercentEncoding(query.toString(), "=&+");
+    }
+    if (!encodedQuery.isEmpty())
+        path += (path.contains('?') ? '&' : '?') + encodedQuery;
+
+    const QJsonValue bodyValue = item.value(QStringLiteral("body"));
+    QByteArray body;
+    if (bodyValue.isString())
+        body = bodyValue.toString().toUtf8();
+    else if (bodyValue.isObject())
+        body = QJsonDocument(bodyValue.toObject()).toJson(QJsonDocument::Compact);
+    else if (bodyValue.isArray())
+        body = QJsonDocument(bodyValue.toArray()).toJson(QJsonDocument::Compact);
+
+    QByteArray request = method + ' ' + path + " HTTP/1.1\r\n";
+    for (const QString &header : headers) {
+        const QByteArray line = header.toUtf8();
+        if (!isBatchHopHeader(line.left(line.indexOf(':')).trimmed()))
+            request += line + "\r\n";
+    }
+    if (!deadline.isForever())
+        request += "X-Request-Timeout: " + QByteArray::number(qMax(1ll, deadline.remainingTime())) + "\r\n";
+    request += "Content-Length: " + QByteArray::number(body.size()) + "\r\n\r\n" + body;
+    return request;
+}
+
+Proof::RestResponse parseBatchItemAnswer(const QByteArray &answer)
+{
+    Proof::RestResponse result;
+    const int headEnd = answer.indexOf("\r\n\r\n");
+    if (!answer.startsWith("HTTP/1.1 ") || headEnd < 0) {
+        result.returnCode = 502;
+        result.reason = QStringLiteral("Bad Gateway");
+        return result;
+    }
+    const QList<QByteArray> lines = answer.left(headEnd).split('\n');
+    const QByteArray statusLine = lines.first().trimmed();
+    result.returnCode = statusLine.mid(9, 3).toInt();
+    result.reason = QString::fromLatin1(statusLine.mid(13));
+
+    bool chunked = false;
+    for (int i = 1; i < lines.count(); ++i) {
+        const QByteArray &line = lines[i];
+        const int colon = line.indexOf(':');
+        if (colon <= 0)
+            continue;
+        const QByteArray name = line.left(colon).trimmed();
+        const QString value = QString::fromUtf8(line.mid(colon + 1).trimmed());
+        if (!qstricmp(name.constData(), "content-type"))
+            result.contentType = value;
+        else if (!qstricmp(name.constData(), "transfer-encoding"))
+            chunked = true;
+        else if (!isBatchHopHeader(name) && qstricmp(name.constData(), "server"))
+            result.headers[QString::fromLatin1(name)] = value;
+    }
+
+    if (!chunked) {
+        result.body = answer.mid(headEnd + 4);
+        return result;
+    }
+    int pos = headEnd + 4;
+    while (pos < answer.size()) {
+        const int sizeEnd = answer.indexOf("\r\n", pos);
+        if (sizeEnd < 0)
+            break;
+        const int chunkSize = answer.mid(pos, sizeEnd - pos).toInt(nullptr, 16);
+        if (chunkSize <= 0)
+            break;
+        result.body += answer.mid(sizeEnd + 2, chunkSize);
+        pos = sizeEnd + 2 + chunkSize + 2;
+    }
+    return result;
+}
+
+QJsonObject batchItemJson(const Proof::RestResponse &response)
+{
+    QJsonObject headers;
+    for (auto it = response.headers.cbegin(); it != response.headers.cend(); ++it)
+        headers[it.key()] = it.value();
+    if (!response.contentType.isEmpty())
+        headers[QStringLiteral("Content-Type")] = response.contentType;
+    QJsonObject result{{QStringLiteral("status"), response.returnCode}, {QStringLiteral("headers"), headers}};
+
+    //JSON answers are embedded as is, other ones are passed as strings or base64 if they are not valid UTF-8
+    if (response.contentType.contains(QLatin1String("json"))) {
+        QJsonParseError parseError;
+        const QJsonDocument doc = QJsonDocument::fromJson(response.body, &parseError);
+        if (parseError.error == QJsonParseError::NoError) {
+            result[QStringLiteral("body")] = doc.isArray() ? QJsonValue(doc.array()) : QJsonValue(doc.object());
+            return result;
+        }
+    }
+    const QString text = QString::fromUtf8(response.body);
+    if (text.toUtf8() == response.body) {
+        result[QStringLiteral("body")] = text;
+    } else {
+        result[QStringLiteral("body")] = QString::fromLatin1(response.body.toBase64());
+        result[QStringLiteral("body_encoding")] = QStringLiteral("base64");
+    }
+    return result;
+}
+
+//Health status of one kind (quick or full) and answer built from it
+struct StatusCache
+{
+    Proof::HealthStatusMap healthStatus;
+    bool hasHealthStatus = false;
+    QDeadlineTimer healthStatusExpiration;
+    //Answer is rebuilt when health status, last error or static part is changed
+    QByteArray answer;
+    QPair<QDateTime, QString> lastError;
+    int staticStatusVersion = -1;
+    //Set while health status is fetched, concurrent requests wait for the same answer
+    bool refreshing = false;
+    Proof::Promise<QByteArray> refreshPromise;
+    //Distinguishes refresh that timed out from the one that replaced it
+    quint64 refreshId = 0;
+};
+
+struct RouteMatch
+{
+    const Proof::RestRouter::Route *route = nullptr;
+    QByteArray path;
+    int variablePartsStart = 0;
+    QVarLengthArray<QByteArray, 4> pathValues;
+};
+
+struct ExecutorPool
+{
+    QThreadPool threads;
+    std::atomic_int maxQueuedRequests{0};
+    //Requests that wait for pool thread, running ones are not counted
+    std::atomic_int queuedRequests{0};
+};
+
+#ifdef Q_OS_UNIX
+//Descriptor is passed as SCM_RIGHTS ancillary data with single byte of payload
+bool sendDescriptor(int connection, int descriptor)
+{
+    char payload = 'H';
+    iovec io{&payload, 1};
+    char control[CMSG_SPACE(sizeof(int))] = {};
+    msghdr message{};
+    message.msg_iov = &io;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    cmsghdr *header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int));
+    std::memcpy(CMSG_DATA(header), &descriptor, sizeof(int));
+    pollfd pollDescriptor{connection, POLLOUT, 0};
+    if (::poll(&pollDescriptor, 1, HANDOFF_TIMEOUT) <= 0)
+        return false;
+#    ifdef MSG_NOSIGNAL
+    return ::sendmsg(connection, &message, MSG_NOSIGNAL) == 1;
+#    else
+    return ::sendmsg(connection, &message, 0) == 1;
+#    endif
+}
+
+//Returns -1 if descriptor is not received during timeout
+int receiveDescriptor(int connection, int timeout)
+{
+    pollfd pollDescriptor{connection, POLLIN, 0};
+    if (::poll(&pollDescriptor, 1, timeout) <= 0)
+        return -1;
+    char payload = 0;
+    iovec io{&payload, 1};
+    char control[CMSG_SPACE(sizeof(int))] = {};
+    msghdr message{};
+    message.msg_iov = &io;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    if (::recvmsg(connection, &message, 0) != 1)
+        return -1;
+    cmsghdr *header = CMSG_FIRSTHDR(&message);
+    if (!header || header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS)
+        return -1;
+    int descriptor = -1;
+    std::memcpy(&descriptor, CMSG_DATA(header), sizeof(int));
+    return descriptor;
+}
+
+//Returns -1 if nobody listens at path
+int connectToLocalSocket(const QString &path)
+{
+    const QByteArray encodedPath = QFile::encodeName(path);
+    sockaddr_un address{};
+    if (encodedPath.size() >= static_cast<int>(sizeof(address.sun_path)))
+        return -1;
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, encodedPath.constData(), static_cast<size_t>(encodedPath.size()));
+    int connection = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connection < 0)
+        return -1;
+    if (::connect(connection, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+        ::close(connection);
+        return -1;
+    }
+    return connection;
+}
+#endif
+
+//Accepted Unix domain sockets are handled by workers same way as tcp ones, QTcpSocket works with their descriptors
+class LocalRestServer : public QLocalServer
+{
+    Q_OBJECT
+public:
+    LocalRestServer(const std::function<void(qintptr)> &handler, QObject *parent)
+        : QLocalServer(parent), m_handler(handler)
+    {}
+
+protected:
+    void incomingConnection(quintptr socketDescriptor) override
     {
-        thread = other.thread;
-        socketCount.store(other.socketCount);
-        return *this;
+        m_handler(static_cast<qintptr>(socketDescriptor));
     }
 
-    WorkerThread *thread = nullptr;
-    std::atomic_llong socketCount{0};
+private:
+    std::function<void(qintptr)> m_handler;
+};
+
+class ExecutorPoolTask : public QRunnable
+{
+public:
+    explicit ExecutorPoolTask(const std::function<void()> &task) : m_task(task) {}
+    void run() override { m_task(); }
+
+private:
+    std::function<void()> m_task;
+};
+
+//Set while method is called in executor pool thread, worker's socket info can't be reached from there
+struct ExecutorPoolCall
+{
+    QTcpSocket *socket = nullptr;
+    Proof::RestCancellationToken cancellation;
 };
+thread_local const ExecutorPoolCall *currentExecutorPoolCall = nullptr;
 
 struct SocketInfo
 {
     SocketInfo() {}
 
     Proof::HttpParser parser;
+    //Set for epoll backend, such sockets are read by poller handler instead of readyRead connection
+    Proof::EpollSocket *epollSocket = nullptr;
     QMetaObject::Connection readyReadConnection;
     QMetaObject::Connection disconnectConnection;
     QMetaObject::Connection errorConnection;
+    QMetaObject::Connection bytesWrittenConnection;
+    //Forever while request is handled, checked by worker idle sweep otherwise
+    QDeadlineTimer idleDeadline{QDeadlineTimer::Forever};
+    Proof::RequestBodyConsumer bodyConsumer;
+    QVector<Proof::Promise<bool>> answerWriteWaiters;
+    AnswerStream answerStream = AnswerStream::None;
+    int handledRequests = 0;
+    bool requestInProgress = false;
+    bool keepAlive = false;
+    //Set when socket is closed after answer and incoming data is not needed anymore
+    bool readingStopped = false;
+    bool streamingBody = false;
+    bool bodyFinished = false;
+    bool bodyConsumerBusy = false;
+    //Route of current request in metrics, -1 until request is dispatched
+    int metricsRoute = -1;
+    qint64 receivedBytes = 0;
+    //Measures parse phase until request is dispatched, dispatch phase until answer is started
+    //and write phase after that
+    QElapsedTimer phaseTimer;
+    bool parseStarted = false;
+    //Route of answer that is still in socket buffer
+    int pendingWriteRoute = -1;
+    QElapsedTimer writeTimer;
+    //Accepted over max open sockets limit, only high priority methods are served
+    bool overSocketsLimit = false;
+    //Answer is being compressed in thread pool
+    bool answerPending = false;
+    //Set when cacheable method is called, its answer is stored in cache under this key
+    //if route is not invalidated since call
+    QByteArray cacheKey;
+    QByteArray cacheRoute;
+    quint64 cacheGeneration = 0;
+    //Set while method's future answer is not filled, cancels it if client disconnects
+    std::function<void()> cancelAsyncAnswer;
+    QSharedPointer<FileAnswer> fileAnswer;
+    Proof::RestCancellationToken cancellation;
+    //Started when request is dispatched if it has deadline, stopped when answer is started
+    QTimer *deadlineTimer = nullptr;
+    //Set for batch item sockets, receives whole answer written to socket or empty one if it wasn't answered
+    std::function<void(const QByteArray &)> batchAnswer;
+    //Non-zero for batch item sockets, they are not counted as connections
+    quint64 batchItemId = 0;
 };
 
 class WorkerThread : public QThread
 {
     Q_OBJECT
 public:
-    explicit WorkerThread(Proof::AbstractRestServerPrivate *serverD);
+    WorkerThread(Proof::AbstractRestServerPrivate *serverD, Proof::RestServerMetrics *metrics);
     WorkerThread(const WorkerThread &) = delete;
     WorkerThread &operator=(const WorkerThread &) = delete;
     WorkerThread(WorkerThread &&) = delete;
@@ -124,14 +666,84 @@ public:
 
     void sendAnswer(QTcpSocket *socket, const QByteArray &body, const QString &contentType,
                     const QHash<QString, QString> &headers, int returnCode, const QString &reason);
-    void handleNewConnection(qintptr socketDescriptor);
+    void startChunkedAnswer(QTcpSocket *socket, const QString &contentType, const QHash<QString, QString> &headers,
+                            int returnCode, const QString &reason);
+    void writeAnswerChunk(QTcpSocket *socket, const QByteArray &chunk, const Proof::Promise<bool> &promise);
+    void finishChunkedAnswer(QTcpSocket *socket);
+    void awaitAnswer(QTcpSocket *socket, const Proof::Future<Proof::RestResponse> &response,
+                     const std::function<void()> &cancel);
+    void sendFile(QTcpSocket *socket, const QString &filePath, const QString &contentType,
+                  const QHash<QString, QString> &headers);
+    void handleNewConnection(qintptr socketDescriptor, bool overSocketsLimit);
     void deleteSocket(QTcpSocket *socket);
     void onReadyRead(QTcpSocket *socket);
+    void readRequestBody(QTcpSocket *socket, const Proof::RequestBodyConsumer &consumer);
+    Proof::RestCancellationToken cancellationToken(QTcpSocket *socket) const;
+    void executeBatchItem(const QByteArray &request, const Proof::Promise<Proof::RestResponse> &promise,
+                          const Proof::RestCancellationToken &batchCancellation);
+    void cancelBatchItem(QTcpSocket *socket, quint64 itemId);
+    void startDrain();
     void stop();
 
+    //Changed by server thread when socket is assigned and by worker itself when socket is deleted
+    std::atomic_llong socketCount{0};
+    //Same for batch items, they keep worker from being stopped but are not used for balancing and limits
+    std::atomic_llong batchItemsCount{0};
+    //Used only by server thread
+    int idleChecks = 0;
+    Proof::RestServerMetrics *const metrics;
+
 private:
+    void startRequest(SocketInfo &info);
+    void callInExecutorPool(QTcpSocket *socket, SocketInfo &info, const RouteMatch &match, ExecutorPool *executor);
+    void armIdleDeadline(SocketInfo &info);
+    void sweepIdleSockets();
+    void dispatchRequest(QTcpSocket *socket, SocketInfo &info);
+    void startDeadline(QTcpSocket *socket, SocketInfo &info);
+    void onRequestDeadline(QTcpSocket *socket);
+    void startRequestMetrics(SocketInfo &info, int route);
+    void finishRequestMetrics(SocketInfo &info);
+    bool isAdmitted(const SocketInfo &info, const Proof::RestRouter::Route *route) const;
+    void sendServiceUnavailable(QTcpSocket *socket);
+    void sendCachedAnswer(QTcpSocket *socket, const QByteArray &key, const Proof::RestResponseCache::Answer &answer);
+    void writeNotModified(QTcpSocket *socket, SocketInfo &info, const QString &contentType,
+                          const QHash<QString, QString> &headers);
+    void feedFileAnswer(QTcpSocket *socket, SocketInfo &info);
+    void sendfileFileAnswer(QTcpSocket *socket, SocketInfo &info);
+    void startBodyStreaming(QTcpSocket *socket, SocketInfo &info);
+    void feedBodyConsumer(QTcpSocket *socket, SocketInfo &info);
+    void onBodyChunkConsumed(QTcpSocket *socket, int requestNumber, bool proceed);
+    void stopBodyStreaming(QTcpSocket *socket, SocketInfo &info);
+    void sendParseError(QTcpSocket *socket, SocketInfo &info);
+    void onAnswerBytesWritten(QTcpSocket *socket);
+    void stopAnswerStream(SocketInfo &info, bool canProceed);
+    SocketInfo *answerableSocketInfo(QTcpSocket *socket, int returnCode);
+    QByteArray answerHead(const SocketInfo &info, const QString &contentType, const QHash<QString, QString> &headers,
+                          int returnCode, const QString &reason, const QByteArray &framingHeader,
+                          int reservedBodySize = 0) const;
+    void finishRequest(QTcpSocket *socket, SocketInfo &info);
+    void abortSocket(QTcpSocket *socket, SocketInfo &info);
+    Proof::HttpCompression::Encoding answerEncoding(const SocketInfo &info, const QByteArray &body,
+                                                    const QString &contentType,
+                                                    const QHash<QString, QString> &headers) const;
+    //Compressed body is stored to response cache if cacheKey is not empty
+    void compressAndWriteAnswer(QTcpSocket *socket, SocketInfo &info, const QByteArray &body,
+                                const QString &contentType, const QHash<QString, QString> &headers, int returnCode,
+                                const QString &reason, const QByteArray &cacheKey = QByteArray());
+    void writeAnswer(QTcpSocket *socket, SocketInfo &info, const QByteArray &body, const QString &contentType,
+                     const QHash<QString, QString> &headers, int returnCode, const QString &reason);
+    void onAnswerCompressed(QTcpSocket *socket, int requestNumber, const QByteArray &body, const QString &contentType,
+                            const QHash<QString, QString> &headers, int returnCode, const QString &reason);
+    void onAsyncAnswer(QTcpSocket *socket, int requestNumber, const Proof::RestResponse &response);
+    void onAsyncAnswerFailed(QTcpSocket *socket, int requestNumber, const Proof::Failure &failure);
+
     Proof::AbstractRestServerPrivate *const serverD;
     QHash<QTcpSocket *, SocketInfo> sockets;
+    QTimer *idleSweepTimer = nullptr;
+    //Created with first connection accepted for epoll backend
+    Proof::EpollPoller *epollPoller = nullptr;
+    int activeRequests = 0;
+    quint64 lastBatchItemId = 0;
 };
 } // anonymous namespace
 
@@ -150,20 +762,61 @@ public:
     AbstractRestServerPrivate &operator=(AbstractRestServerPrivate &&other) = delete;
     ~AbstractRestServerPrivate() = default;
 
-    void tryToCallMethod(QTcpSocket *socket, const QString &type, const QString &method, const QStringList &headers,
-                         const QByteArray &body);
-    QStringList makeMethodName(const QString &type, const QString &name);
-    MethodNode *findMethod(const QStringList &splittedMethod, QStringList &methodVariableParts);
+    //Answers with 404 or 401 if method can't be called
+    bool checkAccess(QTcpSocket *socket, const HttpParser &request, const RestRouter::Route *route);
+    void tryToCallMethod(QTcpSocket *socket, const HttpParser &request, const RouteMatch &match);
+    bool isStreamingBodyRequest(const HttpParser &request) const;
+    const RestRouter::Route *findRoute(const HttpParser &request, QByteArray *path = nullptr,
+                                       int *variablePartsStart = nullptr,
+                                       QVarLengthArray<QByteArray, 4> *pathValues = nullptr) const;
     void fillMethods();
-    void addMethodToTree(const QString &realMethod, const QString &tag);
+    void addMethodToRouter(const QMetaMethod &method);
+    void addTypedRoute(const QString &pattern, const QStringList &tags, const RestRouteParameter *parameters,
+                       int parametersCount, RestRouteInvoker invoker);
 
     void sendAnswer(QTcpSocket *socket, const QByteArray &body, const QString &contentType,
                     const QHash<QString, QString> &headers, int returnCode = 200, const QString &reason = QString());
+    void sendAnswer(QTcpSocket *socket, const Future<RestResponse> &response, const std::function<void()> &cancel);
+    void sendFile(QTcpSocket *socket, const QString &filePath, const QString &contentType,
+                  const QHash<QString, QString> &headers);
+    void startChunkedAnswer(QTcpSocket *socket, const QString &contentType, const QHash<QString, QString> &headers,
+                            int returnCode, const QString &reason);
+    Future<bool> writeAnswerChunk(QTcpSocket *socket, const QByteArray &chunk);
+    void finishChunkedAnswer(QTcpSocket *socket);
+    void readRequestBody(QTcpSocket *socket, const RequestBodyConsumer &consumer);
+    RestCancellationToken cancellationToken(QTcpSocket *socket);
+    Future<RestResponse> executeBatch(QTcpSocket *socket, const QStringList &headers, const QByteArray &body);
+    WorkerThread *workerForSocket(QTcpSocket *socket);
+    ExecutorPool *routeExecutor(const RestRouter::Route *route) const;
+    WorkerThread *chooseWorker(bool forBatchItem = false);
+    void stopIdleWorkers();
+    RestServerMetrics *acquireWorkerMetrics();
+    void releaseWorkerMetrics(RestServerMetrics *metrics);
+    QByteArray prometheusMetrics();
+    void refreshStaticStatus();
+    //Updates only last crash time of static status
+    void refreshCrashesStatus();
+    Future<QByteArray> statusAnswer(bool quick);
+    //Should be called with statusMutex locked
+    QByteArray cachedStatusAnswer(StatusCache &cache);
+    //left is number of messages still allowed by limit, negative if there is no limit
+    void writeRecentErrors(QTcpSocket *socket, const QPointer<MemoryStorageNotificationHandler> &storage,
+                           quint64 beforeId, const QDateTime &since, int left, ErrorNotifier::Severity minSeverity,
+                           bool isFirstChunk);
     void registerSocket(QTcpSocket *socket);
-    void deleteSocket(QTcpSocket *socket, WorkerThread *worker);
+    void deleteSocket(QTcpSocket *socket, WorkerThread *worker, bool isBatchItem = false);
+    bool isKeepAliveAllowed(int handledRequests) const;
+    void startDrain(int msecs, const Promise<bool> &promise);
+    void checkDrainProgress();
+    bool takeOverListeningSocket();
+    void handOffListeningSocket(qintptr connection);
+    QByteArray staticAnswerHeaders();
 
     const QString restMethodPrefix = QStringLiteral("rest_");
     const QString noAuthTag = QStringLiteral("NO_AUTH_REQUIRED");
+    const QString streamingBodyTag = QStringLiteral("STREAMING_BODY");
+    const QString highPriorityTag = QStringLiteral("HIGH_PRIORITY");
+    const QString cacheableTag = QStringLiteral("CACHEABLE");
 
     AbstractRestServer *q_ptr = nullptr;
     quint16 port = 0;
@@ -172,20 +825,111 @@ public:
     QString pathPrefix;
     QStringList splittedPathPrefix;
     QThread *serverThread = nullptr;
-    QVector<WorkerThreadInfo> threadPool;
-    QReadWriteLock threadPoolLock;
+    //Used only from server thread
+    QVector<WorkerThread *> threadPool;
+    //Size of threadPool that can be read from any thread
+    std::atomic_int workerThreadsCount{0};
+    int idleWorkerTimeout = DEFAULT_IDLE_WORKER_TIMEOUT;
+    std::atomic<RestServerIoBackend> ioBackend{RestServerIoBackend::Qt};
+    QTimer *idleWorkersTimer = nullptr;
+    QString localSocketPath;
+    LocalRestServer *localServer = nullptr;
+    QString handoffSocketPath;
+    LocalRestServer *handoffServer = nullptr;
+    int handoffDrainTimeout = DEFAULT_HANDOFF_DRAIN_TIMEOUT;
+    //Set by drain() until server starts listening again, new connections are closed after first answer
+    std::atomic_bool draining{false};
+    QTimer *drainTimer = nullptr;
+    QDeadlineTimer drainDeadline;
+    QVector<Promise<bool>> drainPromises;
     QSet<QTcpSocket *> sockets;
     QMutex socketsMutex;
-    MethodNode methodsTreeRoot;
+    RestRouter router;
+    //Pattern path segments with http verb as first one, path prefix is added when router is filled
+    QVector<QPair<QStringList, RestRouter::Route>> typedRoutes;
     int suggestedMaxThreadsCount = MIN_THREADS_COUNT;
+    int keepAliveTimeout = DEFAULT_KEEP_ALIVE_TIMEOUT;
+    int maxRequestsPerConnection = DEFAULT_MAX_REQUESTS_PER_CONNECTION;
+    qlonglong maxRequestBodySize = 0;
+    qlonglong requestBodySpillThreshold = DEFAULT_REQUEST_BODY_SPILL_THRESHOLD;
+    int maxInFlightRequests = 0;
+    int maxQueuedRequestsPerWorker = 0;
+    int maxOpenSockets = 0;
+    int requestTimeout = 0;
+    //Changed only from server thread, routes are bound to pools when router is filled
+    QHash<QString, QSharedPointer<ExecutorPool>> executorPools;
+    QHash<QByteArray, QString> routeExecutorPools;
+    //Indexed by route index, nullptr for routes called in worker threads
+    QVector<ExecutorPool *> routeExecutors;
+    std::atomic_bool batchRequestsEnabled{false};
+    std::atomic_int inFlightRequests{0};
+    int compressionThreshold = DEFAULT_COMPRESSION_THRESHOLD;
+    int compressionLevel = DEFAULT_COMPRESSION_LEVEL;
+    RestResponseCache responseCache;
     RestAuthType authType = RestAuthType::NoAuth;
     QHash<QString, QString> customHeaders;
+    mutable QMutex customHeadersMutex;
+    //Proof-* and custom headers serialized once, cleared when custom headers are changed
+    QByteArray staticAnswerHeadersCache;
+    QMutex metricsMutex;
+    //Metrics of stopped workers are kept to not lose counters and are given to new workers
+    QVector<QSharedPointer<RestServerMetrics>> workersMetrics;
+    QVector<RestServerMetrics *> freeWorkersMetrics;
+    QMutex statusMutex;
+    //Parts of GET /system/status that don't depend on health status and errors
+    QJsonObject staticStatus;
+    int staticStatusVersion = 0;
+    QTimer *statusRefreshTimer = nullptr;
+    QFileSystemWatcher *crashesWatcher = nullptr;
+    QTimer *crashesRefreshTimer = nullptr;
+    //Crash files names with modification times, used to skip changes of crashes directory that don't touch them
+    QStringList crashesSnapshot;
+    //Full and quick health statuses
+    StatusCache statusCaches[2];
+    std::atomic_int healthStatusCacheTtls[2] = {{DEFAULT_HEALTH_STATUS_CACHE_TTL},
+                                                {DEFAULT_QUICK_HEALTH_STATUS_CACHE_TTL}};
+};
+
+struct RestCancellationToken::Data
+{
+    std::atomic_bool canceled{false};
+    Promise<bool> promise;
+    QDeadlineTimer deadline{QDeadlineTimer::Forever};
 };
 
 } // namespace Proof
 
 using namespace Proof;
 
+RestCancellationToken::RestCancellationToken() : d(QSharedPointer<Data>::create())
+{}
+
+RestCancellationToken::RestCancellationToken(const QDeadlineTimer &deadline) : RestCancellationToken()
+{
+    d->deadline = deadline;
+}
+
+bool RestCancellationToken::isCanceled() const
+{
+    return d->canceled;
+}
+
+QDeadlineTimer RestCancellationToken::deadline() const
+{
+    return d->deadline;
+}
+
+Future<bool> RestCancellationToken::canceled() const
+{
+    return d->promise.future();
+}
+
+void RestCancellationToken::cancel()
+{
+    if (!d->canceled.exchange(true))
+        d->promise.success(true);
+}
+
 AbstractRestServer::AbstractRestServer() : AbstractRestServer(*new AbstractRestServerPrivate, QString(), 80)
 {}
 
@@ -218,14 +962,19 @@ AbstractRestServer::~AbstractRestServer()
 {
     Q_D(AbstractRestServer);
     stopListen();
-    d->threadPoolLock.lockForWrite();
-    for (const WorkerThreadInfo &workerInfo : qAsConst(d->threadPool)) {
-        workerInfo.thread->stop();
-        workerInfo.thread->quit();
-        workerInfo.thread->wait(1000);
-        delete workerInfo.thread;
+    //Methods that wait for pool threads are not called, running ones are waited for since they use server
+    for (const auto &pool : qAsConst(d->executorPools)) {
+        pool->threads.clear();
+        pool->threads.waitForDone();
+    }
+    for (WorkerThread *worker : qAsConst(d->threadPool)) {
+        worker->stop();
+        worker->quit();
+        worker->wait(1000);
+        delete worker;
     }
-    d->threadPoolLock.unlock();
+    d->threadPool.clear();
+    d->workerThreadsCount = 0;
 
     d->serverThread->quit();
     d->serverThread->wait(1000);
@@ -263,6 +1012,144 @@ RestAuthType AbstractRestServer::authType() const
     return d->authType;
 }
 
+int AbstractRestServer::keepAliveTimeout() const
+{
+    Q_D_CONST(AbstractRestServer);
+    return d->keepAliveTimeout;
+}
+
+int AbstractRestServer::maxRequestsPerConnection() const
+{
+    Q_D_CONST(AbstractRestServer);
+    return d->maxRequestsPerConnection;
+}
+
+qlonglong AbstractRestServer::maxRequestBodySize() const
+{
+    Q_D_CONST(AbstractRestServer);
+    return d->maxRequestBodySize;
+}
+
+qlonglong AbstractRestServer::requestBodySpillThreshold() const
+{
+    Q_D_CONST(AbstractRestServer);
+    return d->requestBodySpillThreshold;
+}
+
+int AbstractRestServer::maxInFlightRequests() const
+{
+    Q_D_CONST(AbstractRestServer);
+    return d->maxInFlightRequests;
+}
+
+int AbstractRestServer::maxQueuedRequestsPerWorker() const
+{
+    Q_D_CONST(AbstractRestServer);
+    return d->maxQueuedRequestsPerWorker;
+}
+
+int AbstractRestServer::maxOpenSockets() const
+{
+    Q_D_CONST(AbstractRestServer);
+    return d->maxOpenSockets;
+}
+
+int AbstractRestServer::idleWorkerTimeout() const
+{
+    Q_D_CONST(AbstractRestServer);
+    return d->idleWorkerTimeout;
+}
+
+int AbstractRestServer::workerThreadsCount() const
+{
+    Q_D_CONST(AbstractRestServer);
+    return d->workerThreadsCount;
+}
+
+RestServerIoBackend AbstractRestServer::ioBackend() const
+{
+    Q_D_CONST(AbstractRestServer);
+    return d->ioBackend;
+}
+
+int AbstractRestServer::compressionThreshold() const
+{
+    Q_D_CONST(AbstractRestServer);
+    return d->compressionThreshold;
+}
+
+int AbstractRestServer::compressionLevel() const
+{
+    Q_D_CONST(AbstractRestServer);
+    return d->compressionLevel;
+}
+
+int AbstractRestServer::healthStatusCacheTtl(bool quick) const
+{
+    Q_D_CONST(AbstractRestServer);
+    return d->healthStatusCacheTtls[quick ? 1 : 0];
+}
+
+int AbstractRestServer::requestTimeout() const
+{
+    Q_D_CONST(AbstractRestServer);
+    return d->requestTimeout;
+}
+
+bool AbstractRestServer::batchRequestsEnabled() const
+{
+    Q_D_CONST(AbstractRestServer);
+    return d->batchRequestsEnabled;
+}
+
+QString AbstractRestServer::localSocketPath() const
+{
+    Q_D_CONST(AbstractRestServer);
+    return d->localSocketPath;
+}
+
+bool AbstractRestServer::isListeningLocalSocket() const
+{
+    Q_D_CONST(AbstractRestServer);
+    return d->localServer && d->localServer->isListening();
+}
+
+QString AbstractRestServer::handoffSocketPath() const
+{
+    Q_D_CONST(AbstractRestServer);
+    return d->handoffSocketPath;
+}
+
+int AbstractRestServer::handoffDrainTimeout() const
+{
+    Q_D_CONST(AbstractRestServer);
+    return d->handoffDrainTimeout;
+}
+
+bool AbstractRestServer::isDraining() const
+{
+    Q_D_CONST(AbstractRestServer);
+    return d->draining;
+}
+
+QStringList AbstractRestServer::executorPools() const
+{
+    Q_D_CONST(AbstractRestServer);
+    return d->executorPools.keys();
+}
+
+QString AbstractRestServer::routeExecutorPool(const QString &routeName) const
+{
+    Q_D_CONST(AbstractRestServer);
+    return d->routeExecutorPools.value(routeName.toUtf8());
+}
+
+int AbstractRestServer::responseCacheTtl() const
+{
+    Q_D_CONST(AbstractRestServer);
+    return d->responseCache.ttl();
+}
+
 void AbstractRestServer::setUserName(const QString &userName)
 {
     Q_D(AbstractRestServer);
@@ -324,140 +1211,353 @@ void AbstractRestServer::setAuthType(RestAuthType authType)
     }
 }
 
-void AbstractRestServer::setCustomHeader(const QString &header, const QString &value)
+void AbstractRestServer::setKeepAliveTimeout(int msecs)
 {
     Q_D(AbstractRestServer);
-    d->customHeaders[header] = value;
+    d->keepAliveTimeout = qMax(0, msecs);
 }
 
-QString AbstractRestServer::customHeader(const QString &header) const
+void AbstractRestServer::setMaxRequestsPerConnection(int count)
 {
-    Q_D_CONST(AbstractRestServer);
-    return d->customHeaders.value(header);
+    Q_D(AbstractRestServer);
+    d->maxRequestsPerConnection = qMax(0, count);
 }
 
-bool AbstractRestServer::containsCustomHeader(const QString &header) const
+void AbstractRestServer::setMaxRequestBodySize(qlonglong bytes)
 {
-    Q_D_CONST(AbstractRestServer);
-    return d->customHeaders.contains(header);
+    Q_D(AbstractRestServer);
+    d->maxRequestBodySize = qMax(0ll, bytes);
 }
 
-void AbstractRestServer::unsetCustomHeader(const QString &header)
+void AbstractRestServer::setRequestBodySpillThreshold(qlonglong bytes)
 {
     Q_D(AbstractRestServer);
-    d->customHeaders.remove(header);
+    d->requestBodySpillThreshold = qMax(0ll, bytes);
 }
 
-void AbstractRestServer::startListen()
+void AbstractRestServer::setMaxInFlightRequests(int count)
 {
     Q_D(AbstractRestServer);
-    if (!ProofObject::safeCall(this, &AbstractRestServer::startListen)) {
-        d->fillMethods();
-        bool isListen = listen(QHostAddress::Any, d->port);
-        if (!isListen)
-            qCCritical(proofNetworkMiscLog) << "Server can't start on port" << d->port;
-    }
+    d->maxInFlightRequests = qMax(0, count);
 }
 
-void AbstractRestServer::stopListen()
+void AbstractRestServer::setMaxQueuedRequestsPerWorker(int count)
 {
-    if (!ProofObject::safeCall(this, &AbstractRestServer::stopListen, Proof::Call::Block))
-        close();
+    Q_D(AbstractRestServer);
+    d->maxQueuedRequestsPerWorker = qMax(0, count);
 }
 
-void AbstractRestServer::rest_get_System_Status(QTcpSocket *socket, const QStringList &, const QStringList &,
-                                                const QUrlQuery &query, const QByteArray &)
+void AbstractRestServer::setMaxOpenSockets(int count)
 {
-    auto maybeHealthStatus = healthStatus(query.hasQueryItem(QStringLiteral("quick")));
+    Q_D(AbstractRestServer);
+    d->maxOpenSockets = qMax(0, count);
+}
 
-    QStringList ipsList;
-    const auto allIfaces = QNetworkInterface::allInterfaces();
-    for (const auto &interface : allIfaces) {
-        const auto addressEntries = interface.addressEntries();
-        for (const auto &address : addressEntries) {
-            if (!address.ip().isLoopback())
-                ipsList << QStringLiteral("%1 (%2)").arg(address.ip().toString(), interface.humanReadableName());
-        }
+void AbstractRestServer::setIdleWorkerTimeout(int msecs)
+{
+    Q_D(AbstractRestServer);
+    d->idleWorkerTimeout = qMax(2, msecs);
+}
+
+void AbstractRestServer::setIoBackend(RestServerIoBackend backend)
+{
+    Q_D(AbstractRestServer);
+#ifndef Q_OS_LINUX
+    if (backend == RestServerIoBackend::Epoll) {
+        qCWarning(proofNetworkMiscLog) << "RestServer: epoll backend is not supported on this platform, Qt one is used";
+        backend = RestServerIoBackend::Qt;
     }
+#endif
+    d->ioBackend = backend;
+}
+
+void AbstractRestServer::setCompressionThreshold(int bytes)
+{
+    Q_D(AbstractRestServer);
+    d->compressionThreshold = qMax(0, bytes);
+}
+
+void AbstractRestServer::setCompressionLevel(int level)
+{
+    Q_D(AbstractRestServer);
+    d->compressionLevel = qBound(0, level, 9);
+}
+
+void AbstractRestServer::setHealthStatusCacheTtl(int msecs, bool quick)
+{
+    Q_D(AbstractRestServer);
+    d->healthStatusCacheTtls[quick ? 1 : 0] = qMax(0, msecs);
+}
+
+void AbstractRestServer::setRequestTimeout(int msecs)
+{
+    Q_D(AbstractRestServer);
+    d->requestTimeout = qMax(0, msecs);
+}
+
+void AbstractRestServer::setBatchRequestsEnabled(bool enabled)
+{
+    Q_D(AbstractRestServer);
+    d->batchRequestsEnabled = enabled;
+}
+
+void AbstractRestServer::setLocalSocketPath(const QString &path)
+{
+    Q_D(AbstractRestServer);
+    d->localSocketPath = path;
+}
+
+void AbstractRestServer::setHandoffSocketPath(const QString &path)
+{
+    Q_D(AbstractRestServer);
+    d->handoffSocketPath = path;
+}
+
+void AbstractRestServer::setHandoffDrainTimeout(int msecs)
+{
+    Q_D(AbstractRestServer);
+    d->handoffDrainTimeout = qMax(0, msecs);
+}
+
+void AbstractRestServer::addExecutorPool(const QString &name, int threadsCount, int maxQueuedRequests)
+{
+    Q_D(AbstractRestServer);
+    auto &pool = d->executorPools[name];
+    if (!pool)
+        pool = QSharedPointer<ExecutorPool>::create();
+    pool->threads.setMaxThreadCount(qMax(1, threadsCount));
+    pool->maxQueuedRequests = qMax(0, maxQueuedRequests);
+}
+
+void AbstractRestServer::setRouteExecutorPool(const QString &routeName, const QString &poolName)
+{
+    Q_D(AbstractRestServer);
+    if (poolName.isEmpty())
+        d->routeExecutorPools.remove(routeName.toUtf8());
+    else
+        d->routeExecutorPools[routeName.toUtf8()] = poolName;
+}
+
+void AbstractRestServer::setResponseCacheTtl(int msecs)
+{
+    Q_D(AbstractRestServer);
+    d->responseCache.setTtl(msecs);
+}
+
+void AbstractRestServer::invalidateResponseCache()
+{
+    Q_D(AbstractRestServer);
+    d->responseCache.invalidate();
+}
+
+void AbstractRestServer::invalidateResponseCache(const QString &routeName)
+{
+    Q_D(AbstractRestServer);
+    d->responseCache.invalidate(routeName.toUtf8());
+}
+
+void AbstractRestServer::setCustomHeader(const QString &header, const QString &value)
+{
+    Q_D(AbstractRestServer);
+    QMutexLocker locker(&d->customHeadersMutex);
+    d->customHeaders[header] = value;
+    d->staticAnswerHeadersCache.clear();
+}
+
+QString AbstractRestServer::customHeader(const QString &header) const
+{
+    Q_D_CONST(AbstractRestServer);
+    QMutexLocker locker(&d->customHeadersMutex);
+    return d->customHeaders.value(header);
+}
+
+bool AbstractRestServer::containsCustomHeader(const QString &header) const
+{
+    Q_D_CONST(AbstractRestServer);
+    QMutexLocker locker(&d->customHeadersMutex);
+    return d->customHeaders.contains(header);
+}
+
+void AbstractRestServer::unsetCustomHeader(const QString &header)
+{
+    Q_D(AbstractRestServer);
+    QMutexLocker locker(&d->customHeadersMutex);
+    d->customHeaders.remove(header);
+    d->staticAnswerHeadersCache.clear();
+}
 
-    QString lastCrashAt(QStringLiteral("N/A"));
+void AbstractRestServer::startListen()
+{
+    Q_D(AbstractRestServer);
+    if (!ProofObject::safeCall(this, &AbstractRestServer::startListen)) {
+        d->fillMethods();
+        if (!d->idleWorkersTimer) {
+            d->idleWorkersTimer = new QTimer(this);
+            connect(d->idleWorkersTimer, &QTimer::timeout, this, [d] { d->stopIdleWorkers(); });
+        }
+        d->idleWorkersTimer->setInterval(d->idleWorkerTimeout / 2);
+        d->idleWorkersTimer->start();
+        if (!d->statusRefreshTimer) {
+            d->statusRefreshTimer = new QTimer(this);
+            d->statusRefreshTimer->setInterval(STATUS_REFRESH_INTERVAL);
+            d->statusRefreshTimer->setTimerType(Qt::VeryCoarseTimer);
+            connect(d->statusRefreshTimer, &QTimer::timeout, this, [d] { d->refreshStaticStatus(); });
 #if (defined(Q_OS_LINUX) && !defined(Q_OS_ANDROID)) || defined(Q_OS_MAC)
-    QByteArray homePath = qgetenv("HOME");
-    QDir homeDir(homePath.isEmpty() ? "/tmp" : homePath);
-    QFileInfoList crashes = homeDir.entryInfoList({"proof_crash_*"}, QDir::Files);
-    if (!crashes.isEmpty()) {
-        QDateTime mostRecentCrash = crashes.first().lastModified();
-        for (const auto &crash : crashes) {
-            if (crash.lastModified() > mostRecentCrash)
-                mostRecentCrash = crash.lastModified();
+            d->crashesRefreshTimer = new QTimer(this);
+            d->crashesRefreshTimer->setInterval(CRASHES_REFRESH_DELAY);
+            d->crashesRefreshTimer->setSingleShot(true);
+            connect(d->crashesRefreshTimer, &QTimer::timeout, this, [d] { d->refreshCrashesStatus(); });
+            d->crashesWatcher = new QFileSystemWatcher({crashesDirPath()}, this);
+            connect(d->crashesWatcher, &QFileSystemWatcher::directoryChanged, this, [d] {
+                if (!d->crashesRefreshTimer->isActive())
+                    d->crashesRefreshTimer->start();
+            });
+#endif
         }
-        lastCrashAt = mostRecentCrash.toUTC().toString(Qt::ISODate);
-    }
+        d->statusRefreshTimer->start();
+        d->draining = false;
+        if (d->drainTimer)
+            d->drainTimer->stop();
+        if (!d->localSocketPath.isEmpty()) {
+#ifdef Q_OS_UNIX
+            if (!d->localServer)
+                d->localServer = new LocalRestServer([this](qintptr descriptor) { incomingConnection(descriptor); },
+                                                     this);
+            //Socket file can be left by crashed process
+            QLocalServer::removeServer(d->localSocketPath);
+            if (!d->localServer->listen(d->localSocketPath)) {
+                qCCritical(proofNetworkMiscLog) << "Server can't start on local socket" << d->localSocketPath << ":"
+                                                << d->localServer->errorString();
+            }
+#else
+            qCCritical(proofNetworkMiscLog) << "Server can't start on local socket" << d->localSocketPath
+                                            << ": local sockets are supported only on unix";
 #endif
-
-    QJsonObject statusTemplate{{QStringLiteral("app_type"), qApp->applicationName()},
-                               {QStringLiteral("app_version"), qApp->applicationVersion()},
-                               {QStringLiteral("proof_version"), Proof::proofVersion()},
-                               {QStringLiteral("started_at"), proofApp->startedAt().toString(Qt::ISODate)},
-                               {QStringLiteral("last_crash_at"), lastCrashAt},
-                               {QStringLiteral("os"), QSysInfo::prettyProductName()},
-                               {QStringLiteral("network_addresses"), QJsonArray::fromStringList(ipsList)}};
-    maybeHealthStatus
-        .onSuccess([this, socket, statusTemplate](const HealthStatusMap &healthStatus) {
-            auto statusObj = statusTemplate;
-            auto notificationsMemoryStorage = ErrorNotifier::instance()->handler<MemoryStorageNotificationHandler>();
-            QPair<QDateTime, QString> lastError;
-            if (notificationsMemoryStorage) {
-                statusObj[QStringLiteral("app_id")] = notificationsMemoryStorage->appId();
-                lastError = notificationsMemoryStorage->lastMessage();
-            } else {
-                lastError = qMakePair(QDateTime::currentDateTimeUtc(),
-                                      QStringLiteral("Memory storage error handler not set"));
+            if (!d->port)
+                return;
+        }
+        const bool isTakenOver = !d->handoffSocketPath.isEmpty() && d->takeOverListeningSocket();
+        bool isListen = isTakenOver || listen(QHostAddress::Any, d->port);
+        if (!isListen)
+            qCCritical(proofNetworkMiscLog) << "Server can't start on port" << d->port;
+#ifdef Q_OS_UNIX
+        if (isListen && !d->handoffSocketPath.isEmpty()) {
+            if (!d->handoffServer)
+                d->handoffServer = new LocalRestServer(
+                    [d](qintptr connection) { d->handOffListeningSocket(connection); }, this);
+            QLocalServer::removeServer(d->handoffSocketPath);
+            if (!d->handoffServer->listen(d->handoffSocketPath)) {
+                qCWarning(proofNetworkMiscLog) << "Server can't start on handoff socket" << d->handoffSocketPath
+                                               << ":" << d->handoffServer->errorString();
             }
+        }
+#endif
+    }
+}
 
-            statusObj[QStringLiteral("last_error")] = lastError.first.isValid()
-                                                          ? QJsonObject{{QStringLiteral("timestamp"),
-                                                                         lastError.first.toString(Qt::ISODate)},
-                                                                        {QStringLiteral("message"), lastError.second}}
-                                                          : QJsonValue();
-
-            auto healthMapper = [](const QString &name, const auto &data) {
-                return QJsonObject{{QStringLiteral("name"), name},
-                                   {QStringLiteral("value"), QJsonValue::fromVariant(data.second)},
-                                   {QStringLiteral("updated_at"), data.first.toString(Qt::ISODate)}};
-            };
-            statusObj[QStringLiteral("health")] = algorithms::map(healthStatus, healthMapper, QJsonArray());
-            statusObj[QStringLiteral("generated_at")] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
-            sendAnswer(socket, QJsonDocument(statusObj).toJson(), QStringLiteral("text/json"));
-        })
+Future<bool> AbstractRestServer::drain(int msecs)
+{
+    Q_D(AbstractRestServer);
+    Promise<bool> promise;
+    QMetaObject::invokeMethod(this, [d, msecs, promise] { d->startDrain(msecs, promise); }, Qt::QueuedConnection);
+    return promise.future();
+}
+
+void AbstractRestServer::stopListen()
+{
+    Q_D(AbstractRestServer);
+    if (!ProofObject::safeCall(this, &AbstractRestServer::stopListen, Proof::Call::Block)) {
+        if (d->idleWorkersTimer)
+            d->idleWorkersTimer->stop();
+        if (d->statusRefreshTimer)
+            d->statusRefreshTimer->stop();
+        if (d->localServer)
+            d->localServer->close();
+        if (d->handoffServer)
+            d->handoffServer->close();
+        close();
+    }
+}
+
+void AbstractRestServer::rest_get_System_Status(QTcpSocket *socket, const QStringList &, const QStringList &,
+                                                const QUrlQuery &query, const QByteArray &)
+{
+    Q_D(AbstractRestServer);
+    d->statusAnswer(query.hasQueryItem(QStringLiteral("quick")))
+        .onSuccess(
+            [this, socket](const QByteArray &answer) { sendAnswer(socket, answer, QStringLiteral("text/json")); })
         .onFailure([this, socket](const Failure &f) {
             qCWarning(proofNetworkMiscLog) << "Health status fetch failed with " << f.message << f.data;
-            sendInternalError(socket);
+            if (f.moduleCode == NETWORK_MODULE_CODE && f.errorCode == NetworkErrorCode::ServiceUnavailable) {
+                sendAnswer(socket, "", QStringLiteral("text/plain; charset=utf-8"),
+                           {{QStringLiteral("Retry-After"), QString::number(LOAD_SHEDDING_RETRY_AFTER)}}, 503,
+                           QStringLiteral("Service Unavailable"));
+            } else {
+                sendInternalError(socket);
+            }
         });
 }
 
 void AbstractRestServer::rest_get_System_RecentErrors(QTcpSocket *socket, const QStringList &, const QStringList &,
-                                                      const QUrlQuery &, const QByteArray &)
+                                                      const QUrlQuery &query, const QByteArray &)
 {
+    Q_D(AbstractRestServer);
+    QDateTime since;
+    if (query.hasQueryItem(QStringLiteral("since"))) {
+        since = QDateTime::fromString(query.queryItemValue(QStringLiteral("since"), QUrl::FullyDecoded), Qt::ISODate);
+        if (!since.isValid()) {
+            sendBadRequest(socket, QStringLiteral("Wrong since"));
+            return;
+        }
+    }
+    int limit = -1;
+    if (query.hasQueryItem(QStringLiteral("limit"))) {
+        bool ok = false;
+        limit = query.queryItemValue(QStringLiteral("limit")).toInt(&ok);
+        if (!ok || limit < 0) {
+            sendBadRequest(socket, QStringLiteral("Wrong limit"));
+            return;
+        }
+    }
+    auto minSeverity = ErrorNotifier::Severity::Info;
+    if (query.hasQueryItem(QStringLiteral("severity"))) {
+        int severityIndex = severityNames().indexOf(query.queryItemValue(QStringLiteral("severity")).toLower());
+        if (severityIndex < 0) {
+            sendBadRequest(socket, QStringLiteral("Wrong severity"));
+            return;
+        }
+        minSeverity = static_cast<ErrorNotifier::Severity>(severityIndex);
+    }
+
     auto notificationsMemoryStorage = ErrorNotifier::instance()->handler<MemoryStorageNotificationHandler>();
-    auto lastErrors = notificationsMemoryStorage
-                          ? notificationsMemoryStorage->messages()
-                          : QMultiMap<QDateTime, QString>{{QDateTime::currentDateTimeUtc(),
-                                                           QStringLiteral("Memory storage error handler not set")}};
+    if (!notificationsMemoryStorage) {
+        QByteArray body = "[" + recentErrorJson({0, QDateTime::currentDateTimeUtc(),
+                                                 QStringLiteral("Memory storage error handler not set"),
+                                                 ErrorNotifier::Severity::Error})
+                          + "]";
+        sendAnswer(socket, body, QStringLiteral("text/json"));
+        return;
+    }
+    startChunkedAnswer(socket, QStringLiteral("text/json"));
+    d->writeRecentErrors(socket, notificationsMemoryStorage, 0, since, limit, minSeverity, true);
+}
 
-    auto errorObjectBuilder = [](const QDateTime &time, const QString &error) -> QJsonObject {
-        return QJsonObject{{"timestamp", time.toString(Qt::ISODate)}, {"message", error}};
-    };
+void AbstractRestServer::rest_get_System_Metrics(QTcpSocket *socket, const QStringList &, const QStringList &,
+                                                 const QUrlQuery &, const QByteArray &)
+{
+    Q_D(AbstractRestServer);
+    sendAnswer(socket, d->prometheusMetrics(), QStringLiteral("text/plain; version=0.0.4"));
+}
 
-    QJsonArray recentErrorsArray;
-    QList<QDateTime> uniqueErrorsKeys = lastErrors.uniqueKeys();
-    std::reverse(uniqueErrorsKeys.begin(), uniqueErrorsKeys.end());
-    for (const auto &time : uniqueErrorsKeys) {
-        const auto allMessages = lastErrors.values(time);
-        for (const auto &message : allMessages)
-            recentErrorsArray.append(errorObjectBuilder(time, message));
-    }
-    sendAnswer(socket, QJsonDocument(recentErrorsArray).toJson(), QStringLiteral("text/json"));
+Future<RestResponse> AbstractRestServer::rest_post_System_Batch(QTcpSocket *socket, const QStringList &headers,
+                                                                const QStringList &, const QUrlQuery &,
+                                                                const QByteArray &body)
+{
+    Q_D(AbstractRestServer);
+    if (!d->batchRequestsEnabled)
+        return Future<RestResponse>::successful(RestResponse("", QStringLiteral("text/plain; charset=utf-8"), 404,
+                                                             QStringLiteral("Not Found")));
+    return d->executeBatch(socket, headers, body);
 }
 
 Future<HealthStatusMap> AbstractRestServer::healthStatus(bool) const
@@ -471,30 +1571,16 @@ void AbstractRestServer::incomingConnection(qintptr socketDescriptor)
 
     qCDebug(proofNetworkExtraLog) << "Incoming connection with socket descriptor" << socketDescriptor;
 
-    WorkerThread *worker = nullptr;
-
-    d->threadPoolLock.lockForRead();
-    if (!d->threadPool.isEmpty()) {
-        auto iter = std::min_element(d->threadPool.begin(), d->threadPool.end(),
-                                     [](const WorkerThreadInfo &lhs, const WorkerThreadInfo &rhs) {
-                                         return lhs.socketCount < rhs.socketCount;
-                                     });
-        if (iter->socketCount == 0 || d->threadPool.count() >= d->suggestedMaxThreadsCount) {
-            worker = iter->thread;
-            ++iter->socketCount;
-        }
-    }
-    d->threadPoolLock.unlock();
-
-    if (worker == nullptr) {
-        worker = new WorkerThread(d);
-        worker->start();
-        d->threadPoolLock.lockForWrite();
-        d->threadPool << WorkerThreadInfo(worker, 1);
-        d->threadPoolLock.unlock();
+    bool overSocketsLimit = false;
+    if (d->maxOpenSockets > 0) {
+        qlonglong openSockets = 0;
+        for (WorkerThread *worker : qAsConst(d->threadPool))
+            openSockets += worker->socketCount;
+        overSocketsLimit = openSockets >= d->maxOpenSockets;
     }
 
-    worker->handleNewConnection(socketDescriptor);
+    WorkerThread *worker = d->chooseWorker();
+    worker->handleNewConnection(socketDescriptor, overSocketsLimit);
 }
 
 void AbstractRestServer::sendAnswer(QTcpSocket *socket, const QByteArray &body, const QString &contentType,
@@ -511,6 +1597,25 @@ void AbstractRestServer::sendAnswer(QTcpSocket *socket, const QByteArray &body,
     d->sendAnswer(socket, body, contentType, headers, returnCode, reason);
 }
 
+void AbstractRestServer::sendAnswer(QTcpSocket *socket, const Future<RestResponse> &response)
+{
+    Q_D(AbstractRestServer);
+    d->sendAnswer(socket, response, std::function<void()>());
+}
+
+void AbstractRestServer::sendAnswer(QTcpSocket *socket, const CancelableFuture<RestResponse> &response)
+{
+    Q_D(AbstractRestServer);
+    d->sendAnswer(socket, response, [response] { response.cancel(); });
+}
+
+void AbstractRestServer::sendFile(QTcpSocket *socket, const QString &filePath, const QString &contentType,
+                                  const QHash<QString, QString> &headers)
+{
+    Q_D(AbstractRestServer);
+    d->sendFile(socket, filePath, contentType, headers);
+}
+
 void AbstractRestServer::sendErrorCode(QTcpSocket *socket, int returnCode, const QString &reason, int errorCode,
                                        const QStringList &args)
 {
@@ -526,6 +1631,46 @@ void AbstractRestServer::sendErrorCode(QTcpSocket *socket, int returnCode, const
                returnCode, reason);
 }
 
+void AbstractRestServer::startChunkedAnswer(QTcpSocket *socket, const QString &contentType,
+                                            const QHash<QString, QString> &headers, int returnCode,
+                                            const QString &reason)
+{
+    Q_D(AbstractRestServer);
+    d->startChunkedAnswer(socket, contentType, headers, returnCode, reason);
+}
+
+Future<bool> AbstractRestServer::writeAnswerChunk(QTcpSocket *socket, const QByteArray &chunk)
+{
+    Q_D(AbstractRestServer);
+    return d->writeAnswerChunk(socket, chunk);
+}
+
+void AbstractRestServer::finishChunkedAnswer(QTcpSocket *socket)
+{
+    Q_D(AbstractRestServer);
+    d->finishChunkedAnswer(socket);
+}
+
+void AbstractRestServer::addTypedRoute(const QString &pattern, const QStringList &tags,
+                                       const RestRouteParameter *parameters, int parametersCount,
+                                       RestRouteInvoker invoker)
+{
+    Q_D(AbstractRestServer);
+    d->addTypedRoute(pattern, tags, parameters, parametersCount, invoker);
+}
+
+void AbstractRestServer::readRequestBody(QTcpSocket *socket, const RequestBodyConsumer &consumer)
+{
+    Q_D(AbstractRestServer);
+    d->readRequestBody(socket, consumer);
+}
+
+RestCancellationToken AbstractRestServer::cancellationToken(QTcpSocket *socket)
+{
+    Q_D(AbstractRestServer);
+    return d->cancellationToken(socket);
+}
+
 bool AbstractRestServer::checkBasicAuth(const QString &encryptedAuth) const
 {
     Q_D_CONST(AbstractRestServer);
@@ -579,139 +1724,216 @@ void AbstractRestServer::sendNotImplemented(QTcpSocket *socket, const QString &r
     sendAnswer(socket, "", QStringLiteral("text/plain; charset=utf-8"), 501, reason);
 }
 
-QStringList AbstractRestServerPrivate::makeMethodName(const QString &type, const QString &name)
+void AbstractRestServerPrivate::fillMethods()
 {
-    QStringList splittedName = name.split(QStringLiteral("/"), QString::SkipEmptyParts);
-    bool isStartedWithPrefix = splittedName.size() >= splittedPathPrefix.size()
-                               && std::equal(splittedPathPrefix.cbegin(), splittedPathPrefix.cend(),
-                                             splittedName.cbegin(),
-                                             [](const QString &prefixPart, const QString &namePart) {
-                                                 return prefixPart == namePart.toLower();
-                                             });
-    if (!isStartedWithPrefix)
-        return QStringList();
-    splittedName.erase(splittedName.begin(), splittedName.begin() + splittedPathPrefix.size());
-    splittedName.prepend(type.toLower());
-    return splittedName;
+    Q_Q(AbstractRestServer);
+    router.clear();
+    const QMetaObject *metaObject = q->metaObject();
+    for (int i = 0; i < metaObject->methodCount(); ++i) {
+        QMetaMethod method = metaObject->method(i);
+        if (method.methodType() == QMetaMethod::Slot && method.name().startsWith(restMethodPrefix.toLatin1()))
+            addMethodToRouter(method);
+    }
+    for (const auto &typedRoute : qAsConst(typedRoutes)) {
+        QStringList segments = typedRoute.first;
+        for (int i = splittedPathPrefix.count() - 1; i >= 0; --i)
+            segments.insert(1, splittedPathPrefix[i]);
+        router.addRoute(segments, typedRoute.second);
+    }
+
+    const QVector<QByteArray> routeNames = router.routeNames();
+    routeExecutors.fill(nullptr, routeNames.count());
+    for (int i = 0; i < routeNames.count(); ++i) {
+        const QString poolName = routeExecutorPools.value(routeNames[i]);
+        if (poolName.isEmpty())
+            continue;
+        routeExecutors[i] = executorPools.value(poolName).data();
+        if (!routeExecutors[i]) {
+            qCWarning(proofNetworkMiscLog) << "RestServer: route" << routeNames[i] << "is assigned to unknown pool"
+                                           << poolName << "and is called in worker threads";
+        }
+    }
 }
 
-MethodNode *AbstractRestServerPrivate::findMethod(const QStringList &splittedMethod, QStringList &methodVariableParts)
+ExecutorPool *AbstractRestServerPrivate::routeExecutor(const RestRouter::Route *route) const
 {
-    if (splittedMethod.count() < 2)
-        return nullptr;
+    const int index = router.routeIndex(route);
+    return index >= 0 && index < routeExecutors.count() ? routeExecutors[index] : nullptr;
+}
 
-    MethodNode *currentNode = &methodsTreeRoot;
-    int i = 0;
-    for (; i < splittedMethod.count(); ++i) {
-        QString loweredPart = splittedMethod[i].toLower();
-        if (!currentNode->contains(loweredPart))
-            break;
-        currentNode = &(*currentNode)[loweredPart];
+void AbstractRestServerPrivate::addMethodToRouter(const QMetaMethod &method)
+{
+    static const QList<QByteArray> expectedParameterTypes = {"QTcpSocket*", "QStringList", "QStringList", "QUrlQuery",
+                                                             "QByteArray"};
+    if (method.parameterTypes() != expectedParameterTypes) {
+        qCWarning(proofNetworkMiscLog) << "RestServer: method" << method.methodSignature()
+                                       << "has wrong signature and is skipped";
+        return;
     }
 
-    QString methodName = (*currentNode);
-
-    if (!methodName.isEmpty()) {
-        QStringList partsForDecode = splittedMethod.mid(i);
-        for (QString &part : partsForDecode)
-            part = QString(QByteArray::fromPercentEncoding(part.toUtf8()));
-        methodVariableParts = partsForDecode;
-        return currentNode;
+    QString name = QString::fromLatin1(method.name()).mid(restMethodPrefix.length());
+    for (int i = 0; i < name.length(); ++i) {
+        if (name[i].isUpper()) {
+            name[i] = name[i].toLower();
+            if (i > 0 && name[i - 1] != '_')
+                name.insert(i++, '-');
+        }
     }
 
-    return nullptr;
+    QStringList segments = name.split(QStringLiteral("_"));
+    Q_ASSERT(segments.count() >= 2);
+    for (int i = splittedPathPrefix.count() - 1; i >= 0; --i)
+        segments.insert(1, splittedPathPrefix[i]);
+
+    RestRouter::Route route;
+    route.name = method.name();
+    route.tags = QString::fromLatin1(method.tag()).split(' ', QString::SkipEmptyParts);
+    route.methodIndex = method.methodIndex();
+    const QByteArray returnType = QByteArray(method.typeName()).replace("Proof::", "");
+    route.returnsFuture = returnType == "Future<RestResponse>";
+    route.returnsCancelableFuture = returnType == "CancelableFuture<RestResponse>";
+    router.addRoute(segments, route);
 }
 
-void AbstractRestServerPrivate::fillMethods()
+void AbstractRestServerPrivate::addTypedRoute(const QString &pattern, const QStringList &tags,
+                                              const RestRouteParameter *parameters, int parametersCount,
+                                              RestRouteInvoker invoker)
 {
-    Q_Q(AbstractRestServer);
-    methodsTreeRoot.clear();
-    for (int i = 0; i < q->metaObject()->methodCount(); ++i) {
-        QMetaMethod method = q->metaObject()->method(i);
-        if (method.methodType() == QMetaMethod::Slot) {
-            QString currentMethod = QString(method.name());
-            if (currentMethod.startsWith(restMethodPrefix))
-                addMethodToTree(currentMethod, method.tag());
+    auto parameterType = [parameters, parametersCount](const QString &declaration, int index,
+                                                       bool allowOptional) -> QString {
+        if (!declaration.startsWith('{') || !declaration.endsWith('}') || index >= parametersCount)
+            return QString();
+        const RestRouteParameter &parameter = parameters[index];
+        QString declaredType = declaration.mid(1, declaration.length() - 2).section(':', 1, 1).trimmed();
+        if ((parameter.optional && !allowOptional) || (!declaredType.isEmpty() && declaredType != parameter.type))
+            return QString();
+        return QStringLiteral("{%1}").arg(parameter.type);
+    };
+
+    QString verb = pattern.section(' ', 0, 0, QString::SectionSkipEmpty).toLower();
+    QString target = pattern.section(' ', 1, -1, QString::SectionSkipEmpty).trimmed();
+    QStringList segments = target.section('?', 0, 0).split('/', QString::SkipEmptyParts);
+    QStringList queryDeclarations = target.section('?', 1).split('&', QString::SkipEmptyParts);
+
+    RestRouter::Route route;
+    route.name = pattern.toUtf8();
+    route.tags = tags;
+    route.invoker = invoker;
+    int index = 0;
+    bool isValid = !verb.isEmpty() && !segments.isEmpty();
+    for (QString &segment : segments) {
+        if (!segment.startsWith('{')) {
+            segment = segment.toLower();
+            continue;
         }
+        segment = parameterType(segment, index++, false);
+        isValid = isValid && !segment.isEmpty();
+    }
+    for (const QString &declaration : queryDeclarations) {
+        isValid = isValid && !parameterType(declaration, index++, true).isEmpty();
+        route.queryParameters << declaration.mid(1, declaration.length() - 2).section(':', 0, 0).trimmed().toUtf8();
     }
+    if (!isValid || index != parametersCount) {
+        qCWarning(proofNetworkMiscLog) << "RestServer: route" << pattern << "doesn't match its handler, skipped";
+        return;
+    }
+    segments.prepend(verb);
+    typedRoutes << qMakePair(segments, route);
 }
 
-void AbstractRestServerPrivate::addMethodToTree(const QString &realMethod, const QString &tag)
+const RestRouter::Route *AbstractRestServerPrivate::findRoute(const HttpParser &request, QByteArray *path,
+                                                              int *variablePartsStart,
+                                                              QVarLengthArray<QByteArray, 4> *pathValues) const
 {
-    QString method = realMethod.mid(QString(restMethodPrefix).length());
-    for (int i = 0; i < method.length(); ++i) {
-        if (method[i].isUpper()) {
-            method[i] = method[i].toLower();
-            if (i > 0 && method[i - 1] != '_')
-                method.insert(i++, '-');
-        }
-    }
+    QByteArray uri = request.rawUri();
+    int queryStart = uri.indexOf('?');
+    QByteArray pathPart = queryStart < 0 ? uri : QByteArray::fromRawData(uri.constData(), queryStart);
+    if (path)
+        *path = pathPart;
+    return router.findRoute(request.rawMethod(), pathPart, variablePartsStart, pathValues);
+}
+
+bool AbstractRestServerPrivate::checkAccess(QTcpSocket *socket, const HttpParser &request,
+                                            const RestRouter::Route *route)
+{
+    Q_Q(AbstractRestServer);
+    qCDebug(proofNetworkMiscLog) << "Request for" << request.rawUri() << "associated with"
+                                 << (route ? route->name : QByteArray()) << "at socket" << socket;
 
-    QStringList splittedMethod = method.split(QStringLiteral("_"));
-    Q_ASSERT(splittedMethod.count() >= 2);
+    if (!route) {
+        q->sendNotFound(socket, QStringLiteral("Wrong method"));
+        return false;
+    }
 
-    MethodNode *currentNode = &methodsTreeRoot;
-    for (int i = 0; i < splittedMethod.count(); ++i) {
-        if (!currentNode->contains(splittedMethod[i]))
-            (*currentNode)[splittedMethod[i]] = MethodNode();
-        currentNode = &(*currentNode)[splittedMethod[i]];
+    if (authType == RestAuthType::Basic && !route->hasTag(noAuthTag)) {
+        QByteArray authorization = request.header(HttpParser::Header::Authorization);
+        QByteArray encryptedAuth;
+        if (authorization.startsWith("Basic "))
+            encryptedAuth = authorization.mid(6).trimmed();
+        if (encryptedAuth.isEmpty() || !q->checkBasicAuth(QString::fromLatin1(encryptedAuth))) {
+            q->sendNotAuthorized(socket);
+            return false;
+        }
     }
-    currentNode->setValue(realMethod);
-    currentNode->setTag(tag);
+    return true;
 }
 
-void AbstractRestServerPrivate::tryToCallMethod(QTcpSocket *socket, const QString &type, const QString &method,
-                                                const QStringList &headers, const QByteArray &body)
+void AbstractRestServerPrivate::tryToCallMethod(QTcpSocket *socket, const HttpParser &request,
+                                                const RouteMatch &match)
 {
     Q_Q(AbstractRestServer);
-    QStringList splittedByParamsMethod = method.split('?');
-    QStringList methodVariableParts;
-    QUrlQuery queryParams;
-
-    Q_ASSERT(splittedByParamsMethod.count());
-    if (splittedByParamsMethod.count() > 1)
-        queryParams = QUrlQuery(splittedByParamsMethod.at(1));
-
-    MethodNode *methodNode = findMethod(makeMethodName(type, splittedByParamsMethod.at(0)), methodVariableParts);
-    QString methodName = methodNode ? (*methodNode) : QString();
-    qCDebug(proofNetworkMiscLog) << "Request for" << method << "associated with" << methodName << "at socket" << socket;
-
-    if (methodNode) {
-        bool isAuthenticationSuccessful = true;
-        if (authType == RestAuthType::Basic && methodNode->tag() != noAuthTag) {
-            QString encryptedAuth;
-            for (int i = 0; i < headers.count(); ++i) {
-                if (headers.at(i).startsWith(QLatin1String("Authorization"), Qt::CaseInsensitive)) {
-                    encryptedAuth = q->parseAuth(socket, headers.at(i));
-                    break;
-                }
-            }
-            isAuthenticationSuccessful = (!encryptedAuth.isEmpty() && q->checkBasicAuth(encryptedAuth));
-        }
-        if (isAuthenticationSuccessful) {
-            // clang-format off
-            QMetaObject::invokeMethod(q, methodName.toLatin1().constData(), Qt::DirectConnection,
-                                      Q_ARG(QTcpSocket*, socket), Q_ARG(QStringList, headers),
-                                      Q_ARG(QStringList, methodVariableParts), Q_ARG(QUrlQuery, queryParams),
-                                      Q_ARG(QByteArray, body));
-            // clang-format on
-        } else {
-            q->sendNotAuthorized(socket);
+    const QByteArray &path = match.path;
+    const RestRouter::Route *route = match.route;
+    QByteArray uri = request.rawUri();
+    if (route->invoker) {
+        RestRouteArguments arguments;
+        arguments.socket = socket;
+        arguments.pathValues = match.pathValues;
+        if (!route->queryParameters.isEmpty()) {
+            QByteArray query = QByteArray::fromRawData(uri.constData() + qMin(path.size() + 1, uri.size()),
+                                                       qMax(0, uri.size() - path.size() - 1));
+            RestRouter::queryValues(query, route->queryParameters, arguments.queryValues);
         }
+        if (!route->hasTag(streamingBodyTag))
+            arguments.body = request.body();
+        if (!route->invoker(q, arguments))
+            q->sendBadRequest(socket);
+        return;
+    }
+
+    QStringList headers = request.headers();
+    QStringList methodVariableParts = RestRouter::variableParts(path, match.variablePartsStart);
+    QUrlQuery queryParams;
+    if (uri.size() > path.size())
+        queryParams = QUrlQuery(QString::fromUtf8(uri.constData() + path.size() + 1, uri.size() - path.size() - 1));
+    QByteArray body = route->hasTag(streamingBodyTag) ? QByteArray() : request.body();
+    //Method signature is checked in fillMethods(), so it can be called directly by index
+    void *args[] = {nullptr, &socket, &headers, &methodVariableParts, &queryParams, &body};
+    if (route->returnsFuture) {
+        Future<RestResponse> response = Promise<RestResponse>().future();
+        args[0] = &response;
+        QMetaObject::metacall(q, QMetaObject::InvokeMetaMethod, route->methodIndex, args);
+        q->sendAnswer(socket, response);
+    } else if (route->returnsCancelableFuture) {
+        CancelableFuture<RestResponse> response{Promise<RestResponse>()};
+        args[0] = &response;
+        QMetaObject::metacall(q, QMetaObject::InvokeMetaMethod, route->methodIndex, args);
+        q->sendAnswer(socket, response);
     } else {
-        q->sendNotFound(socket, QStringLiteral("Wrong method"));
+        QMetaObject::metacall(q, QMetaObject::InvokeMetaMethod, route->methodIndex, args);
     }
 }
 
+bool AbstractRestServerPrivate::isStreamingBodyRequest(const HttpParser &request) const
+{
+    const RestRouter::Route *route = findRoute(request);
+    return route && route->hasTag(streamingBodyTag);
+}
+
 void AbstractRestServerPrivate::sendAnswer(QTcpSocket *socket, const QByteArray &body, const QString &contentType,
                                            const QHash<QString, QString> &headers, int returnCode, const QString &reason)
 {
-    WorkerThread *worker = nullptr;
-    {
-        QMutexLocker lock(&socketsMutex);
-        if (sockets.contains(socket))
-            worker = qobject_cast<WorkerThread *>(socket->thread());
-    }
+    WorkerThread *worker = workerForSocket(socket);
     if (worker != nullptr) {
         qCDebug(proofNetworkMiscLog) << "Replying" << returnCode << ":" << reason << "at socket" << socket;
         worker->sendAnswer(socket, body, contentType, headers, returnCode, reason);
@@ -723,13 +1945,445 @@ void AbstractRestServerPrivate::sendAnswer(QTcpSocket *socket, const QByteArray
     }
 }
 
-void AbstractRestServerPrivate::registerSocket(QTcpSocket *socket)
+void AbstractRestServerPrivate::sendAnswer(QTcpSocket *socket, const Future<RestResponse> &response,
+                                           const std::function<void()> &cancel)
 {
-    QMutexLocker lock(&socketsMutex);
-    sockets.insert(socket);
+    WorkerThread *worker = workerForSocket(socket);
+    if (worker != nullptr) {
+        worker->awaitAnswer(socket, response, cancel);
+    } else {
+        qCDebug(proofNetworkMiscLog) << "Wanted to wait for answer at socket"
+                                     << QStringLiteral("QTcpSocket(%1)").arg(reinterpret_cast<quint64>(socket), 0, 16)
+                                     << "but it is dead already";
+        if (cancel)
+            cancel();
+    }
+}
+
+void AbstractRestServerPrivate::sendFile(QTcpSocket *socket, const QString &filePath, const QString &contentType,
+                                         const QHash<QString, QString> &headers)
+{
+    WorkerThread *worker = workerForSocket(socket);
+    if (worker != nullptr) {
+        qCDebug(proofNetworkMiscLog) << "Replying with file" << filePath << "at socket" << socket;
+        worker->sendFile(socket, filePath, contentType, headers);
+    } else {
+        qCCritical(proofNetworkMiscLog).noquote()
+            << "Wanted to reply with file" << filePath << "at socket"
+            << QStringLiteral("QTcpSocket(%1)").arg(reinterpret_cast<quint64>(socket), 0, 16)
+            << "but it is dead already";
+    }
+}
+
+void AbstractRestServerPrivate::startChunkedAnswer(QTcpSocket *socket, const QString &contentType,
+                                                   const QHash<QString, QString> &headers, int returnCode,
+                                                   const QString &reason)
+{
+    WorkerThread *worker = workerForSocket(socket);
+    if (worker != nullptr) {
+        qCDebug(proofNetworkMiscLog) << "Replying chunked" << returnCode << ":" << reason << "at socket" << socket;
+        worker->startChunkedAnswer(socket, contentType, headers, returnCode, reason);
+    } else {
+        qCCritical(proofNetworkMiscLog).noquote()
+            << "Wanted to reply chunked" << returnCode << ":" << reason << "at socket"
+            << QStringLiteral("QTcpSocket(%1)").arg(reinterpret_cast<quint64>(socket), 0, 16)
+            << "but it is dead already";
+    }
+}
+
+Future<bool> AbstractRestServerPrivate::writeAnswerChunk(QTcpSocket *socket, const QByteArray &chunk)
+{
+    WorkerThread *worker = workerForSocket(socket);
+    if (worker == nullptr)
+        return Future<bool>::successful(false);
+    Promise<bool> promise;
+    worker->writeAnswerChunk(socket, chunk, promise);
+    return promise.future();
+}
+
+void AbstractRestServerPrivate::finishChunkedAnswer(QTcpSocket *socket)
+{
+    WorkerThread *worker = workerForSocket(socket);
+    if (worker != nullptr)
+        worker->finishChunkedAnswer(socket);
+}
+
+void AbstractRestServerPrivate::readRequestBody(QTcpSocket *socket, const RequestBodyConsumer &consumer)
+{
+    WorkerThread *worker = workerForSocket(socket);
+    if (worker != nullptr) {
+        worker->readRequestBody(socket, consumer);
+    } else {
+        qCWarning(proofNetworkMiscLog) << "Wanted to read body at socket"
+                                       << QStringLiteral("QTcpSocket(%1)").arg(reinterpret_cast<quint64>(socket), 0, 16)
+                                       << "but it is dead already";
+    }
+}
+
+RestCancellationToken AbstractRestServerPrivate::cancellationToken(QTcpSocket *socket)
+{
+    if (currentExecutorPoolCall && currentExecutorPoolCall->socket == socket)
+        return currentExecutorPoolCall->cancellation;
+    WorkerThread *worker = workerForSocket(socket);
+    if (worker != nullptr)
+        return worker->cancellationToken(socket);
+    //Socket is closed already, so nobody waits for result
+    RestCancellationToken token;
+    token.cancel();
+    return token;
+}
+
+Future<RestResponse> AbstractRestServerPrivate::executeBatch(QTcpSocket *socket, const QStringList &headers,
+                                                            const QByteArray &body)
+{
+    const QJsonDocument doc = QJsonDocument::fromJson(body);
+    const QJsonArray items = doc.array();
+    if (!doc.isArray() || items.count() > MAX_BATCH_ITEMS) {
+        return Future<RestResponse>::successful(
+            RestResponse("", QStringLiteral("text/plain; charset=utf-8"), 400,
+                         doc.isArray() ? QStringLiteral("Too many items") : QStringLiteral("Bad Request")));
+    }
+    if (items.isEmpty())
+        return Future<RestResponse>::successful(RestResponse("[]", QStringLiteral("text/json")));
+
+    struct BatchState
+    {
+        std::vector<RestResponse> results;
+        std::atomic_int left;
+        Promise<RestResponse> promise;
+    };
+    auto state = QSharedPointer<BatchState>::create();
+    state->results.resize(static_cast<size_t>(items.count()));
+    state->left = items.count();
+    auto onItemDone = [state](int index, const RestResponse &response) {
+        state->results[static_cast<size_t>(index)] = response;
+        if (--state->left)
+            return;
+        QJsonArray answer;
+        for (const auto &result : state->results)
+            answer.append(batchItemJson(result));
+        state->promise.success(
+            RestResponse(QJsonDocument(answer).toJson(QJsonDocument::Compact), QStringLiteral("text/json")));
+    };
+
+    //Items that are not answered yet are canceled when batch client disconnects or batch deadline passes
+    const RestCancellationToken cancellation = cancellationToken(socket);
+    const QDeadlineTimer deadline = cancellation.deadline();
+    for (int i = 0; i < items.count(); ++i) {
+        QString error;
+        const QJsonObject item = items[i].toObject();
+        const QByteArray request = batchItemRequest(item, headers, deadline, &error);
+        if (QUrl(item.value(QStringLiteral("path")).toString()).path().endsWith(QLatin1String("/system/batch")))
+            error = QStringLiteral("Nested batches are not allowed");
+        if (!error.isEmpty()) {
+            onItemDone(i, RestResponse(error.toUtf8(), QStringLiteral("text/plain; charset=utf-8"), 400,
+                                       QStringLiteral("Bad Request")));
+            continue;
+        }
+        Promise<RestResponse> itemPromise;
+        itemPromise.future().onSuccess([onItemDone, i](const RestResponse &response) { onItemDone(i, response); });
+        //Items are spread over existing workers by same choice as new connections, worker is chosen in server thread
+        QMetaObject::invokeMethod(q_ptr,
+                                  [this, request, itemPromise, cancellation] {
+                                      WorkerThread *worker = chooseWorker(true);
+                                      worker->executeBatchItem(request, itemPromise, cancellation);
+                                  },
+                                  Qt::QueuedConnection);
+    }
+    return state->promise.future();
+}
+
+WorkerThread *AbstractRestServerPrivate::workerForSocket(QTcpSocket *socket)
+{
+    QMutexLocker lock(&socketsMutex);
+    return sockets.contains(socket) ? qobject_cast<WorkerThread *>(socket->thread()) : nullptr;
+}
+
+WorkerThread *AbstractRestServerPrivate::chooseWorker(bool forBatchItem)
+{
+    //Power of two choices: less loaded of two random workers is almost as good as least loaded one,
+    //but doesn't require to look through all of them
+    WorkerThread *worker = nullptr;
+    const int poolSize = threadPool.count();
+    if (poolSize == 1) {
+        worker = threadPool.first();
+    } else if (poolSize > 1) {
+        int first = QRandomGenerator::global()->bounded(poolSize);
+        int second = QRandomGenerator::global()->bounded(poolSize - 1);
+        if (second >= first)
+            ++second;
+        worker = threadPool[first]->socketCount <= threadPool[second]->socketCount ? threadPool[first]
+                                                                                    : threadPool[second];
+    }
+
+    //Batch items are spread over existing workers, pool grows only for connections
+    if (!worker || (!forBatchItem && worker->socketCount > 0 && poolSize < suggestedMaxThreadsCount)) {
+        worker = new WorkerThread(this, acquireWorkerMetrics());
+        worker->start();
+        threadPool << worker;
+        workerThreadsCount = threadPool.count();
+    }
+    if (forBatchItem)
+        ++worker->batchItemsCount;
+    else
+        ++worker->socketCount;
+    return worker;
+}
+
+void AbstractRestServerPrivate::stopIdleWorkers()
+{
+    //One worker is always kept to not spawn thread for each connection after quiet period
+    for (int i = threadPool.count() - 1; i >= 0 && threadPool.count() > 1; --i) {
+        WorkerThread *worker = threadPool[i];
+        if (worker->socketCount > 0 || worker->batchItemsCount > 0) {
+            worker->idleChecks = 0;
+            continue;
+        }
+        if (++worker->idleChecks < 2)
+            continue;
+        qCDebug(proofNetworkExtraLog) << "Stopping idle worker" << worker;
+        threadPool.removeAt(i);
+        workerThreadsCount = threadPool.count();
+        worker->stop();
+        worker->quit();
+        worker->wait(1000);
+        releaseWorkerMetrics(worker->metrics);
+        delete worker;
+    }
+}
+
+RestServerMetrics *AbstractRestServerPrivate::acquireWorkerMetrics()
+{
+    QMutexLocker locker(&metricsMutex);
+    const int routesCount = router.routesCount();
+    for (int i = 0; i < freeWorkersMetrics.count(); ++i) {
+        if (freeWorkersMetrics[i]->unmatchedRoute() == routesCount)
+            return freeWorkersMetrics.takeAt(i);
+    }
+    workersMetrics << QSharedPointer<RestServerMetrics>::create(routesCount);
+    return workersMetrics.last().data();
+}
+
+void AbstractRestServerPrivate::releaseWorkerMetrics(RestServerMetrics *metrics)
+{
+    QMutexLocker locker(&metricsMutex);
+    freeWorkersMetrics << metrics;
+}
+
+QByteArray AbstractRestServerPrivate::prometheusMetrics()
+{
+    QMutexLocker locker(&metricsMutex);
+    QVector<const RestServerMetrics *> allMetrics;
+    allMetrics.reserve(workersMetrics.count());
+    for (const auto &metrics : qAsConst(workersMetrics))
+        allMetrics << metrics.data();
+    return RestServerMetrics::toPrometheus(allMetrics, router.routeNames());
+}
+
+void AbstractRestServerPrivate::refreshStaticStatus()
+{
+    QStringList ipsList;
+    const auto allIfaces = QNetworkInterface::allInterfaces();
+    for (const auto &interface : allIfaces) {
+        const auto addressEntries = interface.addressEntries();
+        for (const auto &address : addressEntries) {
+            if (!address.ip().isLoopback())
+                ipsList << QStringLiteral("%1 (%2)").arg(address.ip().toString(), interface.humanReadableName());
+        }
+    }
+
+    QJsonObject status{{QStringLiteral("app_type"), qApp->applicationName()},
+                       {QStringLiteral("app_version"), qApp->applicationVersion()},
+                       {QStringLiteral("proof_version"), Proof::proofVersion()},
+                       {QStringLiteral("started_at"), proofApp->startedAt().toString(Qt::ISODate)},
+                       {QStringLiteral("last_crash_at"), lastCrashAt()},
+                       {QStringLiteral("os"), QSysInfo::prettyProductName()},
+                       {QStringLiteral("network_addresses"), QJsonArray::fromStringList(ipsList)}};
+
+    QMutexLocker locker(&statusMutex);
+    if (status != staticStatus) {
+        staticStatus = status;
+        ++staticStatusVersion;
+    }
+}
+
+void AbstractRestServerPrivate::refreshCrashesStatus()
+{
+#if (defined(Q_OS_LINUX) && !defined(Q_OS_ANDROID)) || defined(Q_OS_MAC)
+    QStringList snapshot;
+    const QFileInfoList crashes = QDir(crashesDirPath()).entryInfoList({"proof_crash_*"}, QDir::Files, QDir::Name);
+    for (const auto &crash : crashes)
+        snapshot << QStringLiteral("%1 %2").arg(crash.fileName()).arg(crash.lastModified().toMSecsSinceEpoch());
+    if (snapshot == crashesSnapshot)
+        return;
+    crashesSnapshot = snapshot;
+
+    const QString crashAt = lastCrashAt();
+    QMutexLocker locker(&statusMutex);
+    if (!staticStatus.isEmpty() && staticStatus.value(QStringLiteral("last_crash_at")).toString() != crashAt) {
+        staticStatus[QStringLiteral("last_crash_at")] = crashAt;
+        ++staticStatusVersion;
+    }
+#endif
+}
+
+Future<QByteArray> AbstractRestServerPrivate::statusAnswer(bool quick)
+{
+    Q_Q(AbstractRestServer);
+    statusMutex.lock();
+    const bool hasStaticStatus = !staticStatus.isEmpty();
+    statusMutex.unlock();
+    if (!hasStaticStatus)
+        refreshStaticStatus();
+
+    const int kind = quick ? 1 : 0;
+    Promise<QByteArray> promise;
+    quint64 refreshId = 0;
+    {
+        QMutexLocker locker(&statusMutex);
+        StatusCache &cache = statusCaches[kind];
+        if (cache.hasHealthStatus && !cache.healthStatusExpiration.hasExpired())
+            return Future<QByteArray>::successful(cachedStatusAnswer(cache));
+        if (cache.refreshing)
+            return cache.refreshPromise.future();
+        cache.refreshing = true;
+        cache.refreshPromise = promise;
+        refreshId = ++cache.refreshId;
+    }
+
+    //Stuck healthStatus() shouldn't hang all status requests, waiters get previous snapshot if there is one
+    QTimer::singleShot(HEALTH_STATUS_TIMEOUT, q, [this, kind, refreshId, promise] {
+        QByteArray answer;
+        {
+            QMutexLocker locker(&statusMutex);
+            StatusCache &cache = statusCaches[kind];
+            if (!cache.refreshing || cache.refreshId != refreshId)
+                return;
+            cache.refreshing = false;
+            if (cache.hasHealthStatus)
+                answer = cachedStatusAnswer(cache);
+        }
+        qCWarning(proofNetworkMiscLog) << "RestServer: health status is not fetched in" << HEALTH_STATUS_TIMEOUT
+                                       << "ms";
+        if (promise.isFilled())
+            return;
+        if (answer.isEmpty()) {
+            promise.failure(Failure(QStringLiteral("Health status fetch timed out"), NETWORK_MODULE_CODE,
+                                    NetworkErrorCode::ServiceUnavailable));
+        } else {
+            promise.success(answer);
+        }
+    });
+
+    //Health status is requested without lock, it can be filled synchronously
+    q->healthStatus(quick)
+        .onSuccess([this, kind, refreshId, promise](const HealthStatusMap &healthStatus) {
+            QByteArray answer;
+            {
+                QMutexLocker locker(&statusMutex);
+                StatusCache &cache = statusCaches[kind];
+                //Late result is still the freshest one, so it is stored even after timeout
+                cache.healthStatus = healthStatus;
+                cache.hasHealthStatus = true;
+                cache.healthStatusExpiration = QDeadlineTimer(healthStatusCacheTtls[kind]);
+                cache.answer.clear();
+                if (cache.refreshId == refreshId)
+                    cache.refreshing = false;
+                answer = cachedStatusAnswer(cache);
+            }
+            if (!promise.isFilled())
+                promise.success(answer);
+        })
+        .onFailure([this, kind, refreshId, promise](const Failure &f) {
+            {
+                QMutexLocker locker(&statusMutex);
+                StatusCache &cache = statusCaches[kind];
+                if (cache.refreshId == refreshId)
+                    cache.refreshing = false;
+            }
+            if (!promise.isFilled())
+                promise.failure(f);
+        });
+    return promise.future();
+}
+
+QByteArray AbstractRestServerPrivate::cachedStatusAnswer(StatusCache &cache)
+{
+    auto notificationsMemoryStorage = ErrorNotifier::instance()->handler<MemoryStorageNotificationHandler>();
+    //Without storage there is nothing to compare, error timestamp is set to answer generation time
+    const QPair<QDateTime, QString> lastError =
+        notificationsMemoryStorage ? notificationsMemoryStorage->lastMessage()
+                                   : qMakePair(QDateTime(), QStringLiteral("Memory storage error handler not set"));
+    if (!cache.answer.isEmpty() && cache.lastError == lastError && cache.staticStatusVersion == staticStatusVersion)
+        return cache.answer;
+
+    const QDateTime generatedAt = QDateTime::currentDateTimeUtc();
+    QJsonObject statusObj = staticStatus;
+    if (notificationsMemoryStorage)
+        statusObj[QStringLiteral("app_id")] = notificationsMemoryStorage->appId();
+    const QDateTime lastErrorTime = notificationsMemoryStorage ? lastError.first : generatedAt;
+    statusObj[QStringLiteral("last_error")] = lastErrorTime.isValid()
+                                                  ? QJsonObject{{QStringLiteral("timestamp"),
+                                                                 lastErrorTime.toString(Qt::ISODate)},
+                                                                {QStringLiteral("message"), lastError.second}}
+                                                  : QJsonValue();
+
+    auto healthMapper = [](const QString &name, const auto &data) {
+        return QJsonObject{{QStringLiteral("name"), name},
+                           {QStringLiteral("value"), QJsonValue::fromVariant(data.second)},
+                           {QStringLiteral("updated_at"), data.first.toString(Qt::ISODate)}};
+    };
+    statusObj[QStringLiteral("health")] = algorithms::map(cache.healthStatus, healthMapper, QJsonArray());
+    statusObj[QStringLiteral("generated_at")] = generatedAt.toString(Qt::ISODate);
+
+    cache.answer = QJsonDocument(statusObj).toJson(QJsonDocument::Compact);
+    cache.lastError = lastError;
+    cache.staticStatusVersion = staticStatusVersion;
+    return cache.answer;
+}
+
+void AbstractRestServerPrivate::writeRecentErrors(QTcpSocket *socket,
+                                                  const QPointer<MemoryStorageNotificationHandler> &storage,
+                                                  quint64 beforeId, const QDateTime &since, int left,
+                                                  ErrorNotifier::Severity minSeverity, bool isFirstChunk)
+{
+    QByteArray chunk = isFirstChunk ? "[" : "";
+    const int chunkLimit = left < 0 ? RECENT_ERRORS_CHUNK_SIZE : qMin(left, RECENT_ERRORS_CHUNK_SIZE);
+    int visited = 0;
+    if (storage && chunkLimit) {
+        bool needsComma = !isFirstChunk;
+        visited = storage->forEachRecentMessage(
+            [&chunk, &beforeId, &needsComma](const MemoryStorageNotificationHandler::Message &message) {
+                if (std::exchange(needsComma, true))
+                    chunk.append(',');
+                chunk.append(recentErrorJson(message));
+                beforeId = message.id;
+                return true;
+            },
+            beforeId, since, chunkLimit, minSeverity);
+    }
+    if (left > 0)
+        left -= visited;
+
+    if (visited < chunkLimit || !left) {
+        chunk.append(']');
+        writeAnswerChunk(socket, chunk);
+        finishChunkedAnswer(socket);
+        return;
+    }
+    writeAnswerChunk(socket, chunk).onSuccess([this, socket, storage, beforeId, since, left, minSeverity](bool ok) {
+        if (ok)
+            writeRecentErrors(socket, storage, beforeId, since, left, minSeverity, false);
+    });
+}
+
+void AbstractRestServerPrivate::registerSocket(QTcpSocket *socket)
+{
+    QMutexLocker lock(&socketsMutex);
+    sockets.insert(socket);
 }
 
-void AbstractRestServerPrivate::deleteSocket(QTcpSocket *socket, WorkerThread *worker)
+void AbstractRestServerPrivate::deleteSocket(QTcpSocket *socket, WorkerThread *worker, bool isBatchItem)
 {
     {
         QMutexLocker lock(&socketsMutex);
@@ -740,15 +2394,137 @@ void AbstractRestServerPrivate::deleteSocket(QTcpSocket *socket, WorkerThread *w
             return;
     }
     delete socket;
-    threadPoolLock.lockForRead();
-    auto iter = std::find_if(threadPool.begin(), threadPool.end(),
-                             [worker](const WorkerThreadInfo &info) { return info.thread == worker; });
-    if (iter != threadPool.end())
-        --iter->socketCount;
-    threadPoolLock.unlock();
+    if (isBatchItem)
+        --worker->batchItemsCount;
+    else
+        --worker->socketCount;
+}
+
+bool AbstractRestServerPrivate::isKeepAliveAllowed(int handledRequests) const
+{
+    return !draining && keepAliveTimeout > 0
+           && (maxRequestsPerConnection <= 0 || handledRequests < maxRequestsPerConnection);
+}
+
+void AbstractRestServerPrivate::startDrain(int msecs, const Promise<bool> &promise)
+{
+    Q_Q(AbstractRestServer);
+    drainPromises << promise;
+    if (draining && drainTimer && drainTimer->isActive())
+        return;
+    draining = true;
+    drainDeadline = QDeadlineTimer(qMax(0, msecs));
+    if (localServer)
+        localServer->close();
+    if (handoffServer)
+        handoffServer->close();
+    q->close();
+    qCDebug(proofNetworkMiscLog) << "RestServer: draining for" << msecs << "msecs";
+    for (WorkerThread *worker : qAsConst(threadPool))
+        worker->startDrain();
+    if (!drainTimer) {
+        drainTimer = new QTimer(q);
+        drainTimer->setInterval(DRAIN_PROGRESS_INTERVAL);
+        QObject::connect(drainTimer, &QTimer::timeout, q, [this] { checkDrainProgress(); });
+    }
+    drainTimer->start();
+    checkDrainProgress();
+}
+
+void AbstractRestServerPrivate::checkDrainProgress()
+{
+    Q_Q(AbstractRestServer);
+    qlonglong openSockets = 0;
+    for (WorkerThread *worker : qAsConst(threadPool))
+        openSockets += worker->socketCount;
+    emit q->drainProgress(inFlightRequests, static_cast<int>(openSockets));
+    if (openSockets > 0 && !drainDeadline.hasExpired())
+        return;
+    drainTimer->stop();
+    if (openSockets > 0) {
+        qCWarning(proofNetworkMiscLog) << "RestServer: drain deadline passed with" << inFlightRequests
+                                       << "requests in progress and" << openSockets << "open sockets";
+    } else {
+        qCDebug(proofNetworkMiscLog) << "RestServer: drained";
+    }
+    const auto promises = std::exchange(drainPromises, {});
+    for (const auto &promise : promises)
+        promise.success(openSockets == 0);
+}
+
+bool AbstractRestServerPrivate::takeOverListeningSocket()
+{
+#ifdef Q_OS_UNIX
+    Q_Q(AbstractRestServer);
+    int connection = connectToLocalSocket(handoffSocketPath);
+    if (connection < 0)
+        return false;
+    //Server thread is blocked here, so whole takeover is bounded by single timeout
+    const QDeadlineTimer deadline(HANDOFF_TIMEOUT);
+    int descriptor = receiveDescriptor(connection, static_cast<int>(deadline.remainingTime()));
+    if (descriptor < 0 || !q->setSocketDescriptor(descriptor)) {
+        qCWarning(proofNetworkMiscLog) << "RestServer: can't take listening socket over from" << handoffSocketPath;
+        if (descriptor >= 0)
+            ::close(descriptor);
+        ::close(connection);
+        return false;
+    }
+    //Previous process closes connection after its handoff socket is removed, so path can be listened again
+    pollfd pollDescriptor{connection, POLLIN, 0};
+    char payload = 0;
+    while (!deadline.hasExpired() && ::poll(&pollDescriptor, 1, static_cast<int>(deadline.remainingTime())) > 0
+           && ::recv(connection, &payload, 1, 0) > 0)
+        ;
+    ::close(connection);
+    qCDebug(proofNetworkMiscLog) << "RestServer: listening socket is taken over from" << handoffSocketPath;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void AbstractRestServerPrivate::handOffListeningSocket(qintptr connection)
+{
+#ifdef Q_OS_UNIX
+    Q_Q(AbstractRestServer);
+    const int descriptor = static_cast<int>(q->socketDescriptor());
+    if (descriptor < 0 || draining || !sendDescriptor(static_cast<int>(connection), descriptor)) {
+        qCWarning(proofNetworkMiscLog) << "RestServer: can't hand listening socket off";
+        ::close(static_cast<int>(connection));
+        return;
+    }
+    qCDebug(proofNetworkMiscLog) << "RestServer: listening socket is handed off, draining";
+    //Kernel socket stays open in new process, so connections in backlog are accepted there
+    handoffServer->close();
+    ::close(static_cast<int>(connection));
+    startDrain(handoffDrainTimeout, Promise<bool>());
+    emit q->listeningSocketHandedOff();
+#else
+    Q_UNUSED(connection)
+#endif
 }
 
-WorkerThread::WorkerThread(Proof::AbstractRestServerPrivate *const serverD) : serverD(serverD)
+QByteArray AbstractRestServerPrivate::staticAnswerHeaders()
+{
+    QMutexLocker locker(&customHeadersMutex);
+    if (!staticAnswerHeadersCache.isEmpty())
+        return staticAnswerHeadersCache;
+
+    const QByteArray appName = proofApp->prettifiedApplicationName().toUtf8();
+    QByteArray result;
+    result.append("Proof-Application: ").append(appName).append("\r\n");
+    result.append("Proof-").append(appName).append("-Version: ").append(qApp->applicationVersion().toUtf8());
+    result.append("\r\n");
+    result.append("Proof-").append(appName).append("-Framework-Version: ").append(Proof::proofVersion().toUtf8());
+    result.append("\r\n");
+    for (auto it = customHeaders.cbegin(); it != customHeaders.cend(); ++it)
+        result.append(it.key().toUtf8()).append(": ").append(it.value().toUtf8()).append("\r\n");
+    staticAnswerHeadersCache = result;
+    return result;
+}
+
+WorkerThread::WorkerThread(Proof::AbstractRestServerPrivate *const serverD, Proof::RestServerMetrics *const metrics)
+    : metrics(metrics), serverD(serverD)
 {
     moveToThread(this);
 }
@@ -756,16 +2532,35 @@ WorkerThread::WorkerThread(Proof::AbstractRestServerPrivate *const serverD) : se
 WorkerThread::~WorkerThread()
 {}
 
-void WorkerThread::handleNewConnection(qintptr socketDescriptor)
+void WorkerThread::handleNewConnection(qintptr socketDescriptor, bool overSocketsLimit)
 {
-    if (Proof::ProofObject::safeCall(this, &WorkerThread::handleNewConnection, socketDescriptor))
+    if (Proof::ProofObject::safeCall(this, &WorkerThread::handleNewConnection, socketDescriptor, overSocketsLimit))
         return;
 
-    QTcpSocket *tcpSocket = new QTcpSocket();
+    Proof::EpollSocket *epollSocket = nullptr;
+    if (serverD->ioBackend == Proof::RestServerIoBackend::Epoll) {
+        if (!epollPoller) {
+            epollPoller = new Proof::EpollPoller(this);
+            epollPoller->setReadyReadHandler([this](Proof::EpollSocket *socket) {
+                auto infoIt = sockets.constFind(socket);
+                if (infoIt != sockets.cend() && !infoIt->readingStopped)
+                    onReadyRead(socket);
+            });
+        }
+        //Qt backend is used if epoll can't be created, so server keeps working
+        if (epollPoller->isValid())
+            epollSocket = new Proof::EpollSocket(epollPoller);
+    }
+    QTcpSocket *tcpSocket = epollSocket ? epollSocket : new QTcpSocket();
     serverD->registerSocket(tcpSocket);
     SocketInfo info;
-    info.readyReadConnection = connect(tcpSocket, &QTcpSocket::readyRead, this,
-                                       [tcpSocket, this] { onReadyRead(tcpSocket); }, Qt::QueuedConnection);
+    info.parser.setMaxBodySize(serverD->maxRequestBodySize);
+    info.overSocketsLimit = overSocketsLimit;
+    info.epollSocket = epollSocket;
+    if (!epollSocket) {
+        info.readyReadConnection = connect(tcpSocket, &QTcpSocket::readyRead, this,
+                                           [tcpSocket, this] { onReadyRead(tcpSocket); }, Qt::QueuedConnection);
+    }
 
     void (QTcpSocket::*errorSignal)(QAbstractSocket::SocketError) = &QTcpSocket::error;
     info.errorConnection = connect(tcpSocket, errorSignal, this,
@@ -778,48 +2573,751 @@ void WorkerThread::handleNewConnection(qintptr socketDescriptor)
     info.disconnectConnection = connect(tcpSocket, &QTcpSocket::disconnected, this,
                                         [tcpSocket, this] { deleteSocket(tcpSocket); }, Qt::QueuedConnection);
 
-    if (!tcpSocket->setSocketDescriptor(socketDescriptor)) {
+    info.bytesWrittenConnection = connect(tcpSocket, &QTcpSocket::bytesWritten, this,
+                                          [tcpSocket, this] { onAnswerBytesWritten(tcpSocket); });
+
+    const bool isOpened = epollSocket ? epollSocket->setDescriptor(socketDescriptor)
+                                      : tcpSocket->setSocketDescriptor(socketDescriptor);
+    if (!isOpened) {
         qCWarning(proofNetworkMiscLog) << "RestServer: can't create socket, error:" << tcpSocket->errorString();
         serverD->deleteSocket(tcpSocket, this);
         return;
     }
+    armIdleDeadline(info);
     sockets[tcpSocket] = info;
     qCDebug(proofNetworkExtraLog) << "Handling socket descriptor" << socketDescriptor << "with socket" << tcpSocket;
 }
 
 void WorkerThread::deleteSocket(QTcpSocket *socket)
 {
-    sockets.remove(socket);
-    serverD->deleteSocket(socket, this);
+    auto infoIt = sockets.find(socket);
+    const bool isBatchItem = infoIt != sockets.end() && infoIt->batchItemId;
+    if (infoIt != sockets.end()) {
+        stopAnswerStream(infoIt.value(), false);
+        if (infoIt->requestInProgress)
+            infoIt->cancellation.cancel();
+        if (infoIt->batchAnswer)
+            std::exchange(infoIt->batchAnswer, nullptr)(QByteArray());
+        if (infoIt->cancelAsyncAnswer)
+            std::exchange(infoIt->cancelAsyncAnswer, nullptr)();
+        if (infoIt->metricsRoute >= 0)
+            finishRequestMetrics(infoIt.value());
+        sockets.erase(infoIt);
+    }
+    serverD->deleteSocket(socket, this, isBatchItem);
 }
 
 void WorkerThread::onReadyRead(QTcpSocket *socket)
 {
-    SocketInfo &info = sockets[socket];
-    HttpParser::Result result = info.parser.parseNextPart(socket->readAll());
+    auto infoIt = sockets.find(socket);
+    if (infoIt == sockets.end())
+        return;
+    SocketInfo &info = infoIt.value();
+    //Pipelined requests are kept in socket until current one is answered
+    if (info.requestInProgress) {
+        if (info.streamingBody)
+            feedBodyConsumer(socket, info);
+        return;
+    }
+
+    QByteArray data = socket->readAll();
+    if (!info.parseStarted && (!data.isEmpty() || info.parser.hasPendingData())) {
+        info.parseStarted = true;
+        info.phaseTimer.start();
+    }
+    info.receivedBytes += data.size();
+    HttpParser::Result result = info.parser.parseNextPart(data);
+    if (result == HttpParser::Result::HeadersReady) {
+        if (serverD->isStreamingBodyRequest(info.parser)) {
+            info.parser.setBodySpillThreshold(0);
+            startBodyStreaming(socket, info);
+            return;
+        }
+        info.parser.setBodySpillThreshold(serverD->requestBodySpillThreshold);
+        if (qstricmp(info.parser.header(HttpParser::Header::Expect).constData(), "100-continue") == 0)
+            socket->write("HTTP/1.1 100 Continue\r\n\r\n");
+        result = info.parser.parseNextPart(QByteArray());
+    }
+
     switch (result) {
     case HttpParser::Result::Success:
-        disconnect(info.readyReadConnection);
-        serverD->tryToCallMethod(socket, info.parser.method(), info.parser.uri(), info.parser.headers(),
-                                 info.parser.body());
+        startRequest(info);
+        dispatchRequest(socket, info);
         break;
     case HttpParser::Result::Error:
-        qCCritical(proofNetworkMiscLog) << "RestServer: parse error:" << info.parser.error();
-        disconnect(info.readyReadConnection);
-        sendAnswer(socket, "", QStringLiteral("text/plain; charset=utf-8"), QHash<QString, QString>(), 400,
-                   QStringLiteral("Bad Request"));
+        sendParseError(socket, info);
         break;
     case HttpParser::Result::NeedMore:
+    case HttpParser::Result::HeadersReady:
+        armIdleDeadline(info);
+        break;
+    }
+}
+
+void WorkerThread::readRequestBody(QTcpSocket *socket, const RequestBodyConsumer &consumer)
+{
+    if (Proof::ProofObject::safeCall(this, &WorkerThread::readRequestBody, socket, consumer))
+        return;
+
+    auto infoIt = sockets.find(socket);
+    if (infoIt == sockets.end() || !infoIt->requestInProgress) {
+        qCWarning(proofNetworkMiscLog) << "RestServer: body read for socket" << socket
+                                       << "skipped, request is already answered";
+        return;
+    }
+    SocketInfo &info = infoIt.value();
+    if (!info.streamingBody) {
+        consumer(info.parser.body(), true);
+        return;
+    }
+    info.bodyConsumer = consumer;
+    feedBodyConsumer(socket, info);
+}
+
+void WorkerThread::startRequest(SocketInfo &info)
+{
+    info.idleDeadline = QDeadlineTimer(QDeadlineTimer::Forever);
+    info.requestInProgress = true;
+    ++info.handledRequests;
+    info.cacheKey.clear();
+    info.keepAlive = !info.overSocketsLimit && info.parser.keepAlive()
+                     && serverD->isKeepAliveAllowed(info.handledRequests);
+}
+
+void WorkerThread::armIdleDeadline(SocketInfo &info)
+{
+    const int timeout = serverD->keepAliveTimeout;
+    if (timeout <= 0)
+        return;
+    info.idleDeadline.setRemainingTime(timeout, Qt::CoarseTimer);
+    //Single coarse timer per worker instead of timer per socket, so requests don't touch event dispatcher timers
+    if (!idleSweepTimer) {
+        idleSweepTimer = new QTimer(this);
+        idleSweepTimer->setTimerType(Qt::CoarseTimer);
+        connect(idleSweepTimer, &QTimer::timeout, this, &WorkerThread::sweepIdleSockets);
+    }
+    const int interval = qBound(IDLE_SOCKETS_SWEEP_MIN_INTERVAL, timeout / 4, IDLE_SOCKETS_SWEEP_MAX_INTERVAL);
+    if (!idleSweepTimer->isActive() || idleSweepTimer->interval() != interval)
+        idleSweepTimer->start(interval);
+}
+
+void WorkerThread::sweepIdleSockets()
+{
+    QVector<QTcpSocket *> expired;
+    bool hasArmed = false;
+    for (auto it = sockets.begin(); it != sockets.end(); ++it) {
+        if (it->idleDeadline.isForever())
+            continue;
+        if (it->idleDeadline.hasExpired()) {
+            it->idleDeadline = QDeadlineTimer(QDeadlineTimer::Forever);
+            expired << it.key();
+        } else {
+            hasArmed = true;
+        }
+    }
+    if (!hasArmed)
+        idleSweepTimer->stop();
+    //Disconnection is handled with queued call, so sockets can't be removed while closing them
+    for (QTcpSocket *socket : qAsConst(expired)) {
+        qCDebug(proofNetworkExtraLog) << "Closing idle socket" << socket;
+        socket->disconnectFromHost();
+    }
+}
+
+void WorkerThread::dispatchRequest(QTcpSocket *socket, SocketInfo &info)
+{
+    RouteMatch match;
+    match.route = serverD->findRoute(info.parser, &match.path, &match.variablePartsStart, &match.pathValues);
+    startRequestMetrics(info, match.route ? serverD->router.routeIndex(match.route) : metrics->unmatchedRoute());
+    startDeadline(socket, info);
+    if (!isAdmitted(info, match.route)) {
+        sendServiceUnavailable(socket);
+        return;
+    }
+    if (!serverD->checkAccess(socket, info.parser, match.route))
+        return;
+
+    if (match.route->hasTag(serverD->cacheableTag)) {
+        //Generation is taken before lookup, so answer that is built after it is not stored if invalidated meanwhile
+        info.cacheGeneration = serverD->responseCache.generation(match.route->name);
+        const QByteArray key = info.parser.rawMethod() + ' ' + info.parser.rawUri();
+        auto cached = serverD->responseCache.find(key);
+        if (cached) {
+            sendCachedAnswer(socket, key, *cached);
+            return;
+        }
+        info.cacheKey = key;
+        info.cacheRoute = match.route->name;
+    }
+    ExecutorPool *executor = serverD->routeExecutor(match.route);
+    if (executor)
+        callInExecutorPool(socket, info, match, executor);
+    else
+        serverD->tryToCallMethod(socket, info.parser, match);
+}
+
+void WorkerThread::callInExecutorPool(QTcpSocket *socket, SocketInfo &info, const RouteMatch &match,
+                                      ExecutorPool *executor)
+{
+    const int maxQueued = executor->maxQueuedRequests;
+    if (++executor->queuedRequests > maxQueued && maxQueued > 0 && !match.route->hasTag(serverD->highPriorityTag)) {
+        --executor->queuedRequests;
+        sendServiceUnavailable(socket);
+        return;
+    }
+    //Parser is copied, so worker can proceed with socket while method waits for pool thread.
+    //Spilled body mapping is kept by copied parser as well
+    auto task = [serverD = serverD, socket, parser = info.parser, match, executor,
+                 cancellation = info.cancellation] {
+        --executor->queuedRequests;
+        //Request was answered with 504 or client has gone while it waited in queue
+        if (cancellation.isCanceled())
+            return;
+        ExecutorPoolCall call{socket, cancellation};
+        currentExecutorPoolCall = &call;
+        serverD->tryToCallMethod(socket, parser, match);
+        currentExecutorPoolCall = nullptr;
+    };
+    executor->threads.start(new ExecutorPoolTask(task));
+}
+
+void WorkerThread::startDeadline(QTcpSocket *socket, SocketInfo &info)
+{
+    qint64 timeout = serverD->requestTimeout;
+    const QByteArray clientTimeout = info.parser.header(HttpParser::Header::RequestTimeout);
+    if (!clientTimeout.isEmpty()) {
+        bool ok = false;
+        qint64 parsed = qMin<qint64>(clientTimeout.trimmed().toLongLong(&ok), std::numeric_limits<int>::max());
+        if (ok && parsed > 0)
+            timeout = timeout > 0 ? qMin(timeout, parsed) : parsed;
+    }
+    if (info.deadlineTimer)
+        info.deadlineTimer->stop();
+    if (timeout <= 0) {
+        info.cancellation = RestCancellationToken();
+        return;
+    }
+
+    info.cancellation = RestCancellationToken(QDeadlineTimer(timeout));
+    if (!info.deadlineTimer) {
+        info.deadlineTimer = new QTimer(socket);
+        info.deadlineTimer->setSingleShot(true);
+        connect(info.deadlineTimer, &QTimer::timeout, this, [this, socket] { onRequestDeadline(socket); });
+    }
+    info.deadlineTimer->start(static_cast<int>(timeout));
+}
+
+void WorkerThread::onRequestDeadline(QTcpSocket *socket)
+{
+    auto infoIt = sockets.find(socket);
+    if (infoIt == sockets.end() || !infoIt->requestInProgress)
+        return;
+    SocketInfo &info = infoIt.value();
+    qCDebug(proofNetworkExtraLog) << "RestServer: request at socket" << socket << "is not answered before deadline";
+    info.cancellation.cancel();
+    if (info.cancelAsyncAnswer)
+        std::exchange(info.cancelAsyncAnswer, nullptr)();
+    //Method can still answer later, so connection is closed to not mix its answer with next request
+    info.keepAlive = false;
+    sendAnswer(socket, "", QStringLiteral("text/plain; charset=utf-8"), QHash<QString, QString>(), 504,
+               QStringLiteral("Gateway Timeout"));
+}
+
+void WorkerThread::executeBatchItem(const QByteArray &request, const Promise<RestResponse> &promise,
+                                    const RestCancellationToken &batchCancellation)
+{
+    if (Proof::ProofObject::safeCall(this, &WorkerThread::executeBatchItem, request, promise, batchCancellation))
+        return;
+
+    auto unanswered = [] {
+        return RestResponse("", QStringLiteral("text/plain; charset=utf-8"), 503,
+                            QStringLiteral("Service Unavailable"));
+    };
+    if (batchCancellation.isCanceled()) {
+        --batchItemsCount;
+        promise.success(unanswered());
+        return;
+    }
+
+    auto *socket = new BatchItemSocket();
+    serverD->registerSocket(socket);
+    SocketInfo info;
+    info.parser.setMaxBodySize(serverD->maxRequestBodySize);
+    info.batchAnswer = [promise, unanswered](const QByteArray &answer) {
+        promise.success(answer.isEmpty() ? unanswered() : parseBatchItemAnswer(answer));
+    };
+    const quint64 itemId = ++lastBatchItemId;
+    info.batchItemId = itemId;
+    auto infoIt = sockets.insert(socket, info);
+    QPointer<WorkerThread> self(this);
+    batchCancellation.canceled().onSuccess([self, socket, itemId](bool) {
+        if (self)
+            self->cancelBatchItem(socket, itemId);
+    });
+
+    HttpParser::Result result = infoIt->parser.parseNextPart(request);
+    if (result == HttpParser::Result::HeadersReady) {
+        if (serverD->isStreamingBodyRequest(infoIt->parser)) {
+            startBodyStreaming(socket, infoIt.value());
+            return;
+        }
+        result = infoIt->parser.parseNextPart(QByteArray());
+    }
+    if (result == HttpParser::Result::Success) {
+        startRequest(infoIt.value());
+        dispatchRequest(socket, infoIt.value());
+    } else {
+        sendParseError(socket, infoIt.value());
+    }
+}
+
+void WorkerThread::cancelBatchItem(QTcpSocket *socket, quint64 itemId)
+{
+    if (Proof::ProofObject::safeCall(this, &WorkerThread::cancelBatchItem, socket, itemId))
+        return;
+    //Item can be answered already and its socket address reused, so item id is checked too
+    auto infoIt = sockets.constFind(socket);
+    if (infoIt == sockets.cend() || infoIt->batchItemId != itemId || !infoIt->batchAnswer)
+        return;
+    qCDebug(proofNetworkExtraLog) << "Canceling batch item" << socket << "after batch cancellation";
+    deleteSocket(socket);
+}
+
+RestCancellationToken WorkerThread::cancellationToken(QTcpSocket *socket) const
+{
+    if (QThread::currentThread() != this) {
+        qCWarning(proofNetworkMiscLog) << "RestServer: cancellation token for socket" << socket
+                                       << "can be taken only by method itself";
+        return RestCancellationToken();
+    }
+    auto infoIt = sockets.constFind(socket);
+    if (infoIt != sockets.cend() && infoIt->requestInProgress)
+        return infoIt->cancellation;
+    RestCancellationToken token;
+    token.cancel();
+    return token;
+}
+
+void WorkerThread::startRequestMetrics(SocketInfo &info, int route)
+{
+    info.metricsRoute = route;
+    metrics->requestStarted(route);
+    metrics->bytesReceived(route, info.receivedBytes);
+    metrics->addDuration(route, RestServerMetrics::Phase::Parse,
+                         info.parseStarted ? info.phaseTimer.nsecsElapsed() / 1000 : 0);
+    info.receivedBytes = 0;
+    info.parseStarted = false;
+    info.phaseTimer.start();
+    ++activeRequests;
+    ++serverD->inFlightRequests;
+}
+
+void WorkerThread::finishRequestMetrics(SocketInfo &info)
+{
+    metrics->requestFinished(info.metricsRoute);
+    info.metricsRoute = -1;
+    --activeRequests;
+    --serverD->inFlightRequests;
+}
+
+bool WorkerThread::isAdmitted(const SocketInfo &info, const RestRouter::Route *route) const
+{
+    if (route && route->hasTag(serverD->highPriorityTag))
+        return true;
+    if (info.overSocketsLimit)
+        return false;
+    //Current request is already counted
+    if (serverD->maxInFlightRequests > 0 && serverD->inFlightRequests > serverD->maxInFlightRequests)
+        return false;
+    return serverD->maxQueuedRequestsPerWorker <= 0 || activeRequests <= serverD->maxQueuedRequestsPerWorker;
+}
+
+void WorkerThread::sendServiceUnavailable(QTcpSocket *socket)
+{
+    static const QByteArray answer = QByteArrayLiteral("HTTP/1.1 503 Service Unavailable\r\n"
+                                                       "Server: proof\r\n"
+                                                       "Connection: close\r\n"
+                                                       "Content-Type: text/plain; charset=utf-8\r\n"
+                                                       "Content-Length: 0\r\n")
+                                     + "Retry-After: " + QByteArray::number(LOAD_SHEDDING_RETRY_AFTER) + "\r\n\r\n";
+    SocketInfo *info = answerableSocketInfo(socket, 503);
+    if (!info)
+        return;
+    qCDebug(proofNetworkExtraLog) << "RestServer: request at socket" << socket << "rejected by admission limits";
+    //Rest of pipelined requests would be rejected as well, so there is no sense to keep connection
+    info->keepAlive = false;
+    metrics->bytesSent(info->metricsRoute, answer.size());
+    socket->write(answer);
+    finishRequest(socket, *info);
+}
+
+void WorkerThread::sendCachedAnswer(QTcpSocket *socket, const QByteArray &key, const RestResponseCache::Answer &answer)
+{
+    auto infoIt = sockets.find(socket);
+    if (infoIt == sockets.end())
+        return;
+    const bool notModified = RestResponseCache::isNotModified(infoIt->parser.header(HttpParser::Header::IfNoneMatch),
+                                                              answer.etag);
+    SocketInfo *info = answerableSocketInfo(socket, notModified ? 304 : 200);
+    if (!info)
+        return;
+    if (notModified) {
+        writeNotModified(socket, *info, answer.contentType,
+                         {{QStringLiteral("ETag"), QString::fromLatin1(answer.etag)}});
+        return;
+    }
+    //Each coding is compressed once per cached answer, next hits write stored variant as is
+    const QByteArray encoding = HttpCompression::encodingName(
+        answerEncoding(*info, answer.body, answer.contentType, answer.headers));
+    auto encoded = answer.encodedBodies.constFind(encoding);
+    if (encoded != answer.encodedBodies.cend()) {
+        writeAnswer(socket, *info, *encoded, answer.contentType, compressedAnswerHeaders(answer.headers, encoding),
+                    200, QString());
+    } else {
+        compressAndWriteAnswer(socket, *info, answer.body, answer.contentType, answer.headers, 200, QString(), key);
+    }
+}
+
+void WorkerThread::writeNotModified(QTcpSocket *socket, SocketInfo &info, const QString &contentType,
+                                    const QHash<QString, QString> &headers)
+{
+    //304 has no body and its Content-Length would describe cached representation, so it is not sent at all
+    const QByteArray head = answerHead(info, contentType, headers, 304, QStringLiteral("Not Modified"), QByteArray());
+    metrics->bytesSent(info.metricsRoute, head.size());
+    socket->write(head);
+    finishRequest(socket, info);
+}
+
+void WorkerThread::sendFile(QTcpSocket *socket, const QString &filePath, const QString &contentType,
+                            const QHash<QString, QString> &headers)
+{
+    if (Proof::ProofObject::safeCall(this, &WorkerThread::sendFile, socket, filePath, contentType, headers))
+        return;
+
+    auto infoIt = sockets.find(socket);
+    if (infoIt == sockets.end())
+        return;
+    auto fileAnswer = QSharedPointer<FileAnswer>::create();
+    fileAnswer->file.setFileName(filePath);
+    const QFileInfo fileInfo(filePath);
+    if (!fileInfo.isFile() || !fileAnswer->file.open(QIODevice::ReadOnly)) {
+        qCWarning(proofNetworkMiscLog) << "RestServer: file" << filePath << "can't be opened";
+        sendAnswer(socket, "", QStringLiteral("text/plain; charset=utf-8"), QHash<QString, QString>(), 404,
+                   QStringLiteral("Not Found"));
+        return;
+    }
+
+    const qint64 size = fileAnswer->file.size();
+    const QDateTime lastModified = fileInfo.lastModified().toUTC();
+    const QByteArray etag = '"' + QByteArray::number(size, 16) + '-'
+                            + QByteArray::number(lastModified.toMSecsSinceEpoch(), 16) + '"';
+    const QString lastModifiedDate = httpDate(lastModified);
+    QHash<QString, QString> answerHeaders = headers;
+    answerHeaders[QStringLiteral("ETag")] = QString::fromLatin1(etag);
+    answerHeaders[QStringLiteral("Last-Modified")] = lastModifiedDate;
+    answerHeaders[QStringLiteral("Accept-Ranges")] = QStringLiteral("bytes");
+
+    const HttpParser &request = infoIt->parser;
+    const QByteArray ifNoneMatch = request.header(HttpParser::Header::IfNoneMatch);
+    bool notModified = false;
+    if (!ifNoneMatch.isEmpty()) {
+        notModified = RestResponseCache::isNotModified(ifNoneMatch, etag);
+    } else {
+        const QDateTime ifModifiedSince = fromHttpDate(request.header(HttpParser::Header::IfModifiedSince));
+        notModified = ifModifiedSince.isValid()
+                      && lastModified.toSecsSinceEpoch() <= ifModifiedSince.toSecsSinceEpoch();
+    }
+
+    qint64 start = 0;
+    qint64 end = size;
+    RangeResult range = RangeResult::Ignored;
+    const QByteArray rangeHeader = request.header(HttpParser::Header::Range);
+    const QByteArray ifRange = request.header(HttpParser::Header::IfRange).trimmed();
+    if (!notModified && !rangeHeader.isEmpty()
+        && (ifRange.isEmpty() || ifRange == etag || ifRange == lastModifiedDate.toLatin1())) {
+        range = parseRange(rangeHeader, size, &start, &end);
+    }
+
+    int returnCode = 200;
+    if (notModified)
+        returnCode = 304;
+    else if (range == RangeResult::Satisfiable)
+        returnCode = 206;
+    else if (range == RangeResult::Unsatisfiable)
+        returnCode = 416;
+    SocketInfo *info = answerableSocketInfo(socket, returnCode);
+    if (!info)
+        return;
+    info->cacheKey.clear();
+    if (notModified) {
+        writeNotModified(socket, *info, contentType, answerHeaders);
+        return;
+    }
+    if (range == RangeResult::Unsatisfiable) {
+        answerHeaders[QStringLiteral("Content-Range")] = QStringLiteral("bytes */%1").arg(size);
+        writeAnswer(socket, *info, QByteArray(), contentType, answerHeaders, 416,
+                    QStringLiteral("Range Not Satisfiable"));
+        return;
+    }
+    QString reason;
+    if (range == RangeResult::Satisfiable) {
+        answerHeaders[QStringLiteral("Content-Range")] =
+            QStringLiteral("bytes %1-%2/%3").arg(start).arg(end - 1).arg(size);
+        reason = QStringLiteral("Partial Content");
+    }
+
+    const QByteArray head = answerHead(*info, contentType, answerHeaders, returnCode, reason,
+                                       "Content-Length: " + QByteArray::number(end - start));
+    metrics->bytesSent(info->metricsRoute, head.size());
+    socket->write(head);
+    fileAnswer->position = start;
+    fileAnswer->end = end;
+#ifdef Q_OS_LINUX
+    //Epoll and batch sockets have no native descriptor
+    fileAnswer->useSendfile = socket->socketDescriptor() != -1;
+#endif
+    info->fileAnswer = fileAnswer;
+    info->answerStream = AnswerStream::File;
+    feedFileAnswer(socket, *info);
+}
+
+void WorkerThread::feedFileAnswer(QTcpSocket *socket, SocketInfo &info)
+{
+    FileAnswer &fileAnswer = *info.fileAnswer;
+    if (fileAnswer.useSendfile) {
+        sendfileFileAnswer(socket, info);
+        return;
+    }
+    while (fileAnswer.position < fileAnswer.end && socket->bytesToWrite() < ANSWER_STREAM_HIGH_WATERMARK) {
+        qint64 chunkSize = qMin(FILE_ANSWER_CHUNK_SIZE, fileAnswer.end - fileAnswer.position);
+        const bool isInWindow = fileAnswer.window && fileAnswer.position >= fileAnswer.windowStart
+                                && fileAnswer.position < fileAnswer.windowStart + fileAnswer.windowSize;
+        if (!isInWindow && !fileAnswer.mapFailed) {
+            if (fileAnswer.window)
+                fileAnswer.file.unmap(fileAnswer.window);
+            fileAnswer.windowStart = fileAnswer.position;
+            fileAnswer.windowSize = qMin(FILE_MAP_WINDOW_SIZE, fileAnswer.end - fileAnswer.position);
+            fileAnswer.window = fileAnswer.file.map(fileAnswer.windowStart, fileAnswer.windowSize);
+            fileAnswer.mapFailed = !fileAnswer.window;
+        }
+
+        if (fileAnswer.window) {
+            chunkSize = qMin(chunkSize, fileAnswer.windowStart + fileAnswer.windowSize - fileAnswer.position);
+            socket->write(reinterpret_cast<const char *>(fileAnswer.window)
+                              + (fileAnswer.position - fileAnswer.windowStart),
+                          chunkSize);
+        } else {
+            QByteArray chunk;
+            if (fileAnswer.file.seek(fileAnswer.position))
+                chunk = fileAnswer.file.read(chunkSize);
+            if (chunk.isEmpty()) {
+                //Content-Length is already sent, so the only way to tell client about error is to drop connection
+                qCWarning(proofNetworkMiscLog) << "RestServer: file" << fileAnswer.file.fileName()
+                                               << "can't be read, closing socket" << socket;
+                stopAnswerStream(info, false);
+                abortSocket(socket, info);
+                return;
+            }
+            chunkSize = chunk.size();
+            socket->write(chunk);
+        }
+        metrics->bytesSent(info.metricsRoute, chunkSize);
+        fileAnswer.position += chunkSize;
+    }
+
+    if (fileAnswer.position >= fileAnswer.end) {
+        stopAnswerStream(info, true);
+        finishRequest(socket, info);
+    }
+}
+
+void WorkerThread::sendfileFileAnswer(QTcpSocket *socket, SocketInfo &info)
+{
+#ifdef Q_OS_LINUX
+    FileAnswer &fileAnswer = *info.fileAnswer;
+    //Head is written through socket buffer, file goes after it directly to descriptor
+    if (socket->bytesToWrite())
+        socket->flush();
+    if (socket->bytesToWrite())
+        return;
+
+    const int descriptor = static_cast<int>(socket->socketDescriptor());
+    while (fileAnswer.position < fileAnswer.end) {
+        off_t offset = static_cast<off_t>(fileAnswer.position);
+        const auto count = static_cast<size_t>(qMin(FILE_MAP_WINDOW_SIZE, fileAnswer.end - fileAnswer.position));
+        const ssize_t sent = ::sendfile(descriptor, fileAnswer.file.handle(), &offset, count);
+        if (sent > 0) {
+            metrics->bytesSent(info.metricsRoute, sent);
+            fileAnswer.position += sent;
+            continue;
+        }
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (!fileAnswer.writeNotifier) {
+                fileAnswer.writeNotifier.reset(new QSocketNotifier(descriptor, QSocketNotifier::Write));
+                connect(fileAnswer.writeNotifier.data(), &QSocketNotifier::activated, this, [this, socket] {
+                    auto infoIt = sockets.find(socket);
+                    if (infoIt == sockets.end() || !infoIt->fileAnswer)
+                        return;
+                    infoIt->fileAnswer->writeNotifier->setEnabled(false);
+                    feedFileAnswer(socket, infoIt.value());
+                });
+            }
+            fileAnswer.writeNotifier->setEnabled(true);
+            return;
+        }
+        if (sent < 0 && (errno == EINVAL || errno == ENOSYS)) {
+            //File system that doesn't support sendfile(), regular path is used for the rest of file
+            fileAnswer.useSendfile = false;
+            feedFileAnswer(socket, info);
+            return;
+        }
+        //Content-Length is already sent, so the only way to tell client about error is to drop connection
+        const int error = sent < 0 ? errno : 0;
+        qCWarning(proofNetworkMiscLog) << "RestServer: file" << fileAnswer.file.fileName()
+                                       << "can't be sent, closing socket" << socket << "error:" << error;
+        stopAnswerStream(info, false);
+        abortSocket(socket, info);
+        return;
+    }
+    stopAnswerStream(info, true);
+    finishRequest(socket, info);
+#else
+    info.fileAnswer->useSendfile = false;
+    feedFileAnswer(socket, info);
+#endif
+}
+
+void WorkerThread::startBodyStreaming(QTcpSocket *socket, SocketInfo &info)
+{
+    startRequest(info);
+    info.streamingBody = true;
+    info.bodyFinished = false;
+    info.bodyConsumerBusy = false;
+    info.bodyConsumer = nullptr;
+    socket->setReadBufferSize(STREAMING_READ_BUFFER_SIZE);
+    const int requestNumber = info.handledRequests;
+    dispatchRequest(socket, info);
+
+    //Handler could already answer and even close this socket, so we need to check it again
+    auto infoIt = sockets.find(socket);
+    if (infoIt == sockets.end() || infoIt->handledRequests != requestNumber || !infoIt->streamingBody)
+        return;
+    if (qstricmp(infoIt->parser.header(HttpParser::Header::Expect).constData(), "100-continue") == 0)
+        socket->write("HTTP/1.1 100 Continue\r\n\r\n");
+}
+
+void WorkerThread::feedBodyConsumer(QTcpSocket *socket, SocketInfo &info)
+{
+    if (!info.bodyConsumer || info.bodyConsumerBusy || info.bodyFinished)
+        return;
+
+    QByteArray data = socket->readAll();
+    metrics->bytesReceived(info.metricsRoute, data.size());
+    HttpParser::Result result = info.parser.parseNextPart(data);
+    if (result == HttpParser::Result::Error) {
+        stopBodyStreaming(socket, info);
+        sendParseError(socket, info);
+        return;
+    }
+
+    QByteArray chunk = info.parser.takeBody();
+    info.bodyFinished = result == HttpParser::Result::Success;
+    if (chunk.isEmpty() && !info.bodyFinished) {
+        armIdleDeadline(info);
+        return;
+    }
+
+    info.idleDeadline = QDeadlineTimer(QDeadlineTimer::Forever);
+    info.bodyConsumerBusy = true;
+    const int requestNumber = info.handledRequests;
+    auto consumer = info.bodyConsumer;
+    consumer(chunk, info.bodyFinished).recoverValue(false).onSuccess([this, socket, requestNumber](bool proceed) {
+        auto onConsumed = [this, socket, requestNumber, proceed] {
+            onBodyChunkConsumed(socket, requestNumber, proceed);
+        };
+        QMetaObject::invokeMethod(this, onConsumed, Qt::QueuedConnection);
+    });
+}
+
+void WorkerThread::onBodyChunkConsumed(QTcpSocket *socket, int requestNumber, bool proceed)
+{
+    auto infoIt = sockets.find(socket);
+    if (infoIt == sockets.end() || infoIt->handledRequests != requestNumber || !infoIt->streamingBody)
+        return;
+    SocketInfo &info = infoIt.value();
+    info.bodyConsumerBusy = false;
+    if (!proceed) {
+        qCDebug(proofNetworkExtraLog) << "RestServer: body reading stopped by handler at socket" << socket;
+        //Rest of the body is left unread so connection can't be reused
+        info.keepAlive = false;
+        stopBodyStreaming(socket, info);
+    } else if (info.bodyFinished) {
+        stopBodyStreaming(socket, info);
+    } else {
+        feedBodyConsumer(socket, info);
+    }
+}
+
+void WorkerThread::stopBodyStreaming(QTcpSocket *socket, SocketInfo &info)
+{
+    info.bodyConsumer = nullptr;
+    info.bodyConsumerBusy = false;
+    info.streamingBody = false;
+    socket->setReadBufferSize(0);
+}
+
+void WorkerThread::sendParseError(QTcpSocket *socket, SocketInfo &info)
+{
+    qCCritical(proofNetworkMiscLog) << "RestServer: parse error:" << info.parser.error();
+    info.idleDeadline = QDeadlineTimer(QDeadlineTimer::Forever);
+    if (!info.requestInProgress)
+        startRequestMetrics(info, metrics->unmatchedRoute());
+    info.requestInProgress = true;
+    info.keepAlive = false;
+    switch (info.parser.errorHttpCode()) {
+    case 413:
+        sendAnswer(socket, "", QStringLiteral("text/plain; charset=utf-8"), QHash<QString, QString>(), 413,
+                   QStringLiteral("Payload Too Large"));
         break;
+    case 501:
+        sendAnswer(socket, "", QStringLiteral("text/plain; charset=utf-8"), QHash<QString, QString>(), 501,
+                   QStringLiteral("Not Implemented"));
+        break;
+    default:
+        sendAnswer(socket, "", QStringLiteral("text/plain; charset=utf-8"), QHash<QString, QString>(), 400,
+                   QStringLiteral("Bad Request"));
+        break;
+    }
+}
+
+void WorkerThread::startDrain()
+{
+    if (Proof::ProofObject::safeCall(this, &WorkerThread::startDrain))
+        return;
+    //Sockets with requests in progress or partially received ones are closed after their answers
+    QVector<QTcpSocket *> idle;
+    for (auto it = sockets.cbegin(); it != sockets.cend(); ++it) {
+        if (!it->requestInProgress && !it->parseStarted && !it->parser.hasPendingData() && !it->batchAnswer)
+            idle << it.key();
+    }
+    for (QTcpSocket *socket : qAsConst(idle)) {
+        qCDebug(proofNetworkExtraLog) << "Closing idle socket" << socket << "due to drain";
+        socket->disconnectFromHost();
     }
 }
 
 void WorkerThread::stop()
 {
     if (!ProofObject::safeCall(this, &WorkerThread::stop, Proof::Call::Block)) {
+        if (idleSweepTimer)
+            idleSweepTimer->stop();
         const auto allKeys = sockets.keys();
         for (QTcpSocket *socket : allKeys)
             deleteSocket(socket);
+        //Notifier should be deleted in its own thread
+        delete std::exchange(epollPoller, nullptr);
     }
 }
 
@@ -831,76 +3329,403 @@ void WorkerThread::sendAnswer(QTcpSocket *socket, const QByteArray &body, const
         return;
     }
 
-    if (sockets.contains(socket) && socket->state() == QTcpSocket::ConnectedState) {
-        QStringList additionalHeadersList;
-        additionalHeadersList << QStringLiteral("Proof-Application: %1").arg(proofApp->prettifiedApplicationName());
-        additionalHeadersList << QStringLiteral("Proof-%1-Version: %2")
-                                     .arg(proofApp->prettifiedApplicationName(), qApp->applicationVersion());
-        additionalHeadersList << QStringLiteral("Proof-%1-Framework-Version: %2")
-                                     .arg(proofApp->prettifiedApplicationName(), Proof::proofVersion());
-        for (auto it = serverD->customHeaders.cbegin(); it != serverD->customHeaders.cend(); ++it)
-            additionalHeadersList << QStringLiteral("%1: %2").arg(it.key(), it.value());
-        for (auto it = headers.cbegin(); it != headers.cend(); ++it)
-            additionalHeadersList << QStringLiteral("%1: %2").arg(it.key(), it.value());
-        QString additionalHeaders = additionalHeadersList.join(QStringLiteral("\r\n")) + "\r\n";
-
-        //TODO: Add support for keep-alive
-        socket->write(QStringLiteral("HTTP/1.1 %1 %2\r\n"
-                                     "Server: proof\r\n"
-                                     "Connection: closed\r\n"
-                                     "Content-Type: %3\r\n"
-                                     "%4"
-                                     "%5"
-                                     "\r\n")
-                          .arg(QString::number(returnCode), reason, contentType,
-                               !body.isEmpty() ? QStringLiteral("Content-Length: %1\r\n").arg(body.size()) : QString(),
-                               additionalHeaders)
-                          .toUtf8());
+    //Successful answer of cacheable method is stored and then sent as cached one, so it gets ETag and can be 304
+    auto infoIt = sockets.find(socket);
+    if (infoIt != sockets.end() && !infoIt->cacheKey.isEmpty()) {
+        const QByteArray key = std::exchange(infoIt->cacheKey, QByteArray());
+        if (returnCode == 200) {
+            sendCachedAnswer(socket, key,
+                             serverD->responseCache.insert(key, infoIt->cacheRoute, body, contentType, headers,
+                                                           infoIt->cacheGeneration));
+            return;
+        }
+    }
+
+    SocketInfo *info = answerableSocketInfo(socket, returnCode);
+    if (!info)
+        return;
+    compressAndWriteAnswer(socket, *info, body, contentType, headers, returnCode, reason);
+}
+
+void WorkerThread::compressAndWriteAnswer(QTcpSocket *socket, SocketInfo &info, const QByteArray &body,
+                                          const QString &contentType, const QHash<QString, QString> &headers,
+                                          int returnCode, const QString &reason, const QByteArray &cacheKey)
+{
+    const HttpCompression::Encoding encoding = answerEncoding(info, body, contentType, headers);
+    if (encoding == HttpCompression::Encoding::Identity) {
+        writeAnswer(socket, info, body, contentType, headers, returnCode, reason);
+        return;
+    }
+
+    const QByteArray encodingName = HttpCompression::encodingName(encoding);
+    const QHash<QString, QString> compressedHeaders = compressedAnswerHeaders(headers, encodingName);
+    const QByteArray cacheEtag = cacheKey.isEmpty() ? QByteArray()
+                                                    : headers.value(QStringLiteral("ETag")).toLatin1();
+    const int level = serverD->compressionLevel;
+    if (body.size() < COMPRESSION_OFFLOAD_SIZE) {
+        QByteArray compressed = HttpCompression::compress(body, encoding, level);
+        if (compressed.isEmpty()) {
+            writeAnswer(socket, info, body, contentType, headers, returnCode, reason);
+            return;
+        }
+        if (!cacheKey.isEmpty())
+            serverD->responseCache.insertEncodedBody(cacheKey, cacheEtag, encodingName, compressed);
+        writeAnswer(socket, info, compressed, contentType, compressedHeaders, returnCode, reason);
+        return;
+    }
+
+    info.answerPending = true;
+    const int requestNumber = info.handledRequests;
+    QPointer<WorkerThread> self(this);
+    //Body can be a view over spilled request body, so its mapping is kept until answer is written
+    QSharedPointer<QTemporaryFile> spilledBody = info.parser.spilledBody();
+    tasks::run([self, socket, requestNumber, body, encoding, level, contentType, headers, compressedHeaders,
+                returnCode, reason, spilledBody, cacheKey, cacheEtag, encodingName] {
+        const QByteArray compressed = HttpCompression::compress(body, encoding, level);
+        const bool isCompressed = !compressed.isEmpty();
+        const QByteArray answerBody = isCompressed ? compressed : body;
+        const QHash<QString, QString> answerHeaders = isCompressed ? compressedHeaders : headers;
+        if (!self)
+            return;
+        QMetaObject::invokeMethod(self,
+                                  [self, socket, requestNumber, answerBody, contentType, answerHeaders, returnCode,
+                                   reason, spilledBody, isCompressed, cacheKey, cacheEtag, encodingName] {
+                                      if (isCompressed && !cacheKey.isEmpty()) {
+                                          self->serverD->responseCache.insertEncodedBody(cacheKey, cacheEtag,
+                                                                                         encodingName, answerBody);
+                                      }
+                                      self->onAnswerCompressed(socket, requestNumber, answerBody, contentType,
+                                                               answerHeaders, returnCode, reason);
+                                  },
+                                  Qt::QueuedConnection);
+    });
+}
+
+Proof::HttpCompression::Encoding WorkerThread::answerEncoding(const SocketInfo &info, const QByteArray &body,
+                                                              const QString &contentType,
+                                                              const QHash<QString, QString> &headers) const
+{
+    if (serverD->compressionLevel <= 0 || body.isEmpty() || body.size() < serverD->compressionThreshold
+        || headers.contains(QStringLiteral("Content-Encoding"))
+        || !HttpCompression::isCompressible(contentType.toLatin1())) {
+        return HttpCompression::Encoding::Identity;
+    }
+    return HttpCompression::negotiate(info.parser.header(HttpParser::Header::AcceptEncoding));
+}
 
+void WorkerThread::writeAnswer(QTcpSocket *socket, SocketInfo &info, const QByteArray &body, const QString &contentType,
+                               const QHash<QString, QString> &headers, int returnCode, const QString &reason)
+{
+    const bool singleWrite = body.size() <= SINGLE_WRITE_BODY_LIMIT;
+    QByteArray answer = answerHead(info, contentType, headers, returnCode, reason,
+                                   "Content-Length: " + QByteArray::number(body.size()),
+                                   singleWrite ? body.size() : 0);
+    metrics->bytesSent(info.metricsRoute, answer.size() + body.size());
+    if (singleWrite) {
+        answer.append(body);
+        socket->write(answer);
+    } else {
+        socket->write(answer);
         socket->write(body);
-        connect(socket, &QTcpSocket::bytesWritten, this, [socket] {
-            if (socket->bytesToWrite() == 0)
-                socket->disconnectFromHost();
+    }
+    finishRequest(socket, info);
+}
+
+void WorkerThread::onAnswerCompressed(QTcpSocket *socket, int requestNumber, const QByteArray &body,
+                                      const QString &contentType, const QHash<QString, QString> &headers,
+                                      int returnCode, const QString &reason)
+{
+    auto infoIt = sockets.find(socket);
+    if (infoIt == sockets.end() || infoIt->handledRequests != requestNumber || !infoIt->answerPending
+        || socket->state() != QTcpSocket::ConnectedState) {
+        return;
+    }
+    infoIt->answerPending = false;
+    writeAnswer(socket, infoIt.value(), body, contentType, headers, returnCode, reason);
+}
+
+void WorkerThread::awaitAnswer(QTcpSocket *socket, const Future<RestResponse> &response,
+                               const std::function<void()> &cancel)
+{
+    if (Proof::ProofObject::safeCall(this, &WorkerThread::awaitAnswer, socket, response, cancel))
+        return;
+
+    auto infoIt = sockets.find(socket);
+    if (infoIt == sockets.end() || !infoIt->requestInProgress || infoIt->cancelAsyncAnswer) {
+        if (cancel)
+            cancel();
+        return;
+    }
+    const int requestNumber = infoIt->handledRequests;
+    if (response.isSucceeded()) {
+        onAsyncAnswer(socket, requestNumber, response.result());
+        return;
+    }
+    if (response.isFailed()) {
+        onAsyncAnswerFailed(socket, requestNumber, response.failureReason());
+        return;
+    }
+
+    infoIt->cancelAsyncAnswer = cancel ? cancel : [] {};
+    QPointer<WorkerThread> self(this);
+    //Spilled body is mapped while method works with it even if socket is closed in the meantime
+    QSharedPointer<QTemporaryFile> spilledBody = infoIt->parser.spilledBody();
+    response
+        .onSuccess([self, socket, requestNumber, spilledBody](const RestResponse &result) {
+            if (!self)
+                return;
+            QMetaObject::invokeMethod(self,
+                                      [self, socket, requestNumber, result] {
+                                          self->onAsyncAnswer(socket, requestNumber, result);
+                                      },
+                                      Qt::QueuedConnection);
+        })
+        .onFailure([self, socket, requestNumber](const Failure &failure) {
+            if (!self)
+                return;
+            QMetaObject::invokeMethod(self,
+                                      [self, socket, requestNumber, failure] {
+                                          self->onAsyncAnswerFailed(socket, requestNumber, failure);
+                                      },
+                                      Qt::QueuedConnection);
         });
+}
+
+void WorkerThread::onAsyncAnswer(QTcpSocket *socket, int requestNumber, const RestResponse &response)
+{
+    auto infoIt = sockets.find(socket);
+    if (infoIt == sockets.end() || infoIt->handledRequests != requestNumber || !infoIt->requestInProgress)
+        return;
+    infoIt->cancelAsyncAnswer = nullptr;
+    sendAnswer(socket, response.body, response.contentType, response.headers, response.returnCode, response.reason);
+}
+
+void WorkerThread::onAsyncAnswerFailed(QTcpSocket *socket, int requestNumber, const Failure &failure)
+{
+    auto infoIt = sockets.find(socket);
+    if (infoIt == sockets.end() || infoIt->handledRequests != requestNumber || !infoIt->requestInProgress)
+        return;
+    infoIt->cancelAsyncAnswer = nullptr;
+    qCWarning(proofNetworkMiscLog) << "RestServer: answer for socket" << socket << "failed with" << failure.message
+                                   << failure.data;
+    sendAnswer(socket, "", QStringLiteral("text/plain; charset=utf-8"), QHash<QString, QString>(), 500,
+               QStringLiteral("Internal Server Error"));
+}
+
+void WorkerThread::startChunkedAnswer(QTcpSocket *socket, const QString &contentType,
+                                      const QHash<QString, QString> &headers, int returnCode, const QString &reason)
+{
+    if (Proof::ProofObject::safeCall(this, &WorkerThread::startChunkedAnswer, socket, contentType, headers,
+                                     returnCode, reason)) {
+        return;
+    }
+
+    SocketInfo *info = answerableSocketInfo(socket, returnCode);
+    if (!info)
+        return;
+    //HTTP/1.0 clients don't know about chunked encoding, body is delimited by connection close for them
+    QByteArray head;
+    if (info->parser.isHttp11()) {
+        info->answerStream = AnswerStream::Chunked;
+        head = answerHead(*info, contentType, headers, returnCode, reason, "Transfer-Encoding: chunked");
+    } else {
+        info->answerStream = AnswerStream::UntilClose;
+        info->keepAlive = false;
+        head = answerHead(*info, contentType, headers, returnCode, reason, QByteArray());
     }
+    metrics->bytesSent(info->metricsRoute, head.size());
+    socket->write(head);
 }
 
-MethodNode::MethodNode()
-{}
+void WorkerThread::writeAnswerChunk(QTcpSocket *socket, const QByteArray &chunk, const Promise<bool> &promise)
+{
+    if (Proof::ProofObject::safeCall(this, &WorkerThread::writeAnswerChunk, socket, chunk, promise))
+        return;
+
+    auto infoIt = sockets.find(socket);
+    if (infoIt == sockets.end() || infoIt->answerStream == AnswerStream::None
+        || infoIt->answerStream == AnswerStream::File || socket->state() != QTcpSocket::ConnectedState) {
+        qCWarning(proofNetworkMiscLog) << "RestServer: answer chunk for socket" << socket
+                                       << "skipped, chunked answer is not started";
+        promise.success(false);
+        return;
+    }
+    SocketInfo &info = infoIt.value();
+    if (!chunk.isEmpty()) {
+        if (info.answerStream == AnswerStream::Chunked) {
+            const QByteArray chunkSize = QByteArray::number(chunk.size(), 16) + "\r\n";
+            socket->write(chunkSize);
+            socket->write(chunk);
+            socket->write("\r\n");
+            metrics->bytesSent(info.metricsRoute, chunkSize.size() + chunk.size() + 2);
+        } else {
+            socket->write(chunk);
+            metrics->bytesSent(info.metricsRoute, chunk.size());
+        }
+    }
+    if (socket->bytesToWrite() < ANSWER_STREAM_HIGH_WATERMARK)
+        promise.success(true);
+    else
+        info.answerWriteWaiters << promise;
+}
 
-bool MethodNode::contains(const QString &name) const
+void WorkerThread::finishChunkedAnswer(QTcpSocket *socket)
 {
-    return m_nodes.contains(name);
+    if (Proof::ProofObject::safeCall(this, &WorkerThread::finishChunkedAnswer, socket))
+        return;
+
+    auto infoIt = sockets.find(socket);
+    if (infoIt == sockets.end() || infoIt->answerStream == AnswerStream::None
+        || infoIt->answerStream == AnswerStream::File) {
+        qCWarning(proofNetworkMiscLog) << "RestServer: chunked answer finish for socket" << socket
+                                       << "skipped, chunked answer is not started";
+        return;
+    }
+    SocketInfo &info = infoIt.value();
+    if (info.answerStream == AnswerStream::Chunked) {
+        socket->write("0\r\n\r\n");
+        metrics->bytesSent(info.metricsRoute, 5);
+    }
+    stopAnswerStream(info, true);
+    finishRequest(socket, info);
 }
 
-void MethodNode::clear()
+void WorkerThread::onAnswerBytesWritten(QTcpSocket *socket)
 {
-    m_nodes.clear();
+    auto infoIt = sockets.find(socket);
+    if (infoIt == sockets.end())
+        return;
+    if (infoIt->pendingWriteRoute >= 0 && socket->bytesToWrite() == 0) {
+        metrics->addDuration(infoIt->pendingWriteRoute, RestServerMetrics::Phase::Write,
+                             infoIt->writeTimer.nsecsElapsed() / 1000);
+        infoIt->pendingWriteRoute = -1;
+    }
+    if (infoIt->answerStream == AnswerStream::File && socket->bytesToWrite() <= ANSWER_STREAM_LOW_WATERMARK) {
+        feedFileAnswer(socket, infoIt.value());
+        return;
+    }
+    if (infoIt->answerWriteWaiters.isEmpty() || socket->bytesToWrite() > ANSWER_STREAM_LOW_WATERMARK)
+        return;
+    const auto waiters = infoIt->answerWriteWaiters;
+    infoIt->answerWriteWaiters.clear();
+    for (const auto &waiter : waiters)
+        waiter.success(true);
 }
 
-MethodNode::operator QString() const
+void WorkerThread::stopAnswerStream(SocketInfo &info, bool canProceed)
 {
-    return m_value;
+    info.answerStream = AnswerStream::None;
+    info.fileAnswer.reset();
+    const auto waiters = info.answerWriteWaiters;
+    info.answerWriteWaiters.clear();
+    for (const auto &waiter : waiters)
+        waiter.success(canProceed);
 }
 
-MethodNode &MethodNode::operator[](const QString &name)
+SocketInfo *WorkerThread::answerableSocketInfo(QTcpSocket *socket, int returnCode)
 {
-    return m_nodes[name];
+    auto infoIt = sockets.find(socket);
+    if (infoIt == sockets.end() || socket->state() != QTcpSocket::ConnectedState)
+        return nullptr;
+    SocketInfo &info = infoIt.value();
+    if (!info.requestInProgress || info.answerPending || info.answerStream != AnswerStream::None) {
+        qCWarning(proofNetworkMiscLog) << "RestServer: answer" << returnCode << "for socket" << socket
+                                       << "skipped, request is already answered";
+        return nullptr;
+    }
+    if (info.deadlineTimer)
+        info.deadlineTimer->stop();
+    if (info.streamingBody) {
+        //Unread body is still in socket and can't be distinguished from next request
+        if (!info.bodyFinished)
+            info.keepAlive = false;
+        stopBodyStreaming(socket, info);
+    }
+    if (info.metricsRoute >= 0) {
+        metrics->answerStarted(info.metricsRoute, returnCode);
+        metrics->addDuration(info.metricsRoute, RestServerMetrics::Phase::Dispatch,
+                             info.phaseTimer.nsecsElapsed() / 1000);
+        info.phaseTimer.start();
+    }
+    return &info;
 }
 
-void MethodNode::setValue(const QString &value)
+QByteArray WorkerThread::answerHead(const SocketInfo &info, const QString &contentType,
+                                    const QHash<QString, QString> &headers, int returnCode, const QString &reason,
+                                    const QByteArray &framingHeader, int reservedBodySize) const
 {
-    m_value = value;
+    const QByteArray staticHeaders = serverD->staticAnswerHeaders();
+    const QByteArray status = statusLine(returnCode, reason);
+    const QByteArray connection = info.keepAlive ? QByteArrayLiteral("Connection: keep-alive\r\n")
+                                                 : QByteArrayLiteral("Connection: close\r\n");
+    const QByteArray type = contentType.toUtf8();
+
+    QByteArray result;
+    result.reserve(status.size() + connection.size() + type.size() + framingHeader.size() + staticHeaders.size()
+                   + 64 * (headers.count() + 1) + reservedBodySize);
+    result.append(status);
+    result.append("Server: proof\r\n");
+    result.append(connection);
+    result.append("Content-Type: ").append(type).append("\r\n");
+    if (!framingHeader.isEmpty())
+        result.append(framingHeader).append("\r\n");
+    result.append(staticHeaders);
+    for (auto it = headers.cbegin(); it != headers.cend(); ++it)
+        result.append(it.key().toUtf8()).append(": ").append(it.value().toUtf8()).append("\r\n");
+    result.append("\r\n");
+    return result;
 }
 
-QString MethodNode::tag() const
+void WorkerThread::finishRequest(QTcpSocket *socket, SocketInfo &info)
 {
-    return m_tag;
+    info.requestInProgress = false;
+    if (info.deadlineTimer)
+        info.deadlineTimer->stop();
+    if (info.metricsRoute >= 0) {
+        //Write phase lasts until answer leaves socket buffer
+        info.pendingWriteRoute = info.metricsRoute;
+        info.writeTimer = info.phaseTimer;
+        finishRequestMetrics(info);
+        onAnswerBytesWritten(socket);
+    }
+
+    if (info.batchAnswer) {
+        std::exchange(info.batchAnswer, nullptr)(static_cast<BatchItemSocket *>(socket)->takeAnswer());
+        //Caller can still use socket, so it is deleted later
+        QMetaObject::invokeMethod(this, [this, socket] { deleteSocket(socket); }, Qt::QueuedConnection);
+        return;
+    }
+
+    if (info.keepAlive) {
+        info.parser.reset();
+        const bool hasPendingRequest = info.parser.hasPendingData() || socket->bytesAvailable() > 0;
+        //Requests pipelined before drain are still answered
+        if (hasPendingRequest || !serverD->draining) {
+            armIdleDeadline(info);
+            if (hasPendingRequest)
+                QMetaObject::invokeMethod(this, [this, socket] { onReadyRead(socket); }, Qt::QueuedConnection);
+            return;
+        }
+    }
+    disconnect(info.readyReadConnection);
+    info.readingStopped = true;
+    if (socket->bytesToWrite() == 0) {
+        socket->disconnectFromHost();
+        return;
+    }
+    connect(socket, &QTcpSocket::bytesWritten, this, [socket] {
+        if (socket->bytesToWrite() == 0)
+            socket->disconnectFromHost();
+    });
 }
 
-void MethodNode::setTag(const QString &tag)
+void WorkerThread::abortSocket(QTcpSocket *socket, SocketInfo &info)
 {
-    m_tag = tag;
+    //QAbstractSocket::abort() is not virtual and would send pending data of epoll socket before closing it
+    if (info.epollSocket)
+        info.epollSocket->abort();
+    else
+        socket->abort();
 }
 
 #include "abstractrestserver.moc"
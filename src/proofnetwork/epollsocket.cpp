@@ -0,0 +1,409 @@
+/* Copyright 2018, OpenSoft Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright notice, this list of
+ * conditions and the following disclaimer in the documentation and/or other materials provided
+ * with the distribution.
+ *     * Neither the name of OpenSoft Inc. nor the names of its contributors may be used to endorse
+ * or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include "proofnetwork/epollsocket_p.h"
+
+#include <QSocketNotifier>
+
+#ifdef Q_OS_LINUX
+#    include <sys/epoll.h>
+#    include <sys/socket.h>
+#    include <cerrno>
+#    include <fcntl.h>
+#    include <unistd.h>
+#endif
+
+#include <cstring>
+#include <utility>
+
+//Max number of ready connections handled by one epoll_wait()
+static constexpr int EPOLL_EVENTS_BATCH_SIZE = 256;
+static constexpr int EPOLL_READ_CHUNK_SIZE = 64 * 1024;
+//Consumed part of buffer is dropped when it becomes bigger than this
+static constexpr int EPOLL_BUFFER_COMPACT_SIZE = 64 * 1024;
+
+using namespace Proof;
+
+EpollPoller::EpollPoller(QObject *parent) : QObject(parent)
+{
+#ifdef Q_OS_LINUX
+    m_descriptor = epoll_create1(EPOLL_CLOEXEC);
+    if (m_descriptor < 0) {
+        qCWarning(proofNetworkMiscLog) << "EpollPoller: can't create epoll descriptor:" << strerror(errno);
+        return;
+    }
+    m_notifier = new QSocketNotifier(m_descriptor, QSocketNotifier::Read, this);
+    connect(m_notifier, &QSocketNotifier::activated, this, [this] { processEvents(); });
+#endif
+}
+
+EpollPoller::~EpollPoller()
+{
+#ifdef Q_OS_LINUX
+    delete m_notifier;
+    if (m_descriptor >= 0)
+        ::close(m_descriptor);
+#endif
+}
+
+bool EpollPoller::isValid() const
+{
+    return m_descriptor >= 0;
+}
+
+void EpollPoller::setReadyReadHandler(const std::function<void(EpollSocket *)> &handler)
+{
+    m_readyReadHandler = handler;
+}
+
+bool EpollPoller::watch(EpollSocket *socket, bool read, bool write, bool add)
+{
+#ifdef Q_OS_LINUX
+    epoll_event event = {};
+    //Peer shutdown is watched only while reading, otherwise it would be reported again and again
+    if (read)
+        event.events |= EPOLLIN | EPOLLRDHUP;
+    if (write)
+        event.events |= EPOLLOUT;
+    event.data.ptr = socket;
+    return epoll_ctl(m_descriptor, add ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, socket->m_descriptor, &event) == 0;
+#else
+    Q_UNUSED(socket)
+    Q_UNUSED(read)
+    Q_UNUSED(write)
+    Q_UNUSED(add)
+    return false;
+#endif
+}
+
+void EpollPoller::unwatch(EpollSocket *socket)
+{
+#ifdef Q_OS_LINUX
+    epoll_ctl(m_descriptor, EPOLL_CTL_DEL, socket->m_descriptor, nullptr);
+#else
+    Q_UNUSED(socket)
+#endif
+}
+
+void EpollPoller::processEvents()
+{
+#ifdef Q_OS_LINUX
+    //Sockets are deleted only by queued calls, so pointers from one batch stay valid while it is handled
+    epoll_event events[EPOLL_EVENTS_BATCH_SIZE];
+    int count = 0;
+    do {
+        count = epoll_wait(m_descriptor, events, EPOLL_EVENTS_BATCH_SIZE, 0);
+        if (count < 0 && errno == EINTR)
+            continue;
+        for (int i = 0; i < count; ++i) {
+            auto socket = static_cast<EpollSocket *>(events[i].data.ptr);
+            const quint32 flags = events[i].events;
+            //Socket can be closed by previous event of this batch
+            if (socket->m_descriptor < 0)
+                continue;
+            if (flags & EPOLLERR) {
+                int errorCode = 0;
+                socklen_t length = sizeof(errorCode);
+                getsockopt(socket->m_descriptor, SOL_SOCKET, SO_ERROR, &errorCode, &length);
+                socket->onFailed(errorCode ? errorCode : ECONNRESET);
+                continue;
+            }
+            if (flags & EPOLLOUT)
+                socket->onWritable();
+            if (socket->m_descriptor < 0)
+                continue;
+            if (socket->m_readWatched && (flags & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)))
+                socket->onReadable();
+            else if (flags & EPOLLHUP)
+                socket->closeDescriptor(true);
+        }
+    } while (count == EPOLL_EVENTS_BATCH_SIZE || (count < 0 && errno == EINTR));
+#endif
+}
+
+EpollSocket::EpollSocket(EpollPoller *poller) : m_poller(poller)
+{}
+
+EpollSocket::~EpollSocket()
+{
+    closeDescriptor(false);
+    setSocketState(QAbstractSocket::UnconnectedState);
+}
+
+bool EpollSocket::setDescriptor(qintptr descriptor)
+{
+#ifdef Q_OS_LINUX
+    m_descriptor = static_cast<int>(descriptor);
+    if (!m_poller->isValid()) {
+        setErrorString(QStringLiteral("Epoll poller is not valid"));
+        ::close(std::exchange(m_descriptor, -1));
+        return false;
+    }
+    const int flags = fcntl(m_descriptor, F_GETFL);
+    if (flags < 0 || fcntl(m_descriptor, F_SETFL, flags | O_NONBLOCK) < 0
+        || !m_poller->watch(this, true, false, true)) {
+        setErrorString(QString::fromLocal8Bit(strerror(errno)));
+        ::close(std::exchange(m_descriptor, -1));
+        return false;
+    }
+    m_readWatched = true;
+    setSocketState(QAbstractSocket::ConnectedState);
+    setOpenMode(QIODevice::ReadWrite | QIODevice::Unbuffered);
+    return true;
+#else
+    Q_UNUSED(descriptor)
+    setErrorString(QStringLiteral("Epoll is not supported on this platform"));
+    return false;
+#endif
+}
+
+qint64 EpollSocket::bytesAvailable() const
+{
+    return unreadSize() + QIODevice::bytesAvailable();
+}
+
+qint64 EpollSocket::bytesToWrite() const
+{
+    return m_writeBuffer.size() - m_writePosition;
+}
+
+void EpollSocket::disconnectFromHost()
+{
+    if (m_descriptor < 0)
+        return;
+    if (bytesToWrite() > 0) {
+        //Socket is closed when everything is sent, incoming data is not needed anymore
+        m_closing = true;
+        setSocketState(QAbstractSocket::ClosingState);
+        updateWatch();
+        return;
+    }
+    closeDescriptor(true);
+}
+
+void EpollSocket::close()
+{
+    disconnectFromHost();
+    QIODevice::close();
+}
+
+void EpollSocket::abort()
+{
+    //Pending data is dropped together with descriptor
+    closeDescriptor(true);
+    QIODevice::close();
+}
+
+qint64 EpollSocket::readData(char *data, qint64 maxSize)
+{
+    const qint64 size = qMax<qint64>(0, qMin(maxSize, unreadSize()));
+    if (size > 0) {
+        memcpy(data, m_readBuffer.constData() + m_readPosition, static_cast<size_t>(size));
+        m_readPosition += static_cast<int>(size);
+        if (m_readPosition == m_readBuffer.size()) {
+            m_readBuffer.clear();
+            m_readPosition = 0;
+        }
+    }
+    //Reading could be paused by read buffer limit, which could also be changed since then
+    if (!m_readWatched)
+        updateWatch();
+    return size;
+}
+
+qint64 EpollSocket::writeData(const char *data, qint64 size)
+{
+    if (m_descriptor < 0 || m_closing)
+        return -1;
+    m_writeBuffer.append(data, static_cast<int>(size));
+    //Kernel buffer is most likely not full if nothing is waiting, so it is written right away without epoll round
+    if (!m_writeWatched && !sendPending())
+        return -1;
+    return size;
+}
+
+void EpollSocket::onReadable()
+{
+#ifdef Q_OS_LINUX
+    bool received = false;
+    bool finished = false;
+    int errorCode = 0;
+    while (!m_closing) {
+        const qint64 limit = readBufferSize();
+        const qint64 allowed = limit > 0 ? limit - unreadSize() : EPOLL_READ_CHUNK_SIZE;
+        if (allowed <= 0)
+            break;
+        if (m_readPosition > EPOLL_BUFFER_COMPACT_SIZE) {
+            m_readBuffer.remove(0, m_readPosition);
+            m_readPosition = 0;
+        }
+        const int chunkSize = static_cast<int>(qMin<qint64>(allowed, EPOLL_READ_CHUNK_SIZE));
+        const int oldSize = m_readBuffer.size();
+        m_readBuffer.resize(oldSize + chunkSize);
+        const ssize_t result = ::recv(m_descriptor, m_readBuffer.data() + oldSize, static_cast<size_t>(chunkSize), 0);
+        m_readBuffer.resize(oldSize + static_cast<int>(qMax<ssize_t>(result, 0)));
+        if (result > 0) {
+            received = true;
+            if (result < chunkSize)
+                break;
+        } else if (result == 0) {
+            finished = true;
+            break;
+        } else if (errno != EINTR) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                errorCode = errno;
+            break;
+        }
+    }
+    if (received) {
+        if (m_poller->m_readyReadHandler)
+            m_poller->m_readyReadHandler(this);
+        else
+            emit readyRead();
+    }
+    if (errorCode) {
+        onFailed(errorCode);
+    } else if (finished) {
+        //Data that is already received can still be read after disconnect
+        closeDescriptor(true);
+    } else {
+        updateWatch();
+    }
+#endif
+}
+
+void EpollSocket::onWritable()
+{
+    if (sendPending() && m_closing && bytesToWrite() == 0)
+        closeDescriptor(true);
+}
+
+void EpollSocket::onFailed(int errorCode)
+{
+    if (m_descriptor < 0)
+        return;
+#ifdef Q_OS_LINUX
+    const bool isReset = errorCode == ECONNRESET || errorCode == EPIPE;
+    setSocketError(isReset ? QAbstractSocket::RemoteHostClosedError : QAbstractSocket::NetworkError);
+    setErrorString(QString::fromLocal8Bit(strerror(errorCode)));
+    m_writeBuffer.clear();
+    m_writePosition = 0;
+    emit error(socketError());
+#else
+    Q_UNUSED(errorCode)
+#endif
+    closeDescriptor(true);
+}
+
+bool EpollSocket::sendPending()
+{
+#ifdef Q_OS_LINUX
+    qint64 sent = 0;
+    while (m_writePosition < m_writeBuffer.size()) {
+        const ssize_t result = ::send(m_descriptor, m_writeBuffer.constData() + m_writePosition,
+                                      static_cast<size_t>(m_writeBuffer.size() - m_writePosition), MSG_NOSIGNAL);
+        if (result > 0) {
+            m_writePosition += static_cast<int>(result);
+            sent += result;
+        } else if (result < 0 && errno == EINTR) {
+            continue;
+        } else if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            //Error is reported from event loop, socket can be used by caller after this call
+            const int errorCode = result < 0 ? errno : EPIPE;
+            QMetaObject::invokeMethod(this, [this, errorCode] { onFailed(errorCode); }, Qt::QueuedConnection);
+            m_closing = true;
+            return false;
+        }
+    }
+    if (m_writePosition == m_writeBuffer.size()) {
+        m_writeBuffer.clear();
+        m_writePosition = 0;
+    } else if (m_writePosition > EPOLL_BUFFER_COMPACT_SIZE) {
+        m_writeBuffer.remove(0, m_writePosition);
+        m_writePosition = 0;
+    }
+    updateWatch();
+    if (sent > 0)
+        scheduleBytesWritten(sent);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void EpollSocket::updateWatch()
+{
+    if (m_descriptor < 0)
+        return;
+    const qint64 limit = readBufferSize();
+    const bool read = !m_closing && (limit <= 0 || unreadSize() < limit);
+    const bool write = bytesToWrite() > 0;
+    if (read == m_readWatched && write == m_writeWatched)
+        return;
+    m_readWatched = read;
+    m_writeWatched = write;
+    m_poller->watch(this, read, write, false);
+}
+
+void EpollSocket::scheduleBytesWritten(qint64 bytes)
+{
+    //Emitted from event loop as QAbstractSocket does, so slots can write to socket again
+    const bool scheduled = m_pendingBytesWritten > 0;
+    m_pendingBytesWritten += bytes;
+    if (scheduled)
+        return;
+    QMetaObject::invokeMethod(this,
+                              [this] {
+                                  const qint64 written = std::exchange(m_pendingBytesWritten, 0);
+                                  if (written > 0)
+                                      emit bytesWritten(written);
+                              },
+                              Qt::QueuedConnection);
+}
+
+void EpollSocket::closeDescriptor(bool notify)
+{
+#ifdef Q_OS_LINUX
+    if (m_descriptor < 0)
+        return;
+    m_poller->unwatch(this);
+    ::close(std::exchange(m_descriptor, -1));
+    m_readWatched = false;
+    m_writeWatched = false;
+    m_writeBuffer.clear();
+    m_writePosition = 0;
+    setSocketState(QAbstractSocket::UnconnectedState);
+    if (notify)
+        emit disconnected();
+#else
+    Q_UNUSED(notify)
+#endif
+}
+
+qint64 EpollSocket::unreadSize() const
+{
+    return m_readBuffer.size() - m_readPosition;
+}
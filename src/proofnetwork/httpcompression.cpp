@@ -0,0 +1,116 @@
+/* Copyright 2018, OpenSoft Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright notice, this list of
+ * conditions and the following disclaimer in the documentation and/or other materials provided
+ * with the distribution.
+ *     * Neither the name of OpenSoft Inc. nor the names of its contributors may be used to endorse
+ * or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include "proofnetwork/httpcompression_p.h"
+
+#include <QList>
+
+#include <zlib.h>
+
+using namespace Proof;
+
+HttpCompression::Encoding HttpCompression::negotiate(const QByteArray &acceptEncoding)
+{
+    double gzipQuality = -1.0;
+    double deflateQuality = -1.0;
+    double anyQuality = -1.0;
+    const QList<QByteArray> codings = acceptEncoding.split(',');
+    for (const QByteArray &coding : codings) {
+        const int paramsStart = coding.indexOf(';');
+        const QByteArray name = coding.left(paramsStart).trimmed().toLower();
+        double quality = 1.0;
+        if (paramsStart >= 0) {
+            const QList<QByteArray> params = coding.mid(paramsStart + 1).split(';');
+            for (const QByteArray &param : params) {
+                const QByteArray trimmed = param.trimmed();
+                if (trimmed.size() < 2 || qstrnicmp(trimmed.constData(), "q=", 2))
+                    continue;
+                bool ok = false;
+                quality = trimmed.mid(2).toDouble(&ok);
+                if (!ok)
+                    quality = 0.0;
+            }
+        }
+        if (name == "gzip" || name == "x-gzip")
+            gzipQuality = quality;
+        else if (name == "deflate")
+            deflateQuality = quality;
+        else if (name == "*")
+            anyQuality = quality;
+    }
+    if (gzipQuality < 0.0)
+        gzipQuality = anyQuality;
+    if (deflateQuality < 0.0)
+        deflateQuality = anyQuality;
+    if (gzipQuality <= 0.0 && deflateQuality <= 0.0)
+        return Encoding::Identity;
+    return gzipQuality >= deflateQuality ? Encoding::Gzip : Encoding::Deflate;
+}
+
+bool HttpCompression::isCompressible(const QByteArray &contentType)
+{
+    const QByteArray type = contentType.trimmed().toLower();
+    if (type.startsWith("image/") || type.startsWith("video/") || type.startsWith("audio/"))
+        return type.startsWith("image/svg");
+    return !type.contains("zip") && !type.contains("compressed") && !type.contains("octet-stream");
+}
+
+QByteArray HttpCompression::encodingName(Encoding encoding)
+{
+    switch (encoding) {
+    case Encoding::Gzip:
+        return QByteArrayLiteral("gzip");
+    case Encoding::Deflate:
+        return QByteArrayLiteral("deflate");
+    case Encoding::Identity:
+        break;
+    }
+    return QByteArrayLiteral("identity");
+}
+
+QByteArray HttpCompression::compress(const QByteArray &data, Encoding encoding, int level)
+{
+    if (encoding == Encoding::Identity)
+        return data;
+
+    z_stream stream = {};
+    //gzip wrapper is requested by adding 16 to window bits, deflate coding in HTTP is zlib format
+    const int windowBits = encoding == Encoding::Gzip ? 15 + 16 : 15;
+    if (deflateInit2(&stream, qBound(1, level, 9), Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return QByteArray();
+
+    QByteArray result;
+    result.resize(static_cast<int>(deflateBound(&stream, static_cast<uLong>(data.size()))));
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.constData()));
+    stream.avail_in = static_cast<uInt>(data.size());
+    stream.next_out = reinterpret_cast<Bytef *>(result.data());
+    stream.avail_out = static_cast<uInt>(result.size());
+    const int status = deflate(&stream, Z_FINISH);
+    const auto compressedSize = static_cast<int>(stream.total_out);
+    deflateEnd(&stream);
+    if (status != Z_STREAM_END)
+        return QByteArray();
+    result.resize(compressedSize);
+    return result;
+}
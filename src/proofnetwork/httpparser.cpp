@@ -24,44 +24,236 @@
  */
 #include "proofnetwork/httpparser_p.h"
 
-#include <QObject>
-#include <QRegExp>
+#include <QDir>
+#include <QTemporaryFile>
+
+#include <cstring>
+#include <limits>
 
 using namespace Proof;
 
-const QRegExp HttpParser::FIRST_LINE_REG_EXP{"(.*) (.*) HTTP/1[.][01]\r\n"};
-const QRegExp HttpParser::HEADER_REG_EXP{"((.*): (.*))\r\n"};
+static constexpr int MAX_HEAD_SIZE = 64 * 1024;
+
+namespace {
+struct KnownHeaderName
+{
+    const char *name;
+    int length;
+};
+
+//Order must be the same as in HttpParser::Header
+const KnownHeaderName KNOWN_HEADERS[] = {{"content-length", 14},
+                                         {"connection", 10},
+                                         {"authorization", 13},
+                                         {"transfer-encoding", 17},
+                                         {"expect", 6},
+                                         {"accept-encoding", 15},
+                                         {"if-none-match", 13},
+                                         {"if-modified-since", 17},
+                                         {"range", 5},
+                                         {"if-range", 8},
+                                         {"x-request-timeout", 17}};
+static_assert(sizeof(KNOWN_HEADERS) / sizeof(KNOWN_HEADERS[0]) == static_cast<size_t>(HttpParser::Header::HeadersCount),
+              "All known headers should have their names");
+
+bool isTokenChar(char c)
+{
+    return c > ' ' && c < 127 && !std::strchr("()<>@,;:\\\"/[]?={}", c);
+}
+
+bool isWhitespace(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+int hexDigit(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+bool equalsIgnoreCase(const char *data, int length, const char *other, int otherLength)
+{
+    return length == otherLength && !qstrnicmp(data, other, static_cast<uint>(length));
+}
+} // namespace
 
 HttpParser::HttpParser()
-{}
+{
+    m_knownHeaders.fill(-1);
+    setMaxBodySize(0);
+}
 
-HttpParser::Result HttpParser::parseNextPart(QByteArray data) // clazy:exclude=function-args-by-ref
+HttpParser::Result HttpParser::parseNextPart(const QByteArray &data)
 {
+    //Chunks are copied to body, so everything before current line can be dropped
+    if (m_chunked && m_lineStart > 0) {
+        m_buffer.remove(0, m_lineStart);
+        m_pos -= m_lineStart;
+        m_lineStart = 0;
+    }
+    m_buffer.append(data);
     Result result;
     do
-        result = (this->*m_state)(data);
-    while (result == Result::NeedMore && !data.isEmpty());
+        result = (this->*m_state)();
+    while (result == Result::NeedMore && m_pos < m_buffer.size());
+    if (result == Result::Success && m_spillFile && !m_spilledData)
+        result = mapSpilledBody();
     return result;
 }
 
+void HttpParser::setMaxBodySize(qlonglong size)
+{
+    const qlonglong limit = std::numeric_limits<int>::max();
+    m_maxBodySize = (size <= 0 || size > limit) ? limit : size;
+}
+
+void HttpParser::setBodySpillThreshold(qlonglong size)
+{
+    m_spillThreshold = qMax(0ll, size);
+}
+
+void HttpParser::reset()
+{
+    //Everything after finished request belongs to next pipelined one
+    if (m_head.isEmpty() || m_pos >= m_buffer.size())
+        m_buffer.clear();
+    else
+        m_buffer = m_buffer.mid(m_pos);
+    m_head.clear();
+    m_pos = 0;
+    m_lineStart = 0;
+    m_state = &HttpParser::initialState;
+    m_contentLength = 0;
+    m_bodyTaken = 0;
+    m_chunkRemaining = 0;
+    m_chunked = false;
+    m_body.clear();
+    dropSpilledBody();
+    m_trailers.clear();
+    m_method = Span();
+    m_uri = Span();
+    m_headers.clear();
+    m_knownHeaders.fill(-1);
+    m_error.clear();
+    m_errorHttpCode = 400;
+    m_http11 = false;
+    m_connectionClose = false;
+    m_connectionKeepAlive = false;
+}
+
+bool HttpParser::hasPendingData() const
+{
+    return !m_buffer.isEmpty();
+}
+
 QString HttpParser::method() const
 {
-    return m_method;
+    return QString::fromLatin1(rawMethod());
 }
 
 QString HttpParser::uri() const
 {
-    return m_uri;
+    return QString::fromUtf8(rawUri());
 }
 
 QStringList HttpParser::headers() const
 {
-    return m_headers;
+    QStringList result;
+    result.reserve(m_headers.count());
+    for (const auto &header : m_headers)
+        result << QStringLiteral("%1: %2").arg(QString::fromUtf8(view(header.name)),
+                                               QString::fromUtf8(view(header.value)));
+    for (const auto &trailer : m_trailers)
+        result << QStringLiteral("%1: %2").arg(QString::fromUtf8(trailer.first), QString::fromUtf8(trailer.second));
+    return result;
 }
 
 QByteArray HttpParser::body() const
 {
-    return m_data;
+    if (m_spillFile)
+        return m_spilledData ? QByteArray::fromRawData(m_spilledData, m_spilledSize) : m_body;
+    if (m_chunked)
+        return m_body;
+    if (m_head.isEmpty() || !m_pos)
+        return QByteArray();
+    return m_buffer.size() == m_pos ? m_buffer : m_buffer.left(m_pos);
+}
+
+QByteArray HttpParser::takeBody()
+{
+    QByteArray spilled;
+    if (m_spillFile) {
+        m_spillFile->seek(0);
+        spilled = m_spillFile->readAll();
+        m_bodyTaken += static_cast<qulonglong>(m_spilledSize);
+        dropSpilledBody();
+    }
+    if (m_chunked) {
+        QByteArray result;
+        result.swap(m_body);
+        m_bodyTaken += static_cast<qulonglong>(result.size());
+        return spilled.isEmpty() ? result : spilled.append(result);
+    }
+    QByteArray result = body();
+    if (!result.isEmpty()) {
+        if (m_buffer.size() == m_pos)
+            m_buffer.clear();
+        else
+            m_buffer.remove(0, m_pos);
+        m_bodyTaken += static_cast<qulonglong>(m_pos);
+        m_pos = 0;
+    }
+    return spilled.isEmpty() ? result : spilled.append(result);
+}
+
+QSharedPointer<QTemporaryFile> HttpParser::spilledBody() const
+{
+    return m_spillFile;
+}
+
+bool HttpParser::keepAlive() const
+{
+    return m_http11 ? !m_connectionClose : m_connectionKeepAlive;
+}
+
+bool HttpParser::isHttp11() const
+{
+    return m_http11;
+}
+
+QByteArray HttpParser::rawMethod() const
+{
+    return view(m_method);
+}
+
+QByteArray HttpParser::rawUri() const
+{
+    return view(m_uri);
+}
+
+QByteArray HttpParser::header(Header header) const
+{
+    int index = m_knownHeaders[static_cast<size_t>(header)];
+    return index < 0 ? QByteArray() : view(m_headers[index].value);
+}
+
+QByteArray HttpParser::header(const QByteArray &name) const
+{
+    for (const auto &header : m_headers) {
+        if (equalsIgnoreCase(m_head.constData() + header.name.start, header.name.length, name.constData(), name.size()))
+            return view(header.value);
+    }
+    for (const auto &trailer : m_trailers) {
+        if (equalsIgnoreCase(trailer.first.constData(), trailer.first.size(), name.constData(), name.size()))
+            return trailer.second;
+    }
+    return QByteArray();
 }
 
 QString HttpParser::error() const
@@ -69,86 +261,329 @@ QString HttpParser::error() const
     return m_error;
 }
 
-HttpParser::Result HttpParser::initialState(QByteArray &data)
+int HttpParser::errorHttpCode() const
 {
-    Result result;
-    int endLineIndex = data.indexOf("\n");
-    if (endLineIndex != -1) {
-        m_data.append(data.constData(), endLineIndex + 1);
-        data.remove(0, endLineIndex + 1);
-        QString startLine(m_data);
-        m_data.clear();
-        QRegExp firstLineRegExp = FIRST_LINE_REG_EXP;
-        if (firstLineRegExp.indexIn(startLine) != -1) {
-            m_method = firstLineRegExp.cap(1);
-            m_uri = firstLineRegExp.cap(2);
-            m_state = &HttpParser::headersState;
-            result = Result::NeedMore;
-        } else {
-            m_error = QStringLiteral("Invalid start line: %1").arg(startLine);
-            result = Result::Error;
+    return m_errorHttpCode;
+}
+
+HttpParser::Result HttpParser::initialState()
+{
+    int lineEnd = nextLineEnd();
+    if (m_pos > MAX_HEAD_SIZE)
+        return fail(400, QStringLiteral("Start line is too long"));
+    if (lineEnd == -1)
+        return Result::NeedMore;
+
+    const char *data = m_buffer.constData();
+    int end = (lineEnd > m_lineStart && data[lineEnd - 1] == '\r') ? lineEnd - 1 : lineEnd;
+    //Empty lines before request line should be ignored
+    if (end == m_lineStart) {
+        m_lineStart = m_pos;
+        return Result::NeedMore;
+    }
+
+    int methodEnd = m_lineStart;
+    while (methodEnd < end && isTokenChar(data[methodEnd]))
+        ++methodEnd;
+    int uriEnd = end;
+    while (uriEnd > methodEnd && data[uriEnd - 1] != ' ')
+        --uriEnd;
+    --uriEnd;
+    int versionStart = uriEnd + 1;
+
+    bool isValid = methodEnd > m_lineStart && methodEnd < end && data[methodEnd] == ' ' && uriEnd > methodEnd + 1
+                   && end - versionStart == 8 && !std::memcmp(data + versionStart, "HTTP/1.", 7)
+                   && (data[end - 1] == '0' || data[end - 1] == '1');
+    if (!isValid) {
+        return fail(400, QStringLiteral("Invalid start line: %1")
+                             .arg(QString::fromLatin1(data + m_lineStart, lineEnd + 1 - m_lineStart)));
+    }
+
+    m_method = {m_lineStart, methodEnd - m_lineStart};
+    m_uri = {methodEnd + 1, uriEnd - methodEnd - 1};
+    m_http11 = data[end - 1] == '1';
+    m_lineStart = m_pos;
+    m_state = &HttpParser::headersState;
+    return Result::NeedMore;
+}
+
+HttpParser::Result HttpParser::headersState()
+{
+    int lineEnd = nextLineEnd();
+    if (m_pos > MAX_HEAD_SIZE)
+        return fail(400, QStringLiteral("Headers are too long"));
+    if (lineEnd == -1)
+        return Result::NeedMore;
+
+    const char *data = m_buffer.constData();
+    int end = (lineEnd > m_lineStart && data[lineEnd - 1] == '\r') ? lineEnd - 1 : lineEnd;
+    if (end != m_lineStart) {
+        Result result = parseHeaderLine(end);
+        m_lineStart = m_pos;
+        return result;
+    }
+
+    //Head is moved out so body can be handed out without copying
+    m_head = m_buffer.left(m_pos);
+    m_buffer.remove(0, m_pos);
+    m_pos = 0;
+    m_lineStart = 0;
+
+    QByteArray transferEncoding = header(Header::TransferEncoding);
+    QByteArray contentLength = header(Header::ContentLength);
+    if (!transferEncoding.isEmpty()) {
+        //Transfer-Encoding overrides Content-Length according to RFC 7230
+        if (!equalsIgnoreCase(transferEncoding.constData(), transferEncoding.size(), "chunked", 7)) {
+            return fail(501, QStringLiteral("Unsupported Transfer-Encoding: %1")
+                                 .arg(QString::fromLatin1(transferEncoding)));
+        }
+        m_chunked = true;
+    } else if (!contentLength.isEmpty()) {
+        bool ok = false;
+        m_contentLength = contentLength.trimmed().toULongLong(&ok);
+        if (!ok) {
+            return fail(400, QStringLiteral("Can't convert %1 to unsigned long long for \"Content-Length\"")
+                                 .arg(QString::fromLatin1(contentLength)));
         }
+        if (m_contentLength > static_cast<qulonglong>(m_maxBodySize))
+            return fail(413, QStringLiteral("Body is too big: %1 bytes").arg(m_contentLength));
+    }
+
+    QByteArray connection = header(Header::Connection);
+    const char *option = connection.constData();
+    const char *connectionEnd = option + connection.size();
+    while (option < connectionEnd) {
+        while (option < connectionEnd && (isWhitespace(*option) || *option == ','))
+            ++option;
+        const char *optionEnd = option;
+        while (optionEnd < connectionEnd && !isWhitespace(*optionEnd) && *optionEnd != ',')
+            ++optionEnd;
+        int optionLength = static_cast<int>(optionEnd - option);
+        if (equalsIgnoreCase(option, optionLength, "close", 5))
+            m_connectionClose = true;
+        else if (equalsIgnoreCase(option, optionLength, "keep-alive", 10))
+            m_connectionKeepAlive = true;
+        option = optionEnd;
+    }
+
+    if (m_chunked) {
+        m_state = &HttpParser::chunkSizeState;
+        return Result::HeadersReady;
+    }
+    if (!m_contentLength)
+        return Result::Success;
+    m_state = &HttpParser::bodyState;
+    return Result::HeadersReady;
+}
+
+HttpParser::Result HttpParser::bodyState()
+{
+    const qulonglong received = m_bodyTaken + static_cast<qulonglong>(m_spilledSize);
+    int needed = static_cast<int>(m_contentLength - received) - m_pos;
+    m_pos += qMin(needed, m_buffer.size() - m_pos);
+    //Spilled bytes are dropped from buffer right away, so it holds only pipelined data after body
+    if (m_spillThreshold && m_contentLength > static_cast<qulonglong>(m_spillThreshold) && m_pos) {
+        if (!spill(m_buffer.constData(), m_pos))
+            return fail(500, QStringLiteral("Can't write request body to temporary file"));
+        m_buffer.remove(0, m_pos);
+        m_pos = 0;
+    }
+    return m_bodyTaken + static_cast<qulonglong>(m_spilledSize + m_pos) == m_contentLength ? Result::Success
+                                                                                          : Result::NeedMore;
+}
+
+HttpParser::Result HttpParser::chunkSizeState()
+{
+    int lineEnd = nextLineEnd();
+    if (lineEnd == -1) {
+        return m_pos - m_lineStart > MAX_HEAD_SIZE ? fail(400, QStringLiteral("Chunk size line is too long"))
+                                                   : Result::NeedMore;
+    }
+
+    const char *data = m_buffer.constData();
+    qulonglong chunkSize = 0;
+    int digitsEnd = m_lineStart;
+    for (; digitsEnd < lineEnd; ++digitsEnd) {
+        int digit = hexDigit(data[digitsEnd]);
+        if (digit < 0)
+            break;
+        chunkSize = (chunkSize << 4) | static_cast<qulonglong>(digit);
+        if (chunkSize > static_cast<qulonglong>(m_maxBodySize))
+            return fail(413, QStringLiteral("Body is too big"));
+    }
+    //Chunk extensions are allowed after size and ignored
+    char terminator = digitsEnd < lineEnd ? data[digitsEnd] : '\n';
+    if (digitsEnd == m_lineStart || (terminator != ';' && terminator != '\r' && !isWhitespace(terminator))) {
+        return fail(400, QStringLiteral("Invalid chunk size: %1")
+                             .arg(QString::fromLatin1(data + m_lineStart, lineEnd - m_lineStart).trimmed()));
+    }
+    //Parts already taken by streaming consumer are counted too, so limit applies to whole body
+    const qulonglong received = m_bodyTaken + static_cast<qulonglong>(m_body.size() + m_spilledSize);
+    if (received + chunkSize > static_cast<qulonglong>(m_maxBodySize))
+        return fail(413, QStringLiteral("Body is too big"));
+
+    m_lineStart = m_pos;
+    if (chunkSize) {
+        m_chunkRemaining = chunkSize;
+        m_state = &HttpParser::chunkDataState;
     } else {
-        m_data.append(data);
-        data.clear();
-        result = Result::NeedMore;
+        m_state = &HttpParser::trailersState;
     }
-    return result;
+    return Result::NeedMore;
 }
 
-HttpParser::Result HttpParser::headersState(QByteArray &data)
+HttpParser::Result HttpParser::chunkDataState()
 {
-    Result result;
-    int endLineIndex = data.indexOf("\n");
-    if (endLineIndex != -1) {
-        m_data.append(data.constData(), endLineIndex + 1);
-        data.remove(0, endLineIndex + 1);
-        QString header(m_data);
-        m_data.clear();
-        QRegExp headerRegExp = HEADER_REG_EXP;
-        if (headerRegExp.indexIn(header) != -1) {
-            result = Result::NeedMore;
-            m_headers << headerRegExp.cap(1);
-            if (headerRegExp.cap(2).compare(QLatin1String("Content-Length"), Qt::CaseInsensitive) == 0) {
-                bool ok = false;
-                m_contentLength = headerRegExp.cap(3).toULongLong(&ok);
-                if (!ok) {
-                    result = Result::Error;
-                    m_error = QStringLiteral("Can't convert %1 to unsinged long long for \"Content-Length\"")
-                                  .arg(headerRegExp.cap(3));
-                }
-            }
-        } else if (header == QLatin1String("\r\n")) {
-            if (m_contentLength != 0) {
-                m_state = &HttpParser::bodyState;
-                result = Result::NeedMore;
-            } else {
-                result = Result::Success;
-            }
-        } else {
-            m_error = QStringLiteral("Invalid header: %1").arg(header);
-            result = Result::Error;
+    int available = static_cast<int>(qMin(static_cast<qulonglong>(m_buffer.size() - m_pos), m_chunkRemaining));
+    m_body.append(m_buffer.constData() + m_pos, available);
+    m_pos += available;
+    m_lineStart = m_pos;
+    m_chunkRemaining -= available;
+    if (m_spillThreshold && (m_spillFile || m_body.size() > m_spillThreshold)) {
+        if (!spill(m_body.constData(), m_body.size()))
+            return fail(500, QStringLiteral("Can't write request body to temporary file"));
+        m_body.clear();
+    }
+    if (!m_chunkRemaining)
+        m_state = &HttpParser::chunkDataEndState;
+    return Result::NeedMore;
+}
+
+HttpParser::Result HttpParser::chunkDataEndState()
+{
+    int lineEnd = nextLineEnd();
+    if (lineEnd == -1) {
+        return m_pos - m_lineStart > 1 ? fail(400, QStringLiteral("Chunk data is bigger than its size"))
+                                       : Result::NeedMore;
+    }
+    int end = (lineEnd > m_lineStart && m_buffer.at(lineEnd - 1) == '\r') ? lineEnd - 1 : lineEnd;
+    if (end != m_lineStart)
+        return fail(400, QStringLiteral("Chunk data is bigger than its size"));
+    m_lineStart = m_pos;
+    m_state = &HttpParser::chunkSizeState;
+    return Result::NeedMore;
+}
+
+HttpParser::Result HttpParser::trailersState()
+{
+    int lineEnd = nextLineEnd();
+    if (lineEnd == -1) {
+        return m_pos - m_lineStart > MAX_HEAD_SIZE ? fail(400, QStringLiteral("Trailers are too long"))
+                                                   : Result::NeedMore;
+    }
+
+    const char *data = m_buffer.constData();
+    int end = (lineEnd > m_lineStart && data[lineEnd - 1] == '\r') ? lineEnd - 1 : lineEnd;
+    if (end == m_lineStart) {
+        m_lineStart = m_pos;
+        return Result::Success;
+    }
+
+    int nameEnd = m_lineStart;
+    while (nameEnd < end && isTokenChar(data[nameEnd]))
+        ++nameEnd;
+    if (nameEnd == m_lineStart || nameEnd == end || data[nameEnd] != ':') {
+        return fail(400, QStringLiteral("Invalid trailer: %1")
+                             .arg(QString::fromLatin1(data + m_lineStart, end - m_lineStart)));
+    }
+    m_trailers << qMakePair(QByteArray(data + m_lineStart, nameEnd - m_lineStart),
+                            QByteArray(data + nameEnd + 1, end - nameEnd - 1).trimmed());
+    m_lineStart = m_pos;
+    return Result::NeedMore;
+}
+
+int HttpParser::nextLineEnd()
+{
+    const char *data = m_buffer.constData();
+    const void *found = std::memchr(data + m_pos, '\n', static_cast<size_t>(m_buffer.size() - m_pos));
+    if (!found) {
+        m_pos = m_buffer.size();
+        return -1;
+    }
+    int lineEnd = static_cast<int>(static_cast<const char *>(found) - data);
+    m_pos = lineEnd + 1;
+    return lineEnd;
+}
+
+HttpParser::Result HttpParser::parseHeaderLine(int lineEnd)
+{
+    const char *data = m_buffer.constData();
+    int nameEnd = m_lineStart;
+    while (nameEnd < lineEnd && isTokenChar(data[nameEnd]))
+        ++nameEnd;
+    if (nameEnd == m_lineStart || nameEnd == lineEnd || data[nameEnd] != ':') {
+        return fail(400, QStringLiteral("Invalid header: %1")
+                             .arg(QString::fromLatin1(data + m_lineStart, lineEnd - m_lineStart)));
+    }
+
+    int valueStart = nameEnd + 1;
+    while (valueStart < lineEnd && isWhitespace(data[valueStart]))
+        ++valueStart;
+    int valueEnd = lineEnd;
+    while (valueEnd > valueStart && isWhitespace(data[valueEnd - 1]))
+        --valueEnd;
+
+    HeaderSpan header{{m_lineStart, nameEnd - m_lineStart}, {valueStart, valueEnd - valueStart}};
+    for (size_t i = 0; i < m_knownHeaders.size(); ++i) {
+        const KnownHeaderName &known = KNOWN_HEADERS[i];
+        if (m_knownHeaders[i] < 0
+            && equalsIgnoreCase(data + m_lineStart, header.name.length, known.name, known.length)) {
+            m_knownHeaders[i] = m_headers.count();
+            break;
         }
-    } else {
-        m_data.append(data);
-        data.clear();
-        result = Result::NeedMore;
     }
-    return result;
+    m_headers << header;
+    return Result::NeedMore;
 }
 
-HttpParser::Result HttpParser::bodyState(QByteArray &data)
+QByteArray HttpParser::view(const Span &span) const
 {
-    Result result;
-    m_data.append(data);
-    data.clear();
-    if ((qulonglong)m_data.size() > m_contentLength) {
-        m_error = QString();
-        result = Result::Error;
-    } else if ((qulonglong)m_data.size() == m_contentLength) {
-        result = Result::Success;
-    } else {
-        result = Result::NeedMore;
+    return QByteArray::fromRawData(m_head.constData() + span.start, span.length);
+}
+
+bool HttpParser::spill(const char *data, int size)
+{
+    if (!m_spillFile) {
+        const QString fileTemplate = QDir::temp().filePath(QStringLiteral("proof-body-XXXXXX"));
+        m_spillFile = QSharedPointer<QTemporaryFile>::create(fileTemplate);
+        if (!m_spillFile->open()) {
+            m_spillFile.reset();
+            return false;
+        }
     }
-    return result;
+    if (m_spillFile->write(data, size) != size)
+        return false;
+    m_spilledSize += size;
+    return true;
+}
+
+HttpParser::Result HttpParser::mapSpilledBody()
+{
+    if (!m_spillFile->flush())
+        return fail(500, QStringLiteral("Can't write request body to temporary file"));
+    if (m_spilledSize)
+        m_spilledData = reinterpret_cast<const char *>(m_spillFile->map(0, m_spilledSize));
+    //Body is read back to memory if mapping is not possible, it is still better than failing the request
+    if (!m_spilledData && m_spilledSize) {
+        m_spillFile->seek(0);
+        m_body = m_spillFile->readAll();
+        if (m_body.size() != m_spilledSize)
+            return fail(500, QStringLiteral("Can't read request body from temporary file"));
+    }
+    return Result::Success;
+}
+
+void HttpParser::dropSpilledBody()
+{
+    //File unmaps itself when it is destroyed, so views stay valid while someone holds it
+    m_spillFile.reset();
+    m_spilledSize = 0;
+    m_spilledData = nullptr;
+}
+
+HttpParser::Result HttpParser::fail(int httpCode, const QString &error)
+{
+    m_errorHttpCode = httpCode;
+    m_error = error;
+    return Result::Error;
 }
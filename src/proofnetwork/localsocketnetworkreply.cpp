@@ -0,0 +1,337 @@
+/* Copyright 2018, OpenSoft Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright notice, this list of
+ * conditions and the following disclaimer in the documentation and/or other materials provided
+ * with the distribution.
+ *     * Neither the name of OpenSoft Inc. nor the names of its contributors may be used to endorse
+ * or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include "proofnetwork/localsocketnetworkreply_p.h"
+
+#include <QLocalSocket>
+
+#include <cstring>
+
+using namespace Proof;
+
+LocalSocketNetworkReply::LocalSocketNetworkReply(const QString &socketPath, const QByteArray &verb,
+                                                 const QNetworkRequest &request, const QByteArray &body,
+                                                 QObject *parent)
+    : QNetworkReply(parent)
+{
+    setRequest(request);
+    setUrl(request.url());
+    if (verb == "GET")
+        setOperation(QNetworkAccessManager::GetOperation);
+    else if (verb == "POST")
+        setOperation(QNetworkAccessManager::PostOperation);
+    else if (verb == "PUT")
+        setOperation(QNetworkAccessManager::PutOperation);
+    else if (verb == "DELETE")
+        setOperation(QNetworkAccessManager::DeleteOperation);
+    else if (verb == "HEAD")
+        setOperation(QNetworkAccessManager::HeadOperation);
+    else
+        setOperation(QNetworkAccessManager::CustomOperation);
+    open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+
+    m_socket = new QLocalSocket(this);
+    const QByteArray data = serializeRequest(verb, request, body);
+    connect(m_socket, &QLocalSocket::connected, this, [this, data] { m_socket->write(data); });
+    connect(m_socket, &QLocalSocket::readyRead, this, &LocalSocketNetworkReply::onReadyRead);
+    connect(m_socket, &QLocalSocket::disconnected, this, &LocalSocketNetworkReply::onDisconnected);
+    connect(m_socket, qOverload<QLocalSocket::LocalSocketError>(&QLocalSocket::error), this,
+            [this](QLocalSocket::LocalSocketError socketError) {
+                switch (socketError) {
+                case QLocalSocket::PeerClosedError:
+                    //Handled by disconnected signal, answer can be delimited by connection close
+                    break;
+                case QLocalSocket::ServerNotFoundError:
+                    failReply(HostNotFoundError, m_socket->errorString());
+                    break;
+                case QLocalSocket::ConnectionRefusedError:
+                    failReply(ConnectionRefusedError, m_socket->errorString());
+                    break;
+                case QLocalSocket::SocketTimeoutError:
+                    failReply(TimeoutError, m_socket->errorString());
+                    break;
+                default:
+                    failReply(UnknownNetworkError, m_socket->errorString());
+                    break;
+                }
+            });
+    //Connection errors can be reported synchronously, but caller should be able to connect to reply signals first
+    QMetaObject::invokeMethod(this,
+                              [this, socketPath] {
+                                  if (m_state != State::Done)
+                                      m_socket->connectToServer(socketPath);
+                              },
+                              Qt::QueuedConnection);
+}
+
+LocalSocketNetworkReply::~LocalSocketNetworkReply()
+{}
+
+void LocalSocketNetworkReply::abort()
+{
+    failReply(OperationCanceledError, QStringLiteral("Operation canceled"));
+}
+
+qint64 LocalSocketNetworkReply::bytesAvailable() const
+{
+    return m_content.size() - m_contentPos + QNetworkReply::bytesAvailable();
+}
+
+bool LocalSocketNetworkReply::isSequential() const
+{
+    return true;
+}
+
+QByteArray LocalSocketNetworkReply::serializeRequest(const QByteArray &verb, const QNetworkRequest &request,
+                                                     const QByteArray &body)
+{
+    const QUrl url = request.url();
+    QByteArray target = url.path(QUrl::FullyEncoded).toLatin1();
+    if (target.isEmpty())
+        target = "/";
+    if (url.hasQuery())
+        target += '?' + url.query(QUrl::FullyEncoded).toLatin1();
+
+    QByteArray result = verb + ' ' + target + " HTTP/1.1\r\nHost: "
+                        + (url.host().isEmpty() ? QByteArray("localhost") : url.host().toLatin1())
+                        + "\r\nConnection: close\r\n";
+    const auto headers = request.rawHeaderList();
+    for (const QByteArray &header : headers) {
+        if (qstricmp(header.constData(), "Host") == 0 || qstricmp(header.constData(), "Connection") == 0
+            || qstricmp(header.constData(), "Content-Length") == 0) {
+            continue;
+        }
+        result += header + ": " + request.rawHeader(header) + "\r\n";
+    }
+    if (!body.isEmpty() || verb == "POST" || verb == "PUT" || verb == "PATCH")
+        result += "Content-Length: " + QByteArray::number(body.size()) + "\r\n";
+    result += "\r\n";
+    result += body;
+    return result;
+}
+
+QNetworkReply::NetworkError LocalSocketNetworkReply::errorForStatusCode(int statusCode)
+{
+    //Same mapping as QNetworkAccessManager uses for http answers
+    switch (statusCode) {
+    case 401:
+        return AuthenticationRequiredError;
+    case 403:
+        return ContentAccessDenied;
+    case 404:
+        return ContentNotFoundError;
+    case 405:
+        return ContentOperationNotPermittedError;
+    case 407:
+        return ProxyAuthenticationRequiredError;
+    case 409:
+        return ContentConflictError;
+    case 410:
+        return ContentGoneError;
+    case 418:
+        return ProtocolInvalidOperationError;
+    case 500:
+        return InternalServerError;
+    case 501:
+        return OperationNotImplementedError;
+    case 503:
+        return ServiceUnavailableError;
+    default:
+        break;
+    }
+    if (statusCode >= 500)
+        return UnknownServerError;
+    if (statusCode >= 400)
+        return UnknownContentError;
+    return NoError;
+}
+
+qint64 LocalSocketNetworkReply::readData(char *data, qint64 maxSize)
+{
+    const qint64 size = qMin(maxSize, m_content.size() - m_contentPos);
+    if (size <= 0)
+        return 0;
+    std::memcpy(data, m_content.constData() + m_contentPos, static_cast<size_t>(size));
+    m_contentPos += size;
+    if (m_contentPos == m_content.size()) {
+        m_content.clear();
+        m_contentPos = 0;
+    }
+    return size;
+}
+
+qint64 LocalSocketNetworkReply::writeData(const char *, qint64)
+{
+    return -1;
+}
+
+void LocalSocketNetworkReply::onReadyRead()
+{
+    m_buffer += m_socket->readAll();
+    while (m_state != State::Done) {
+        switch (m_state) {
+        case State::Head: {
+            const int headEnd = m_buffer.indexOf("\r\n\r\n");
+            if (headEnd < 0)
+                return;
+            parseHead(m_buffer.left(headEnd));
+            m_buffer.remove(0, headEnd + 4);
+            break;
+        }
+        case State::Body:
+        case State::ChunkData: {
+            //Body without length is read until connection is closed
+            if (m_bodyLeft < 0) {
+                m_content += m_buffer;
+                m_buffer.clear();
+                return;
+            }
+            const int size = static_cast<int>(qMin<qint64>(m_bodyLeft, m_buffer.size()));
+            m_content += m_buffer.left(size);
+            m_buffer.remove(0, size);
+            m_bodyLeft -= size;
+            if (m_bodyLeft > 0)
+                return;
+            if (m_state == State::Body)
+                finishReply();
+            else
+                m_state = State::ChunkEnd;
+            break;
+        }
+        case State::ChunkSize: {
+            const int lineEnd = m_buffer.indexOf("\r\n");
+            if (lineEnd < 0)
+                return;
+            QByteArray sizeLine = m_buffer.left(lineEnd);
+            const int extensionStart = sizeLine.indexOf(';');
+            if (extensionStart >= 0)
+                sizeLine.truncate(extensionStart);
+            bool ok = false;
+            m_bodyLeft = sizeLine.trimmed().toLongLong(&ok, 16);
+            m_buffer.remove(0, lineEnd + 2);
+            if (!ok || m_bodyLeft < 0) {
+                failReply(ProtocolFailure, QStringLiteral("Wrong chunk size in answer"));
+                return;
+            }
+            m_state = m_bodyLeft ? State::ChunkData : State::Trailers;
+            break;
+        }
+        case State::ChunkEnd:
+            if (m_buffer.size() < 2)
+                return;
+            m_buffer.remove(0, 2);
+            m_state = State::ChunkSize;
+            break;
+        case State::Trailers: {
+            const int lineEnd = m_buffer.indexOf("\r\n");
+            if (lineEnd < 0)
+                return;
+            m_buffer.remove(0, lineEnd + 2);
+            if (!lineEnd)
+                finishReply();
+            break;
+        }
+        case State::Done:
+            break;
+        }
+    }
+}
+
+void LocalSocketNetworkReply::onDisconnected()
+{
+    if (m_state == State::Body && m_bodyLeft < 0)
+        finishReply();
+    else
+        failReply(RemoteHostClosedError, QStringLiteral("Connection closed before answer was received"));
+}
+
+void LocalSocketNetworkReply::parseHead(const QByteArray &head)
+{
+    const QList<QByteArray> lines = head.split('\n');
+    const QByteArray statusLine = lines.first().trimmed();
+    const int codeStart = statusLine.indexOf(' ');
+    const int reasonStart = statusLine.indexOf(' ', codeStart + 1);
+    bool ok = false;
+    const int statusCode = statusLine.mid(codeStart + 1, reasonStart < 0 ? -1 : reasonStart - codeStart - 1)
+                               .toInt(&ok);
+    if (!statusLine.startsWith("HTTP/") || codeStart < 0 || !ok) {
+        failReply(ProtocolFailure, QStringLiteral("Wrong status line in answer"));
+        return;
+    }
+    setAttribute(QNetworkRequest::HttpStatusCodeAttribute, statusCode);
+    setAttribute(QNetworkRequest::HttpReasonPhraseAttribute,
+                 reasonStart < 0 ? QByteArray() : statusLine.mid(reasonStart + 1));
+
+    for (int i = 1; i < lines.count(); ++i) {
+        const QByteArray &line = lines[i];
+        const int colon = line.indexOf(':');
+        if (colon <= 0)
+            continue;
+        const QByteArray name = line.left(colon).trimmed();
+        const QByteArray value = line.mid(colon + 1).trimmed();
+        setRawHeader(name, hasRawHeader(name) ? rawHeader(name) + ", " + value : value);
+    }
+
+    m_state = State::Body;
+    m_bodyLeft = -1;
+    if (operation() == QNetworkAccessManager::HeadOperation || statusCode == 204 || statusCode == 304) {
+        m_bodyLeft = 0;
+    } else if (rawHeader("Transfer-Encoding").toLower().contains("chunked")) {
+        m_state = State::ChunkSize;
+    } else if (hasRawHeader("Content-Length")) {
+        m_bodyLeft = qMax(0ll, rawHeader("Content-Length").trimmed().toLongLong());
+    }
+    if (m_state == State::Body && !m_bodyLeft)
+        finishReply();
+}
+
+void LocalSocketNetworkReply::finishReply()
+{
+    if (m_state == State::Done)
+        return;
+    m_state = State::Done;
+    m_socket->abort();
+    const NetworkError statusError = errorForStatusCode(attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt());
+    setFinished(true);
+    emit downloadProgress(m_content.size(), m_content.size());
+    if (!m_content.isEmpty())
+        emit readyRead();
+    if (statusError != NoError) {
+        setError(statusError, attribute(QNetworkRequest::HttpReasonPhraseAttribute).toString());
+        emit error(statusError);
+    }
+    emit finished();
+}
+
+void LocalSocketNetworkReply::failReply(NetworkError code, const QString &errorString)
+{
+    if (m_state == State::Done)
+        return;
+    m_state = State::Done;
+    m_socket->abort();
+    setError(code, errorString);
+    setFinished(true);
+    emit error(code);
+    emit finished();
+}
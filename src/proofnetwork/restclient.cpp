@@ -29,6 +29,7 @@
 #include "proofcore/proofobject_p.h"
 #include "proofcore/settingsgroup.h"
 
+#include "proofnetwork/localsocketnetworkreply_p.h"
 #include "proofnetwork/smtpclient.h"
 
 #include <QAuthenticator>
@@ -106,6 +107,8 @@ public:
     QUrl createUrl(QString method, const QUrlQuery &query) const;
     QNetworkRequest createNetworkRequest(const QUrl &url, const QByteArray &body, const QString &vendor);
     QByteArray generateWsseToken() const;
+    QNetworkReply *sendRequest(QNetworkAccessManager *qnam, const QByteArray &verb, const QNetworkRequest &request,
+                               const QByteArray &body = QByteArray());
 
     void handleReply(QNetworkReply *reply, int customMsecsForTimeout = -1);
     void cleanupReplyHandler(QNetworkReply *reply);
@@ -128,6 +131,7 @@ public:
     QString postfix;
     QString token;
     QString scheme = QStringLiteral("https");
+    QString localSocketPath;
     QHash<QNetworkReply *, QTimer *> replyTimeouts;
     QHash<QByteArray, QByteArray> customHeaders;
     QHash<QString, QNetworkCookie> cookies;
@@ -366,6 +370,21 @@ void RestClient::setMsecsForTimeout(int arg)
     }
 }
 
+QString RestClient::localSocketPath() const
+{
+    Q_D_CONST(RestClient);
+    return d->localSocketPath;
+}
+
+void RestClient::setLocalSocketPath(const QString &arg)
+{
+    Q_D(RestClient);
+    if (d->localSocketPath != arg) {
+        d->localSocketPath = arg;
+        emit localSocketPathChanged(arg);
+    }
+}
+
 bool RestClient::followRedirects() const
 {
     Q_D_CONST(RestClient);
@@ -437,7 +456,7 @@ CancelableFuture<QNetworkReply *> RestClient::get(const QString &method, const Q
 
     return NetworkScheduler::instance()->addRequest(d->host, [d, url, vendor](QNetworkAccessManager *qnam) {
         qCDebug(proofNetworkExtraLog) << "GET" << url.toDisplayString() << "started";
-        QNetworkReply *reply = qnam->get(d->createNetworkRequest(url, QByteArray(), vendor));
+        QNetworkReply *reply = d->sendRequest(qnam, "GET", d->createNetworkRequest(url, QByteArray(), vendor));
         d->handleReply(reply);
         return reply;
     });
@@ -452,7 +471,7 @@ CancelableFuture<QNetworkReply *> RestClient::post(const QString &method, const
 
     return NetworkScheduler::instance()->addRequest(d->host, [d, url, body, vendor](QNetworkAccessManager *qnam) {
         qCDebug(proofNetworkExtraLog) << "POST" << url.toDisplayString() << "started";
-        QNetworkReply *reply = qnam->post(d->createNetworkRequest(url, body, vendor), body);
+        QNetworkReply *reply = d->sendRequest(qnam, "POST", d->createNetworkRequest(url, body, vendor), body);
         d->handleReply(reply);
         return reply;
     });
@@ -487,7 +506,7 @@ CancelableFuture<QNetworkReply *> RestClient::put(const QString &method, const Q
 
     return NetworkScheduler::instance()->addRequest(d->host, [d, url, body, vendor](QNetworkAccessManager *qnam) {
         qCDebug(proofNetworkExtraLog) << "PUT" << url.toDisplayString() << "started";
-        QNetworkReply *reply = qnam->put(d->createNetworkRequest(url, body, vendor), body);
+        QNetworkReply *reply = d->sendRequest(qnam, "PUT", d->createNetworkRequest(url, body, vendor), body);
         d->handleReply(reply);
         return reply;
     });
@@ -502,11 +521,8 @@ CancelableFuture<QNetworkReply *> RestClient::patch(const QString &method, const
 
     return NetworkScheduler::instance()->addRequest(d->host, [d, url, body, vendor](QNetworkAccessManager *qnam) {
         qCDebug(proofNetworkExtraLog) << "PATCH" << url.toDisplayString() << "started";
-        QBuffer *bodyBuffer = new QBuffer;
-        bodyBuffer->setData(body);
-        QNetworkReply *reply = qnam->sendCustomRequest(d->createNetworkRequest(url, body, vendor), "PATCH", bodyBuffer);
+        QNetworkReply *reply = d->sendRequest(qnam, "PATCH", d->createNetworkRequest(url, body, vendor), body);
         d->handleReply(reply);
-        bodyBuffer->setParent(reply);
         return reply;
     });
 }
@@ -520,7 +536,7 @@ CancelableFuture<QNetworkReply *> RestClient::deleteResource(const QString &meth
 
     return NetworkScheduler::instance()->addRequest(d->host, [d, url, vendor](QNetworkAccessManager *qnam) {
         qCDebug(proofNetworkExtraLog) << "DELETE" << url.toDisplayString() << "started";
-        QNetworkReply *reply = qnam->deleteResource(d->createNetworkRequest(url, QByteArray(), vendor));
+        QNetworkReply *reply = d->sendRequest(qnam, "DELETE", d->createNetworkRequest(url, QByteArray(), vendor));
         d->handleReply(reply);
         return reply;
     });
@@ -645,6 +661,26 @@ QNetworkRequest RestClientPrivate::createNetworkRequest(const QUrl &url, const Q
     return result;
 }
 
+QNetworkReply *RestClientPrivate::sendRequest(QNetworkAccessManager *qnam, const QByteArray &verb,
+                                              const QNetworkRequest &request, const QByteArray &body)
+{
+    if (!localSocketPath.isEmpty())
+        return new LocalSocketNetworkReply(localSocketPath, verb, request, body, qnam);
+    if (verb == "GET")
+        return qnam->get(request);
+    if (verb == "POST")
+        return qnam->post(request, body);
+    if (verb == "PUT")
+        return qnam->put(request, body);
+    if (verb == "DELETE")
+        return qnam->deleteResource(request);
+    QBuffer *bodyBuffer = new QBuffer;
+    bodyBuffer->setData(body);
+    QNetworkReply *reply = qnam->sendCustomRequest(request, verb, bodyBuffer);
+    bodyBuffer->setParent(reply);
+    return reply;
+}
+
 QByteArray RestClientPrivate::generateWsseToken() const
 {
     QByteArray hashedPassword;
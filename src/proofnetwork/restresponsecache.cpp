@@ -0,0 +1,166 @@
+/* Copyright 2018, OpenSoft Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright notice, this list of
+ * conditions and the following disclaimer in the documentation and/or other materials provided
+ * with the distribution.
+ *     * Neither the name of OpenSoft Inc. nor the names of its contributors may be used to endorse
+ * or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include "proofnetwork/restresponsecache_p.h"
+
+#include <QCryptographicHash>
+#include <QList>
+#include <QReadLocker>
+#include <QWriteLocker>
+
+static constexpr int DEFAULT_TTL = 60000;
+static constexpr int EXPIRED_PURGE_INTERVAL = 1000;
+
+using namespace Proof;
+
+RestResponseCache::RestResponseCache(int maxEntries) : maxEntries(qMax(1, maxEntries)), m_ttl(DEFAULT_TTL)
+{}
+
+RestResponseCache::~RestResponseCache()
+{}
+
+int RestResponseCache::ttl() const
+{
+    return m_ttl.load(std::memory_order_relaxed);
+}
+
+void RestResponseCache::setTtl(int msecs)
+{
+    m_ttl.store(qMax(0, msecs), std::memory_order_relaxed);
+}
+
+int RestResponseCache::count() const
+{
+    QReadLocker locker(&lock);
+    return entries.count();
+}
+
+std::optional<RestResponseCache::Answer> RestResponseCache::find(const QByteArray &key)
+{
+    {
+        QReadLocker locker(&lock);
+        auto it = entries.constFind(key);
+        if (it == entries.cend())
+            return std::nullopt;
+        if (!it->expiration.hasExpired())
+            return it->answer;
+    }
+    QWriteLocker locker(&lock);
+    auto it = entries.find(key);
+    if (it != entries.end() && it->expiration.hasExpired())
+        entries.erase(it);
+    return std::nullopt;
+}
+
+quint64 RestResponseCache::generation(const QByteArray &routeName) const
+{
+    QReadLocker locker(&lock);
+    return routeGeneration(routeName);
+}
+
+RestResponseCache::Answer RestResponseCache::insert(const QByteArray &key, const QByteArray &routeName,
+                                                    const QByteArray &body, const QString &contentType,
+                                                    const QHash<QString, QString> &headers,
+                                                    std::optional<quint64> generation)
+{
+    Entry entry;
+    //Body can be raw data over buffer that is released after answer is sent (e.g. mapped request body)
+    entry.answer.body = QByteArray(body.constData(), body.size());
+    entry.answer.contentType = contentType;
+    entry.answer.headers = headers;
+    entry.answer.etag = etag(body);
+    entry.answer.headers[QStringLiteral("ETag")] = QString::fromLatin1(entry.answer.etag);
+    entry.routeName = routeName;
+    const int currentTtl = ttl();
+    entry.expiration = currentTtl > 0 ? QDeadlineTimer(currentTtl) : QDeadlineTimer(QDeadlineTimer::Forever);
+
+    QWriteLocker locker(&lock);
+    if (generation && *generation != routeGeneration(routeName))
+        return entry.answer;
+    if (nextPurge.hasExpired() || (entries.count() >= maxEntries && !entries.contains(key))) {
+        purgeExpired();
+        if (entries.count() >= maxEntries && !entries.contains(key))
+            entries.erase(entries.begin());
+    }
+    entries[key] = entry;
+    return entry.answer;
+}
+
+void RestResponseCache::insertEncodedBody(const QByteArray &key, const QByteArray &etag, const QByteArray &encoding,
+                                          const QByteArray &body)
+{
+    QWriteLocker locker(&lock);
+    auto it = entries.find(key);
+    if (it != entries.end() && it->answer.etag == etag && !it->expiration.hasExpired())
+        it->answer.encodedBodies[encoding] = body;
+}
+
+void RestResponseCache::invalidate()
+{
+    QWriteLocker locker(&lock);
+    entries.clear();
+    ++globalGeneration;
+}
+
+void RestResponseCache::invalidate(const QByteArray &routeName)
+{
+    QWriteLocker locker(&lock);
+    for (auto it = entries.begin(); it != entries.end();)
+        it = it->routeName == routeName ? entries.erase(it) : ++it;
+    ++routeGenerations[routeName];
+}
+
+quint64 RestResponseCache::routeGeneration(const QByteArray &routeName) const
+{
+    //Both counters only grow, so their sum changes with any of them
+    return globalGeneration + routeGenerations.value(routeName);
+}
+
+void RestResponseCache::purgeExpired()
+{
+    for (auto it = entries.begin(); it != entries.end();)
+        it = it->expiration.hasExpired() ? entries.erase(it) : ++it;
+    nextPurge.setRemainingTime(EXPIRED_PURGE_INTERVAL);
+}
+
+QByteArray RestResponseCache::etag(const QByteArray &body)
+{
+    return "W/\"" + QCryptographicHash::hash(body, QCryptographicHash::Md5).toHex() + '"';
+}
+
+bool RestResponseCache::isNotModified(const QByteArray &ifNoneMatch, const QByteArray &etag)
+{
+    const QByteArray opaqueTag = etag.startsWith("W/") ? etag.mid(2) : etag;
+    const QList<QByteArray> candidates = ifNoneMatch.split(',');
+    for (const QByteArray &candidate : candidates) {
+        QByteArray trimmed = candidate.trimmed();
+        if (trimmed == "*")
+            return true;
+        if (trimmed.startsWith("W/"))
+            trimmed = trimmed.mid(2);
+        if (!trimmed.isEmpty() && trimmed == opaqueTag)
+            return true;
+    }
+    return false;
+}
@@ -0,0 +1,251 @@
+/* Copyright 2018, OpenSoft Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright notice, this list of
+ * conditions and the following disclaimer in the documentation and/or other materials provided
+ * with the distribution.
+ *     * Neither the name of OpenSoft Inc. nor the names of its contributors may be used to endorse
+ * or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include "proofnetwork/restrouter_p.h"
+
+using namespace Proof;
+
+namespace {
+bool isParameterSegment(const QByteArray &segment)
+{
+    return segment.startsWith('{') && segment.endsWith('}');
+}
+
+bool matchesParameterType(const QByteArray &type, const char *value, int length)
+{
+    int i = 0;
+    if (type == "{int}" && length > 1 && value[0] == '-')
+        ++i;
+    else if (type != "{int}" && type != "{uint}")
+        return length > 0;
+    if (i == length)
+        return false;
+    for (; i < length; ++i) {
+        if (value[i] < '0' || value[i] > '9')
+            return false;
+    }
+    return true;
+}
+} // namespace
+
+RestRouter::RestRouter()
+{
+    clear();
+}
+
+void RestRouter::clear()
+{
+    m_nodes.clear();
+    m_nodes << Node();
+    m_routes.clear();
+}
+
+bool RestRouter::isEmpty() const
+{
+    return m_routes.isEmpty();
+}
+
+void RestRouter::addRoute(const QStringList &segments, const Route &route)
+{
+    Q_ASSERT(segments.count() >= 2);
+    int node = 0;
+    for (const QString &segment : segments) {
+        QByteArray rawSegment = segment.toUtf8();
+        bool isParameter = isParameterSegment(rawSegment);
+        int child = -1;
+        for (child = m_nodes[node].firstChild; child >= 0; child = m_nodes[child].nextSibling) {
+            const Node &childNode = m_nodes[child];
+            if (childNode.isParameter == isParameter && childNode.segment.compare(rawSegment, Qt::CaseInsensitive) == 0)
+                break;
+        }
+        node = child < 0 ? addChild(node, rawSegment, isParameter) : child;
+    }
+    if (m_nodes[node].route < 0) {
+        m_nodes[node].route = m_routes.count();
+        m_routes << route;
+    } else {
+        m_routes[m_nodes[node].route] = route;
+    }
+}
+
+const RestRouter::Route *RestRouter::findRoute(const QByteArray &verb, const QByteArray &path, int *variablePartsStart,
+                                               QVarLengthArray<QByteArray, 4> *pathValues) const
+{
+    int node = findChild(0, verb.constData(), verb.size());
+    if (node < 0)
+        return nullptr;
+
+    const char *data = path.constData();
+    const int size = path.size();
+    int pos = 0;
+    //Deepest moc route passed on the way, used if walk ends in node without suitable route
+    int fallbackNode = -1;
+    int fallbackPos = 0;
+    int fallbackValuesCount = 0;
+    forever {
+        while (pos < size && data[pos] == '/')
+            ++pos;
+        int end = pos;
+        while (end < size && data[end] != '/')
+            ++end;
+        if (end == pos)
+            break;
+        int child = findChild(node, data + pos, end - pos);
+        if (child < 0) {
+            child = findParameterChild(node, data + pos, end - pos);
+            if (child < 0)
+                break;
+            if (pathValues)
+                pathValues->append(QByteArray::fromRawData(data + pos, end - pos));
+        }
+        node = child;
+        pos = end;
+        if (m_nodes[node].route >= 0 && !m_routes[m_nodes[node].route].invoker) {
+            fallbackNode = node;
+            fallbackPos = pos;
+            fallbackValuesCount = pathValues ? pathValues->count() : 0;
+        }
+    }
+
+    bool found = m_nodes[node].route >= 0;
+    if (found && m_routes[m_nodes[node].route].invoker) {
+        while (pos < size && data[pos] == '/')
+            ++pos;
+        found = pos == size;
+    }
+    if (!found) {
+        if (fallbackNode < 0)
+            return nullptr;
+        node = fallbackNode;
+        pos = fallbackPos;
+        if (pathValues)
+            pathValues->resize(fallbackValuesCount);
+    }
+    if (variablePartsStart)
+        *variablePartsStart = pos;
+    return &m_routes[m_nodes[node].route];
+}
+
+int RestRouter::routesCount() const
+{
+    return m_routes.count();
+}
+
+int RestRouter::routeIndex(const Route *route) const
+{
+    return route ? static_cast<int>(route - m_routes.constData()) : -1;
+}
+
+QVector<QByteArray> RestRouter::routeNames() const
+{
+    QVector<QByteArray> result;
+    result.reserve(m_routes.count());
+    for (const Route &route : m_routes)
+        result << route.name;
+    return result;
+}
+
+QStringList RestRouter::variableParts(const QByteArray &path, int start)
+{
+    QStringList result;
+    const int size = path.size();
+    int pos = start;
+    while (pos < size) {
+        int end = path.indexOf('/', pos);
+        if (end < 0)
+            end = size;
+        if (end > pos)
+            result << QString::fromUtf8(QByteArray::fromPercentEncoding(path.mid(pos, end - pos)));
+        pos = end + 1;
+    }
+    return result;
+}
+
+void RestRouter::queryValues(const QByteArray &query, const QVector<QByteArray> &names,
+                             QVarLengthArray<QByteArray, 4> &values)
+{
+    values.resize(names.count());
+    for (auto &value : values)
+        value = QByteArray();
+    const char *data = query.constData();
+    const int size = query.size();
+    int pos = 0;
+    while (pos < size) {
+        int end = pos;
+        while (end < size && data[end] != '&')
+            ++end;
+        int separator = pos;
+        while (separator < end && data[separator] != '=')
+            ++separator;
+        for (int i = 0; i < names.count(); ++i) {
+            const QByteArray &name = names[i];
+            if (values[i].isNull() && name.size() == separator - pos
+                && !qstrncmp(name.constData(), data + pos, static_cast<uint>(name.size()))) {
+                int valueStart = qMin(separator + 1, end);
+                values[i] = QByteArray::fromRawData(data + valueStart, end - valueStart);
+                break;
+            }
+        }
+        pos = end + 1;
+    }
+}
+
+int RestRouter::findChild(int node, const char *segment, int length) const
+{
+    for (int child = m_nodes[node].firstChild; child >= 0; child = m_nodes[child].nextSibling) {
+        const Node &childNode = m_nodes[child];
+        if (!childNode.isParameter && childNode.segment.size() == length
+            && !qstrnicmp(childNode.segment.constData(), segment, static_cast<uint>(length))) {
+            return child;
+        }
+    }
+    return -1;
+}
+
+int RestRouter::findParameterChild(int node, const char *segment, int length) const
+{
+    //Numeric parameters are more specific than other ones, so they are checked first
+    int fallback = -1;
+    for (int child = m_nodes[node].firstChild; child >= 0; child = m_nodes[child].nextSibling) {
+        const Node &childNode = m_nodes[child];
+        if (!childNode.isParameter || !matchesParameterType(childNode.segment, segment, length))
+            continue;
+        if (childNode.segment == "{int}" || childNode.segment == "{uint}")
+            return child;
+        if (fallback < 0)
+            fallback = child;
+    }
+    return fallback;
+}
+
+int RestRouter::addChild(int node, const QByteArray &segment, bool isParameter)
+{
+    Node child;
+    child.segment = segment;
+    child.isParameter = isParameter;
+    child.nextSibling = m_nodes[node].firstChild;
+    m_nodes << child;
+    m_nodes[node].firstChild = m_nodes.count() - 1;
+    return m_nodes[node].firstChild;
+}
@@ -0,0 +1,214 @@
+/* Copyright 2018, OpenSoft Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright notice, this list of
+ * conditions and the following disclaimer in the documentation and/or other materials provided
+ * with the distribution.
+ *     * Neither the name of OpenSoft Inc. nor the names of its contributors may be used to endorse
+ * or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include "proofnetwork/restservermetrics_p.h"
+
+#include <algorithm>
+
+using namespace Proof;
+
+namespace {
+//Only owner worker writes to counters, so plain load and store are enough
+template <typename T, typename V>
+void add(std::atomic<T> &counter, V value)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + static_cast<T>(value), std::memory_order_relaxed);
+}
+
+template <typename T>
+T load(const std::atomic<T> &counter)
+{
+    return counter.load(std::memory_order_relaxed);
+}
+
+QByteArray escapedLabel(const QByteArray &value)
+{
+    QByteArray result = value;
+    result.replace('\\', "\\\\").replace('"', "\\\"").replace('\n', "\\n");
+    return result;
+}
+
+QByteArray secondsFromUsecs(quint64 usecs)
+{
+    return QByteArray::number(static_cast<double>(usecs) / 1000000.0, 'g', 12);
+}
+} // namespace
+
+const qint64 RestServerMetrics::BUCKET_BOUNDS_USECS[RestServerMetrics::BUCKETS_COUNT] = {
+    100,    250,    500,     1000,    2500,    5000,    10000,   25000,
+    50000,  100000, 250000,  500000,  1000000, 2500000, 5000000, 10000000};
+
+RestServerMetrics::RestServerMetrics(int routesCount)
+    : m_routes(new RouteMetrics[qMax(0, routesCount) + 1]()), m_routesCount(qMax(0, routesCount) + 1)
+{}
+
+RestServerMetrics::~RestServerMetrics()
+{}
+
+int RestServerMetrics::routesCount() const
+{
+    return m_routesCount;
+}
+
+int RestServerMetrics::unmatchedRoute() const
+{
+    return m_routesCount - 1;
+}
+
+void RestServerMetrics::requestStarted(int route)
+{
+    add(routeMetrics(route)->inFlight, 1);
+}
+
+void RestServerMetrics::requestFinished(int route)
+{
+    add(routeMetrics(route)->inFlight, -1);
+}
+
+void RestServerMetrics::answerStarted(int route, int returnCode)
+{
+    int statusClass = returnCode / 100 - 1;
+    if (statusClass < 0 || statusClass >= STATUS_CLASSES_COUNT - 1)
+        statusClass = STATUS_CLASSES_COUNT - 1;
+    add(routeMetrics(route)->answers[statusClass], 1);
+}
+
+void RestServerMetrics::bytesReceived(int route, qint64 bytes)
+{
+    add(routeMetrics(route)->receivedBytes, bytes);
+}
+
+void RestServerMetrics::bytesSent(int route, qint64 bytes)
+{
+    add(routeMetrics(route)->sentBytes, bytes);
+}
+
+void RestServerMetrics::addDuration(int route, Phase phase, qint64 usecs)
+{
+    usecs = qMax(0ll, usecs);
+    Histogram &histogram = routeMetrics(route)->phases[static_cast<int>(phase)];
+    const qint64 *bucket = std::lower_bound(BUCKET_BOUNDS_USECS, BUCKET_BOUNDS_USECS + BUCKETS_COUNT, usecs);
+    add(histogram.buckets[bucket - BUCKET_BOUNDS_USECS], 1);
+    add(histogram.count, 1);
+    add(histogram.sumUsecs, usecs);
+}
+
+QByteArray RestServerMetrics::toPrometheus(const QVector<const RestServerMetrics *> &metrics,
+                                           const QVector<QByteArray> &routeNames)
+{
+    static const char *const phaseNames[PHASES_COUNT] = {"parse", "dispatch", "write"};
+    static const char *const statusClassNames[STATUS_CLASSES_COUNT] = {"1xx", "2xx", "3xx", "4xx", "5xx", "other"};
+
+    struct MergedRoute
+    {
+        QByteArray label;
+        qint64 inFlight = 0;
+        quint64 receivedBytes = 0;
+        quint64 sentBytes = 0;
+        quint64 answers[STATUS_CLASSES_COUNT] = {};
+        quint64 buckets[PHASES_COUNT][BUCKETS_COUNT + 1] = {};
+        quint64 counts[PHASES_COUNT] = {};
+        quint64 sumsUsecs[PHASES_COUNT] = {};
+    };
+
+    int routesCount = routeNames.count() + 1;
+    QVector<MergedRoute> merged(routesCount);
+    for (int route = 0; route < routesCount; ++route)
+        merged[route].label = escapedLabel(route < routeNames.count() ? routeNames[route] : QByteArray("unmatched"));
+
+    for (const RestServerMetrics *workerMetrics : metrics) {
+        for (int route = 0; route < routesCount; ++route) {
+            //Unmatched requests are always stored to last route of each instance
+            int sourceRoute = route == routesCount - 1 ? workerMetrics->unmatchedRoute() : route;
+            if (route < routesCount - 1 && sourceRoute >= workerMetrics->unmatchedRoute())
+                continue;
+            const RouteMetrics *source = workerMetrics->routeMetrics(sourceRoute);
+            MergedRoute &target = merged[route];
+            target.inFlight += load(source->inFlight);
+            target.receivedBytes += load(source->receivedBytes);
+            target.sentBytes += load(source->sentBytes);
+            for (int i = 0; i < STATUS_CLASSES_COUNT; ++i)
+                target.answers[i] += load(source->answers[i]);
+            for (int phase = 0; phase < PHASES_COUNT; ++phase) {
+                const Histogram &histogram = source->phases[phase];
+                for (int i = 0; i <= BUCKETS_COUNT; ++i)
+                    target.buckets[phase][i] += load(histogram.buckets[i]);
+                target.counts[phase] += load(histogram.count);
+                target.sumsUsecs[phase] += load(histogram.sumUsecs);
+            }
+        }
+    }
+
+    auto isActive = [](const MergedRoute &route) {
+        return route.inFlight != 0 || route.counts[static_cast<int>(Phase::Parse)] != 0
+               || std::any_of(std::begin(route.answers), std::end(route.answers), [](quint64 x) { return x; });
+    };
+
+    QByteArray requests = "# HELP proof_rest_requests_total Answered requests by status class\n"
+                          "# TYPE proof_rest_requests_total counter\n";
+    QByteArray inFlight = "# HELP proof_rest_requests_in_flight Requests that are being processed\n"
+                          "# TYPE proof_rest_requests_in_flight gauge\n";
+    QByteArray received = "# HELP proof_rest_received_bytes_total Bytes of requests\n"
+                          "# TYPE proof_rest_received_bytes_total counter\n";
+    QByteArray sent = "# HELP proof_rest_sent_bytes_total Bytes of answers\n"
+                      "# TYPE proof_rest_sent_bytes_total counter\n";
+    QByteArray durations = "# HELP proof_rest_phase_duration_seconds Duration of request parse, dispatch and write\n"
+                           "# TYPE proof_rest_phase_duration_seconds histogram\n";
+
+    for (const MergedRoute &route : qAsConst(merged)) {
+        if (!isActive(route))
+            continue;
+        const QByteArray routeLabel = "route=\"" + route.label + '"';
+        for (int i = 0; i < STATUS_CLASSES_COUNT; ++i) {
+            if (route.answers[i]) {
+                requests += "proof_rest_requests_total{" + routeLabel + ",code=\"" + statusClassNames[i] + "\"} "
+                            + QByteArray::number(route.answers[i]) + '\n';
+            }
+        }
+        inFlight += "proof_rest_requests_in_flight{" + routeLabel + "} " + QByteArray::number(route.inFlight) + '\n';
+        received += "proof_rest_received_bytes_total{" + routeLabel + "} " + QByteArray::number(route.receivedBytes)
+                    + '\n';
+        sent += "proof_rest_sent_bytes_total{" + routeLabel + "} " + QByteArray::number(route.sentBytes) + '\n';
+        for (int phase = 0; phase < PHASES_COUNT; ++phase) {
+            const QByteArray labels = routeLabel + ",phase=\"" + phaseNames[phase] + '"';
+            quint64 cumulative = 0;
+            for (int i = 0; i <= BUCKETS_COUNT; ++i) {
+                cumulative += route.buckets[phase][i];
+                const QByteArray bound = i < BUCKETS_COUNT ? secondsFromUsecs(BUCKET_BOUNDS_USECS[i]) : "+Inf";
+                durations += "proof_rest_phase_duration_seconds_bucket{" + labels + ",le=\"" + bound + "\"} "
+                             + QByteArray::number(cumulative) + '\n';
+            }
+            durations += "proof_rest_phase_duration_seconds_sum{" + labels + "} "
+                         + secondsFromUsecs(route.sumsUsecs[phase]) + '\n';
+            durations += "proof_rest_phase_duration_seconds_count{" + labels + "} "
+                         + QByteArray::number(route.counts[phase]) + '\n';
+        }
+    }
+    return requests + inFlight + received + sent + durations;
+}
+
+RestServerMetrics::RouteMetrics *RestServerMetrics::routeMetrics(int route) const
+{
+    return &m_routes[route >= 0 && route < m_routesCount ? route : m_routesCount - 1];
+}
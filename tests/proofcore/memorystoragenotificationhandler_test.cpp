@@ -57,3 +57,79 @@ TEST(MemoryStorageNotificationHandlerTest, notify)
         EXPECT_EQ(last.second, all.last());
     }
 }
+
+TEST(MemoryStorageNotificationHandlerTest, forEachRecentMessage)
+{
+    ErrorNotifier::instance()->unregisterHandler<MemoryStorageNotificationHandler>();
+    ErrorNotifier::instance()->registerHandler(new MemoryStorageNotificationHandler("testsHandler"));
+    MemoryStorageNotificationHandler *handler = ErrorNotifier::instance()->handler<MemoryStorageNotificationHandler>();
+    ASSERT_TRUE(handler);
+
+    ErrorNotifier::instance()->notify("info", ErrorNotifier::Severity::Info);
+    ErrorNotifier::instance()->notify("error 1", ErrorNotifier::Severity::Error);
+    ErrorNotifier::instance()->notify("warning", ErrorNotifier::Severity::Warning);
+    ErrorNotifier::instance()->notify("critical", ErrorNotifier::Severity::Critical);
+    ErrorNotifier::instance()->notify("error 2", ErrorNotifier::Severity::Error);
+
+    QStringList visited;
+    QVector<quint64> ids;
+    auto visitor = [&visited, &ids](const MemoryStorageNotificationHandler::Message &message) {
+        visited << message.text;
+        ids << message.id;
+        return true;
+    };
+
+    EXPECT_EQ(5, handler->forEachRecentMessage(visitor));
+    EXPECT_EQ((QStringList{"error 2", "critical", "warning", "error 1", "info"}), visited);
+
+    visited.clear();
+    EXPECT_EQ(3, handler->forEachRecentMessage(visitor, 0, QDateTime(), -1, ErrorNotifier::Severity::Error));
+    EXPECT_EQ((QStringList{"error 2", "critical", "error 1"}), visited);
+
+    visited.clear();
+    ids.clear();
+    EXPECT_EQ(2, handler->forEachRecentMessage(visitor, 0, QDateTime(), 2));
+    EXPECT_EQ((QStringList{"error 2", "critical"}), visited);
+    ASSERT_EQ(2, ids.count());
+
+    visited.clear();
+    EXPECT_EQ(3, handler->forEachRecentMessage(visitor, ids.last()));
+    EXPECT_EQ((QStringList{"warning", "error 1", "info"}), visited);
+
+    visited.clear();
+    EXPECT_EQ(0, handler->forEachRecentMessage(visitor, 0, QDateTime::currentDateTimeUtc().addSecs(10)));
+    EXPECT_TRUE(visited.isEmpty());
+
+    visited.clear();
+    EXPECT_EQ(1, handler->forEachRecentMessage([&visited](const MemoryStorageNotificationHandler::Message &message) {
+        visited << message.text;
+        return false;
+    }));
+    EXPECT_EQ((QStringList{"error 2"}), visited);
+}
+
+TEST(MemoryStorageNotificationHandlerTest, maxMessagesCount)
+{
+    ErrorNotifier::instance()->unregisterHandler<MemoryStorageNotificationHandler>();
+    ErrorNotifier::instance()->registerHandler(new MemoryStorageNotificationHandler("testsHandler"));
+    MemoryStorageNotificationHandler *handler = ErrorNotifier::instance()->handler<MemoryStorageNotificationHandler>();
+    ASSERT_TRUE(handler);
+    EXPECT_EQ(0, handler->maxMessagesCount());
+
+    handler->setMaxMessagesCount(3);
+    EXPECT_EQ(3, handler->maxMessagesCount());
+    for (int i = 0; i < 5; ++i)
+        ErrorNotifier::instance()->notify(QStringLiteral("error %1").arg(i));
+    ASSERT_EQ(3, handler->messages().size());
+    EXPECT_EQ((QSet<QString>{"error 2", "error 3", "error 4"}), handler->messages().values().toSet());
+    EXPECT_EQ("error 4", handler->lastMessage().second);
+
+    handler->setMaxMessagesCount(1);
+    ASSERT_EQ(1, handler->messages().size());
+    EXPECT_EQ("error 4", handler->messages().first());
+
+    handler->setMaxMessagesCount(0);
+    for (int i = 5; i < 10; ++i)
+        ErrorNotifier::instance()->notify(QStringLiteral("error %1").arg(i));
+    EXPECT_EQ(6, handler->messages().size());
+}
@@ -15,7 +15,10 @@
 #include <QJsonObject>
 #include <QNetworkReply>
 #include <QTest>
+#include <QUrlQuery>
 
+#include <algorithm>
+#include <atomic>
 #include <tuple>
 
 using testing::Test;
@@ -33,11 +36,39 @@ public:
         setPassword("password");
     }
 
+    mutable std::atomic_int healthStatusCalls{0};
+    //Health status is filled asynchronously after this delay if it is not 0
+    std::atomic_int healthStatusDelay{0};
+
+protected slots:
+    void rest_get_Echo(QTcpSocket *socket, const QStringList &, const QStringList &, const QUrlQuery &query,
+                       const QByteArray &)
+    {
+        sendAnswer(socket, query.queryItemValue("text").toUtf8(), "text/plain");
+    }
+
+    void rest_post_Echo(QTcpSocket *socket, const QStringList &, const QStringList &, const QUrlQuery &,
+                        const QByteArray &body)
+    {
+        sendAnswer(socket, body, "text/json");
+    }
+
 protected:
     Proof::Future<Proof::HealthStatusMap> healthStatus(bool) const override
     {
-        return Proof::futures::successful(QMap<QString, QPair<QDateTime, QVariant>>{
-            {"extra-param", qMakePair(QDateTime::currentDateTime(), QVariant(42))}});
+        ++healthStatusCalls;
+        auto status = [] {
+            return QMap<QString, QPair<QDateTime, QVariant>>{
+                {"extra-param", qMakePair(QDateTime::currentDateTime(), QVariant(42))}};
+        };
+        const int delay = healthStatusDelay;
+        if (delay) {
+            return Proof::tasks::run([delay, status] {
+                QThread::msleep(static_cast<unsigned long>(delay));
+                return status();
+            });
+        }
+        return Proof::futures::successful(status());
     }
 };
 
@@ -129,6 +160,117 @@ TEST_F(RestServerSystemEndpointsTest, recentErrors)
     }
 }
 
+TEST_F(RestServerSystemEndpointsTest, recentErrorsFilters)
+{
+    ASSERT_TRUE(restServerUT->isListening());
+
+    auto fetch = [this](const QString &query, int expectedCode = 200) -> QJsonArray {
+        QNetworkReply *reply = restClientUT->get("/system/recent-errors", QUrlQuery(query)).result();
+        QTime timer;
+        timer.start();
+        while (!reply->isFinished() && timer.elapsed() < 10000)
+            QThread::msleep(5);
+        EXPECT_TRUE(reply->isFinished());
+        EXPECT_EQ(expectedCode, reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt());
+        QJsonDocument doc = QJsonDocument::fromJson(reply->readAll());
+        delete reply;
+        return doc.array();
+    };
+
+    Proof::ErrorNotifier::instance()->notify("old", Proof::ErrorNotifier::Severity::Error);
+    QThread::msleep(1100);
+    const QString since = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    for (int i = 0; i < 600; ++i)
+        Proof::ErrorNotifier::instance()->notify(QStringLiteral("warning %1").arg(i),
+                                                 Proof::ErrorNotifier::Severity::Warning);
+    Proof::ErrorNotifier::instance()->notify("critical", Proof::ErrorNotifier::Severity::Critical);
+
+    QJsonArray all = fetch("");
+    ASSERT_EQ(602, all.count());
+    EXPECT_EQ("critical", all.first().toObject().value("message").toString());
+    EXPECT_EQ("critical", all.first().toObject().value("severity").toString());
+    EXPECT_EQ("warning 599", all[1].toObject().value("message").toString());
+    EXPECT_EQ("old", all.last().toObject().value("message").toString());
+
+    QJsonArray limited = fetch("limit=300");
+    ASSERT_EQ(300, limited.count());
+    EXPECT_EQ("warning 300", limited.last().toObject().value("message").toString());
+
+    EXPECT_EQ(601, fetch(QStringLiteral("since=%1").arg(since)).count());
+    EXPECT_TRUE(fetch("limit=0").isEmpty());
+
+    QJsonArray errors = fetch("severity=error");
+    ASSERT_EQ(2, errors.count());
+    EXPECT_EQ("critical", errors[0].toObject().value("message").toString());
+    EXPECT_EQ("old", errors[1].toObject().value("message").toString());
+
+    fetch("limit=abc", 400);
+    fetch("since=yesterday", 400);
+    fetch("severity=fatal", 400);
+}
+
+TEST_F(RestServerSystemEndpointsTest, batch)
+{
+    ASSERT_TRUE(restServerUT->isListening());
+
+    auto post = [](const Proof::RestClientSP &client, const QByteArray &body) {
+        QNetworkReply *reply = client->post("/system/batch", QUrlQuery(), body).result();
+        QTime timer;
+        timer.start();
+        while (!reply->isFinished() && timer.elapsed() < 10000)
+            QThread::msleep(5);
+        EXPECT_TRUE(reply->isFinished());
+        auto result = qMakePair(reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt(),
+                                QJsonDocument::fromJson(reply->readAll()).array());
+        delete reply;
+        return result;
+    };
+
+    const QByteArray batch = R"([{"path": "/echo", "query": {"text": "first"}},
+                                 {"method": "post", "path": "/echo", "body": {"id": 42}},
+                                 {"path": "/system/status"},
+                                 {"path": "/not-existing"},
+                                 {"method": "post", "path": "/system/batch", "body": []},
+                                 {"path": "no slash"}])";
+
+    EXPECT_FALSE(restServerUT->batchRequestsEnabled());
+    EXPECT_EQ(404, post(restClientUT, batch).first);
+
+    restServerUT->setBatchRequestsEnabled(true);
+    EXPECT_TRUE(restServerUT->batchRequestsEnabled());
+    auto result = post(restClientUT, batch);
+    EXPECT_EQ(200, result.first);
+    ASSERT_EQ(6, result.second.count());
+    //Client doesn't have credentials, so only methods without auth are called
+    EXPECT_EQ(401, result.second[0].toObject().value("status").toInt());
+    EXPECT_EQ(401, result.second[1].toObject().value("status").toInt());
+    EXPECT_EQ(200, result.second[2].toObject().value("status").toInt());
+    EXPECT_TRUE(result.second[2].toObject().value("body").toObject().contains("health"));
+    EXPECT_EQ(404, result.second[3].toObject().value("status").toInt());
+    EXPECT_EQ(400, result.second[4].toObject().value("status").toInt());
+    EXPECT_EQ(400, result.second[5].toObject().value("status").toInt());
+
+    auto authorizedClient = Proof::RestClientSP::create();
+    authorizedClient->setAuthType(Proof::RestAuthType::Basic);
+    authorizedClient->setUserName("username");
+    authorizedClient->setPassword("password");
+    authorizedClient->setHost("127.0.0.1");
+    authorizedClient->setPort(9091);
+    authorizedClient->setScheme("http");
+    authorizedClient->setClientName("Proof-test");
+    result = post(authorizedClient, batch);
+    EXPECT_EQ(200, result.first);
+    ASSERT_EQ(6, result.second.count());
+    EXPECT_EQ(200, result.second[0].toObject().value("status").toInt());
+    EXPECT_EQ("first", result.second[0].toObject().value("body").toString());
+    EXPECT_EQ(200, result.second[1].toObject().value("status").toInt());
+    EXPECT_EQ(42, result.second[1].toObject().value("body").toObject().value("id").toInt());
+    EXPECT_EQ("text/json", result.second[1].toObject().value("headers").toObject().value("Content-Type").toString());
+
+    EXPECT_EQ(400, post(authorizedClient, "{}").first);
+    restServerUT->setBatchRequestsEnabled(false);
+}
+
 TEST_F(RestServerSystemEndpointsTest, healthStatus)
 {
     ASSERT_TRUE(restServerUT->isListening());
@@ -187,4 +329,106 @@ TEST_F(RestServerSystemEndpointsTest, healthStatus)
         delete reply;
     }
 }
+
+TEST_F(RestServerSystemEndpointsTest, healthStatusCache)
+{
+    ASSERT_TRUE(restServerUT->isListening());
+    EXPECT_EQ(5000, restServerUT->healthStatusCacheTtl());
+    EXPECT_EQ(1000, restServerUT->healthStatusCacheTtl(true));
+
+    auto status = [this](const QString &path) {
+        QNetworkReply *reply = restClientUT->get(path).result();
+        QTime timer;
+        timer.start();
+        while (!reply->isFinished() && timer.elapsed() < 10000)
+            QThread::msleep(5);
+        EXPECT_EQ(200, reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt());
+        const QByteArray answer = reply->readAll();
+        delete reply;
+        return answer;
+    };
+
+    const QByteArray first = status("/system/status");
+    EXPECT_FALSE(first.contains('\n'));
+    EXPECT_TRUE(QJsonDocument::fromJson(first).isObject());
+    EXPECT_EQ(first, status("/system/status"));
+    EXPECT_EQ(1, restServerUT->healthStatusCalls);
+
+    status("/system/status?quick");
+    EXPECT_EQ(2, restServerUT->healthStatusCalls);
+
+    Proof::ErrorNotifier::instance()->notify("error message");
+    QJsonObject obj = QJsonDocument::fromJson(status("/system/status")).object();
+    EXPECT_EQ("error message", obj.value("last_error").toObject().value("message").toString());
+    EXPECT_EQ(2, restServerUT->healthStatusCalls);
+
+    restServerUT->setHealthStatusCacheTtl(0);
+    status("/system/status");
+    status("/system/status");
+    EXPECT_EQ(4, restServerUT->healthStatusCalls);
+}
+
+TEST_F(RestServerSystemEndpointsTest, concurrentHealthStatusRefresh)
+{
+    ASSERT_TRUE(restServerUT->isListening());
+    restServerUT->setHealthStatusCacheTtl(0);
+    restServerUT->healthStatusDelay = 300;
+
+    QVector<QNetworkReply *> replies;
+    for (int i = 0; i < 4; ++i)
+        replies << restClientUT->get("/system/status").result();
+    auto isFinished = [](QNetworkReply *reply) { return reply->isFinished(); };
+    QTime timer;
+    timer.start();
+    while (!std::all_of(replies.cbegin(), replies.cend(), isFinished) && timer.elapsed() < 10000)
+        QThread::msleep(5);
+    for (QNetworkReply *reply : qAsConst(replies)) {
+        ASSERT_TRUE(reply->isFinished());
+        EXPECT_EQ(200, reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt());
+        EXPECT_TRUE(QJsonDocument::fromJson(reply->readAll()).object().contains("health"));
+        delete reply;
+    }
+    //Requests are sent almost at once and wait for the same health status
+    EXPECT_LT(restServerUT->healthStatusCalls, 4);
+}
+
+TEST_F(RestServerSystemEndpointsTest, metrics)
+{
+    ASSERT_TRUE(restServerUT->isListening());
+
+    auto get = [this](const QString &path) -> QNetworkReply * {
+        QNetworkReply *reply = restClientUT->get(path).result();
+        QTime timer;
+        timer.start();
+        while (!reply->isFinished() && timer.elapsed() < 10000)
+            QThread::msleep(5);
+        return reply;
+    };
+
+    QNetworkReply *reply = get("/system/status");
+    ASSERT_TRUE(reply->isFinished());
+    EXPECT_EQ(200, reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt());
+    delete reply;
+
+    reply = get("/system/not-existing");
+    ASSERT_TRUE(reply->isFinished());
+    EXPECT_EQ(404, reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt());
+    delete reply;
+
+    reply = get("/system/metrics");
+    ASSERT_TRUE(reply->isFinished());
+    EXPECT_EQ(200, reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt());
+    const QByteArray answer = reply->readAll();
+    EXPECT_TRUE(answer.contains("# TYPE proof_rest_requests_total counter"));
+    EXPECT_TRUE(answer.contains("proof_rest_requests_total{route=\"rest_get_System_Status\",code=\"2xx\"} 1\n"));
+    EXPECT_TRUE(answer.contains("proof_rest_requests_total{route=\"unmatched\",code=\"4xx\"} 1\n"));
+    EXPECT_TRUE(answer.contains("proof_rest_requests_in_flight{route=\"rest_get_System_Metrics\"} 1\n"));
+    EXPECT_TRUE(answer.contains("proof_rest_phase_duration_seconds_count{route=\"rest_get_System_Status\","
+                                "phase=\"dispatch\"} 1\n"));
+    EXPECT_TRUE(answer.contains("proof_rest_phase_duration_seconds_bucket{route=\"rest_get_System_Status\","
+                                "phase=\"parse\",le=\"+Inf\"} 1\n"));
+    EXPECT_FALSE(answer.contains("rest_get_System_RecentErrors"));
+    delete reply;
+}
+
 #include "abstractrestserver_system_endpoints_test.moc"
@@ -8,13 +8,20 @@
 
 #include "gtest/proof/test_global.h"
 
+#include <QDir>
 #include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QNetworkReply>
+#include <QSharedPointer>
+#include <QTcpSocket>
+#include <QTemporaryFile>
 #include <QTest>
 
+#include <atomic>
+#include <memory>
 #include <tuple>
+#include <vector>
 
 using testing::Test;
 using testing::TestWithParam;
@@ -43,13 +50,42 @@ public slots:
     {
         sendAnswer(socket, __func__, "text/plain", 200, methodVariableParts.join('/') + "|" + queryParams.toString());
     }
+
+    CACHEABLE void rest_get_CachedTestMethod(QTcpSocket *socket, const QStringList &, const QStringList &,
+                                             const QUrlQuery &, const QByteArray &)
+    {
+        sendAnswer(socket, __func__, "text/plain");
+    }
 };
 
 class TestRestServerWithoutAuth : public Proof::AbstractRestServer
 {
     Q_OBJECT
 public:
-    TestRestServerWithoutAuth() : Proof::AbstractRestServer(9092) {}
+    TestRestServerWithoutAuth() : Proof::AbstractRestServer(9092)
+    {
+        route<&TestRestServerWithoutAuth::getOrder>("GET /orders/{id:int}?{verbose:bool}");
+        route<&TestRestServerWithoutAuth::postOrderItem>("POST /orders/{id}/items/{name:string}");
+        route<&TestRestServerWithoutAuth::getAsyncOrder>("GET /async-orders/{id:int}");
+        addExecutorPool("slow", 1, 1);
+        setRouteExecutorPool("rest_get_Slow", "slow");
+    }
+
+    void getOrder(QTcpSocket *socket, int id, std::optional<bool> verbose)
+    {
+        QString verboseString = verbose ? (*verbose ? "true" : "false") : "none";
+        sendAnswer(socket, QStringLiteral("%1|%2").arg(id).arg(verboseString).toUtf8(), "text/plain");
+    }
+
+    void postOrderItem(QTcpSocket *socket, qulonglong id, const QString &name, const QByteArray &body)
+    {
+        sendAnswer(socket, QStringLiteral("%1|%2|").arg(id).arg(name).toUtf8() + body, "text/plain");
+    }
+
+    Proof::Future<Proof::RestResponse> getAsyncOrder(QTcpSocket *, int id)
+    {
+        return Proof::tasks::run([id] { return Proof::RestResponse(QByteArray::number(id), "text/plain"); });
+    }
 
 public slots:
     void rest_get_TestMethod(QTcpSocket *socket, const QStringList &, const QStringList &, const QUrlQuery &,
@@ -101,6 +137,125 @@ public slots:
     {
         sendNotImplemented(socket);
     }
+
+    void rest_get_Compressible(QTcpSocket *socket, const QStringList &, const QStringList &,
+                               const QUrlQuery &query, const QByteArray &)
+    {
+        sendAnswer(socket, QByteArray(query.queryItemValue("size").toInt(), 'a'), "text/plain");
+    }
+
+    CACHEABLE void rest_get_Cached(QTcpSocket *socket, const QStringList &, const QStringList &,
+                                   const QUrlQuery &query, const QByteArray &)
+    {
+        sendAnswer(socket, query.queryItemValue("id").toUtf8() + "|" + QByteArray::number(++cachedCalls),
+                   "text/plain");
+    }
+
+    Proof::Future<Proof::RestResponse> rest_get_Async(QTcpSocket *, const QStringList &, const QStringList &,
+                                                      const QUrlQuery &query, const QByteArray &)
+    {
+        const QByteArray id = query.queryItemValue("id").toUtf8();
+        return Proof::tasks::run([id] {
+            QThread::msleep(100);
+            return Proof::RestResponse(id, "text/plain", {{"ExtraHeader", "async"}}, 201, "Created");
+        });
+    }
+
+    Proof::Future<Proof::RestResponse> rest_get_Async_Failed(QTcpSocket *, const QStringList &, const QStringList &,
+                                                             const QUrlQuery &, const QByteArray &)
+    {
+        return Proof::Future<Proof::RestResponse>::failed(Proof::Failure("Async failure", 0, 0));
+    }
+
+    Proof::CancelableFuture<Proof::RestResponse> rest_get_Async_Hanging(QTcpSocket *, const QStringList &,
+                                                                        const QStringList &, const QUrlQuery &,
+                                                                        const QByteArray &)
+    {
+        Proof::Promise<Proof::RestResponse> promise;
+        promise.future().onFailure([this](const Proof::Failure &) { ++canceledAnswers; });
+        return Proof::CancelableFuture<Proof::RestResponse>(promise);
+    }
+
+    void rest_get_Watched(QTcpSocket *socket, const QStringList &, const QStringList &, const QUrlQuery &,
+                          const QByteArray &)
+    {
+        cancellationToken(socket).canceled().onSuccess([this](bool) { ++canceledTokens; });
+    }
+
+    void rest_get_Slow(QTcpSocket *socket, const QStringList &, const QStringList &, const QUrlQuery &,
+                       const QByteArray &)
+    {
+        if (QThread::currentThread() == socket->thread())
+            slowCalledInWorker = true;
+        ++slowCalls;
+        while (!slowReleased)
+            QThread::msleep(10);
+        sendAnswer(socket, "slow", "text/plain");
+    }
+
+    void rest_get_File(QTcpSocket *socket, const QStringList &, const QStringList &, const QUrlQuery &query,
+                       const QByteArray &)
+    {
+        sendFile(socket, query.queryItemValue("path", QUrl::FullyDecoded), "application/pdf");
+    }
+
+    void rest_get_Chunked(QTcpSocket *socket, const QStringList &, const QStringList &, const QUrlQuery &,
+                          const QByteArray &)
+    {
+        startChunkedAnswer(socket, "text/plain");
+        writeAnswerChunk(socket, "first");
+        writeAnswerChunk(socket, "second");
+        finishChunkedAnswer(socket);
+    }
+
+    void rest_post_Echo(QTcpSocket *socket, const QStringList &, const QStringList &, const QUrlQuery &,
+                        const QByteArray &body)
+    {
+        sendAnswer(socket, body, "application/octet-stream");
+    }
+
+    STREAMING_BODY void rest_post_Upload(QTcpSocket *socket, const QStringList &, const QStringList &,
+                                         const QUrlQuery &, const QByteArray &body)
+    {
+        auto received = QSharedPointer<QByteArray>::create(body);
+        readRequestBody(socket, [this, socket, received](const QByteArray &chunk, bool isLast) {
+            received->append(chunk);
+            if (isLast)
+                sendAnswer(socket, *received, "text/plain");
+            return Proof::Future<bool>::successful(true);
+        });
+    }
+
+public:
+    std::atomic_int cachedCalls{0};
+    std::atomic_int canceledAnswers{0};
+    std::atomic_int canceledTokens{0};
+    std::atomic_int slowCalls{0};
+    std::atomic_bool slowReleased{false};
+    std::atomic_bool slowCalledInWorker{false};
+};
+
+class EpollTestRestServer : public Proof::AbstractRestServer
+{
+    Q_OBJECT
+public:
+    EpollTestRestServer() : Proof::AbstractRestServer(9097)
+    {
+        setIoBackend(Proof::RestServerIoBackend::Epoll);
+    }
+
+public slots:
+    void rest_get_Big(QTcpSocket *socket, const QStringList &, const QStringList &, const QUrlQuery &,
+                      const QByteArray &)
+    {
+        sendAnswer(socket, QByteArray(4 * 1024 * 1024, 'b'), "application/octet-stream");
+    }
+
+    void rest_post_Echo(QTcpSocket *socket, const QStringList &, const QStringList &, const QUrlQuery &,
+                        const QByteArray &body)
+    {
+        sendAnswer(socket, body, "application/octet-stream");
+    }
 };
 
 class RestServerTest : public Test
@@ -253,6 +408,36 @@ TEST_F(RestServerTest, customHeadersSanity)
     EXPECT_EQ(QString(), server->customHeader("OtherSpecialHeader"));
 }
 
+TEST_F(RestServerTest, customHeadersInAnswer)
+{
+    ASSERT_TRUE(restServerWithoutAuthUT->isListening());
+
+    auto request = [this]() -> QNetworkReply * {
+        QNetworkReply *reply = restClientWithoutAuthUT->get("/test-method").result();
+        QTime timer;
+        timer.start();
+        while (!reply->isFinished() && timer.elapsed() < 10000)
+            QThread::msleep(5);
+        return reply;
+    };
+
+    restServerWithoutAuthUT->setCustomHeader("SpecialHeader", "Some Value");
+    QNetworkReply *reply = request();
+    ASSERT_TRUE(reply->isFinished());
+    EXPECT_EQ(200, reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt());
+    EXPECT_EQ("Some Value", reply->rawHeader("SpecialHeader"));
+    EXPECT_TRUE(reply->hasRawHeader("Server"));
+    delete reply;
+
+    restServerWithoutAuthUT->unsetCustomHeader("SpecialHeader");
+    reply = request();
+    ASSERT_TRUE(reply->isFinished());
+    EXPECT_EQ(200, reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt());
+    EXPECT_FALSE(reply->hasRawHeader("SpecialHeader"));
+    EXPECT_EQ("rest_get_TestMethod", QString(reply->readAll()).trimmed());
+    delete reply;
+}
+
 TEST_F(RestServerTest, withoutAuth)
 {
     ASSERT_TRUE(restServerWithoutAuthUT->isListening());
@@ -508,4 +693,904 @@ TEST_F(RestServerTest, notImplementedHttpCode)
     delete reply;
 }
 
+TEST_F(RestServerTest, typedRoutes)
+{
+    ASSERT_TRUE(restServerWithoutAuthUT->isListening());
+
+    auto fetch = [](QNetworkReply *reply) {
+        QTime timer;
+        timer.start();
+        while (!reply->isFinished() && timer.elapsed() < 10000)
+            QThread::msleep(5);
+        EXPECT_TRUE(reply->isFinished());
+        auto result = qMakePair(reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt(),
+                                QString(reply->readAll()).trimmed());
+        delete reply;
+        return result;
+    };
+
+    auto result = fetch(restClientWithoutAuthUT->get("/orders/42").result());
+    EXPECT_EQ(200, result.first);
+    EXPECT_EQ("42|none", result.second);
+
+    QUrlQuery query;
+    query.addQueryItem("verbose", "true");
+    result = fetch(restClientWithoutAuthUT->get("/orders/-3", query).result());
+    EXPECT_EQ(200, result.first);
+    EXPECT_EQ("-3|true", result.second);
+
+    query.clear();
+    query.addQueryItem("verbose", "maybe");
+    EXPECT_EQ(400, fetch(restClientWithoutAuthUT->get("/orders/42", query).result()).first);
+    EXPECT_EQ(404, fetch(restClientWithoutAuthUT->get("/orders/abc").result()).first);
+    EXPECT_EQ(404, fetch(restClientWithoutAuthUT->get("/orders/42/more").result()).first);
+
+    result = fetch(restClientWithoutAuthUT->post("/orders/7/items/name", QUrlQuery(), "body").result());
+    EXPECT_EQ(200, result.first);
+    EXPECT_EQ("7|name|body", result.second);
+    EXPECT_EQ(404, fetch(restClientWithoutAuthUT->post("/orders/-7/items/name", QUrlQuery(), "body").result()).first);
+}
+
+TEST_F(RestServerTest, keepAlivePipelining)
+{
+    ASSERT_TRUE(restServerWithoutAuthUT->isListening());
+
+    QTcpSocket socket;
+    socket.connectToHost("127.0.0.1", 9092);
+    ASSERT_TRUE(socket.waitForConnected(10000));
+    socket.write("GET /test-method HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n"
+                 "GET /test-method-with-custom-header HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+    ASSERT_TRUE(socket.waitForBytesWritten(10000));
+
+    QByteArray received;
+    QTime timer;
+    timer.start();
+    while (received.count("HTTP/1.1 200") < 2 && timer.elapsed() < 10000) {
+        if (socket.waitForReadyRead(100))
+            received += socket.readAll();
+    }
+    EXPECT_EQ(2, received.count("HTTP/1.1 200"));
+    EXPECT_EQ(2, received.count("Connection: keep-alive"));
+    EXPECT_LT(received.indexOf("\r\n\r\nrest_get_TestMethod"),
+              received.indexOf("rest_get_TestMethodWithCustomHeader"));
+    EXPECT_EQ(QAbstractSocket::ConnectedState, socket.state());
+
+    socket.write("GET /test-method HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n");
+    received.clear();
+    timer.start();
+    while (socket.state() == QAbstractSocket::ConnectedState && timer.elapsed() < 10000) {
+        if (socket.waitForReadyRead(100))
+            received += socket.readAll();
+    }
+    received += socket.readAll();
+    EXPECT_TRUE(received.startsWith("HTTP/1.1 200"));
+    EXPECT_TRUE(received.contains("Connection: close"));
+    EXPECT_NE(QAbstractSocket::ConnectedState, socket.state());
+}
+
+TEST_F(RestServerTest, idleSocketsClosing)
+{
+    ASSERT_TRUE(restServerWithoutAuthUT->isListening());
+    const int oldTimeout = restServerWithoutAuthUT->keepAliveTimeout();
+    restServerWithoutAuthUT->setKeepAliveTimeout(400);
+
+    QTcpSocket socket;
+    socket.connectToHost("127.0.0.1", 9092);
+    ASSERT_TRUE(socket.waitForConnected(10000));
+    socket.write("GET /test-method HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+    ASSERT_TRUE(socket.waitForBytesWritten(10000));
+
+    QByteArray received;
+    QTime timer;
+    timer.start();
+    while (!received.contains("rest_get_TestMethod") && timer.elapsed() < 10000) {
+        if (socket.waitForReadyRead(100))
+            received += socket.readAll();
+    }
+    EXPECT_TRUE(received.startsWith("HTTP/1.1 200"));
+    EXPECT_EQ(QAbstractSocket::ConnectedState, socket.state());
+
+    timer.start();
+    while (socket.state() == QAbstractSocket::ConnectedState && timer.elapsed() < 10000)
+        socket.waitForDisconnected(100);
+    EXPECT_NE(QAbstractSocket::ConnectedState, socket.state());
+    EXPECT_GE(timer.elapsed(), 300);
+    EXPECT_LT(timer.elapsed(), 5000);
+
+    restServerWithoutAuthUT->setKeepAliveTimeout(oldTimeout);
+}
+
+TEST_F(RestServerTest, executorPools)
+{
+    ASSERT_TRUE(restServerWithoutAuthUT->isListening());
+    EXPECT_EQ(QStringList{"slow"}, restServerWithoutAuthUT->executorPools());
+    EXPECT_EQ("slow", restServerWithoutAuthUT->routeExecutorPool("rest_get_Slow"));
+    EXPECT_EQ("", restServerWithoutAuthUT->routeExecutorPool("rest_get_TestMethod"));
+
+    auto startRequest = [](QTcpSocket &socket, const QByteArray &path) {
+        socket.connectToHost("127.0.0.1", 9092);
+        ASSERT_TRUE(socket.waitForConnected(10000));
+        socket.write("GET " + path + " HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n");
+        ASSERT_TRUE(socket.waitForBytesWritten(10000));
+    };
+    auto readAnswer = [](QTcpSocket &socket) {
+        QByteArray received;
+        QTime timer;
+        timer.start();
+        while (socket.state() == QAbstractSocket::ConnectedState && timer.elapsed() < 10000) {
+            if (socket.waitForReadyRead(100))
+                received += socket.readAll();
+        }
+        return received + socket.readAll();
+    };
+
+    restServerWithoutAuthUT->slowCalls = 0;
+    restServerWithoutAuthUT->slowReleased = false;
+    QTcpSocket running;
+    startRequest(running, "/slow");
+    QTime timer;
+    timer.start();
+    while (restServerWithoutAuthUT->slowCalls == 0 && timer.elapsed() < 10000)
+        QThread::msleep(10);
+    ASSERT_EQ(1, restServerWithoutAuthUT->slowCalls);
+
+    //Only pool thread is occupied, other routes are still served
+    QTcpSocket fast;
+    startRequest(fast, "/test-method");
+    EXPECT_TRUE(readAnswer(fast).startsWith("HTTP/1.1 200"));
+
+    QTcpSocket queued;
+    startRequest(queued, "/slow");
+    QThread::msleep(100);
+    QTcpSocket rejected;
+    startRequest(rejected, "/slow");
+    EXPECT_TRUE(readAnswer(rejected).startsWith("HTTP/1.1 503"));
+    EXPECT_EQ(1, restServerWithoutAuthUT->slowCalls);
+
+    restServerWithoutAuthUT->slowReleased = true;
+    QByteArray received = readAnswer(running);
+    EXPECT_TRUE(received.startsWith("HTTP/1.1 200"));
+    EXPECT_TRUE(received.endsWith("slow"));
+    received = readAnswer(queued);
+    EXPECT_TRUE(received.startsWith("HTTP/1.1 200"));
+    EXPECT_TRUE(received.endsWith("slow"));
+    EXPECT_EQ(2, restServerWithoutAuthUT->slowCalls);
+    EXPECT_FALSE(restServerWithoutAuthUT->slowCalledInWorker);
+}
+
+TEST_F(RestServerTest, localSocket)
+{
+    const QString socketPath = QDir::temp().absoluteFilePath("proof_rest_server_test.sock");
+    std::unique_ptr<Proof::AbstractRestServer> server(new Proof::AbstractRestServer(0));
+    server->setLocalSocketPath(socketPath);
+    EXPECT_EQ(socketPath, server->localSocketPath());
+    server->startListen();
+    QTime timer;
+    timer.start();
+    while (!server->isListeningLocalSocket() && timer.elapsed() < 10000)
+        QThread::msleep(50);
+    ASSERT_TRUE(server->isListeningLocalSocket());
+    EXPECT_FALSE(server->isListening());
+
+    auto client = Proof::RestClientSP::create();
+    client->setAuthType(Proof::RestAuthType::NoAuth);
+    client->setHost("localhost");
+    client->setScheme("http");
+    client->setLocalSocketPath(socketPath);
+    EXPECT_EQ(socketPath, client->localSocketPath());
+
+    QNetworkReply *reply = client->get("/system/status").result();
+    timer.start();
+    while (!reply->isFinished() && timer.elapsed() < 10000)
+        QThread::msleep(5);
+    ASSERT_TRUE(reply->isFinished());
+    EXPECT_EQ(QNetworkReply::NoError, reply->error());
+    EXPECT_EQ(200, reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt());
+    EXPECT_EQ("text/json", reply->header(QNetworkRequest::ContentTypeHeader).toString());
+    EXPECT_TRUE(QJsonDocument::fromJson(reply->readAll()).isObject());
+    delete reply;
+
+    reply = client->get("/wrong").result();
+    timer.start();
+    while (!reply->isFinished() && timer.elapsed() < 10000)
+        QThread::msleep(5);
+    ASSERT_TRUE(reply->isFinished());
+    EXPECT_EQ(QNetworkReply::ContentNotFoundError, reply->error());
+    EXPECT_EQ(404, reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt());
+    delete reply;
+
+    server->stopListen();
+    EXPECT_FALSE(server->isListeningLocalSocket());
+}
+
+TEST_F(RestServerTest, drain)
+{
+    ASSERT_TRUE(restServerWithoutAuthUT->isListening());
+    EXPECT_FALSE(restServerWithoutAuthUT->isDraining());
+
+    QTcpSocket idle;
+    idle.connectToHost("127.0.0.1", 9092);
+    ASSERT_TRUE(idle.waitForConnected(10000));
+
+    restServerWithoutAuthUT->slowCalls = 0;
+    restServerWithoutAuthUT->slowReleased = false;
+    QTcpSocket busy;
+    busy.connectToHost("127.0.0.1", 9092);
+    ASSERT_TRUE(busy.waitForConnected(10000));
+    busy.write("GET /slow HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+    ASSERT_TRUE(busy.waitForBytesWritten(10000));
+    QTime timer;
+    timer.start();
+    while (restServerWithoutAuthUT->slowCalls == 0 && timer.elapsed() < 10000)
+        QThread::msleep(10);
+    ASSERT_EQ(1, restServerWithoutAuthUT->slowCalls);
+
+    std::atomic_int progressReports{0};
+    auto connection = QObject::connect(restServerWithoutAuthUT, &Proof::AbstractRestServer::drainProgress,
+                                       restServerWithoutAuthUT, [&progressReports](int, int) { ++progressReports; });
+    auto drained = restServerWithoutAuthUT->drain(10000);
+    timer.start();
+    while (restServerWithoutAuthUT->isListening() && timer.elapsed() < 10000)
+        QThread::msleep(10);
+    EXPECT_FALSE(restServerWithoutAuthUT->isListening());
+    EXPECT_TRUE(restServerWithoutAuthUT->isDraining());
+
+    timer.start();
+    while (idle.state() == QAbstractSocket::ConnectedState && timer.elapsed() < 10000)
+        idle.waitForDisconnected(100);
+    EXPECT_NE(QAbstractSocket::ConnectedState, idle.state());
+    EXPECT_FALSE(drained.isCompleted());
+
+    restServerWithoutAuthUT->slowReleased = true;
+    QByteArray received;
+    timer.start();
+    while (busy.state() == QAbstractSocket::ConnectedState && timer.elapsed() < 10000) {
+        if (busy.waitForReadyRead(100))
+            received += busy.readAll();
+    }
+    received += busy.readAll();
+    EXPECT_TRUE(received.startsWith("HTTP/1.1 200"));
+    EXPECT_TRUE(received.endsWith("slow"));
+    EXPECT_NE(QAbstractSocket::ConnectedState, busy.state());
+
+    drained.wait(10000);
+    ASSERT_TRUE(drained.isSucceeded());
+    EXPECT_TRUE(drained.result());
+    EXPECT_LT(0, progressReports);
+    QObject::disconnect(connection);
+
+    restServerWithoutAuthUT->startListen();
+    timer.start();
+    while (!restServerWithoutAuthUT->isListening() && timer.elapsed() < 10000)
+        QThread::msleep(50);
+    ASSERT_TRUE(restServerWithoutAuthUT->isListening());
+    EXPECT_FALSE(restServerWithoutAuthUT->isDraining());
+}
+
+TEST_F(RestServerTest, listeningSocketHandoff)
+{
+    const QString handoffPath = QDir::temp().absoluteFilePath("proof_rest_server_handoff_test.sock");
+    std::unique_ptr<Proof::AbstractRestServer> oldServer(new Proof::AbstractRestServer(9095));
+    oldServer->setHandoffSocketPath(handoffPath);
+    oldServer->setHandoffDrainTimeout(1000);
+    EXPECT_EQ(handoffPath, oldServer->handoffSocketPath());
+    EXPECT_EQ(1000, oldServer->handoffDrainTimeout());
+    std::atomic_bool handedOff{false};
+    QObject::connect(oldServer.get(), &Proof::AbstractRestServer::listeningSocketHandedOff, oldServer.get(),
+                     [&handedOff] { handedOff = true; });
+    oldServer->startListen();
+    QTime timer;
+    timer.start();
+    while (!oldServer->isListening() && timer.elapsed() < 10000)
+        QThread::msleep(50);
+    ASSERT_TRUE(oldServer->isListening());
+
+    std::unique_ptr<Proof::AbstractRestServer> newServer(new Proof::AbstractRestServer(9095));
+    newServer->setHandoffSocketPath(handoffPath);
+    newServer->startListen();
+    timer.start();
+    while ((!newServer->isListening() || !handedOff) && timer.elapsed() < 10000)
+        QThread::msleep(50);
+    ASSERT_TRUE(newServer->isListening());
+    EXPECT_TRUE(handedOff);
+    EXPECT_TRUE(oldServer->isDraining());
+    EXPECT_FALSE(oldServer->isListening());
+
+    QTcpSocket socket;
+    socket.connectToHost("127.0.0.1", 9095);
+    ASSERT_TRUE(socket.waitForConnected(10000));
+    socket.write("GET /system/status HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n");
+    QByteArray received;
+    timer.start();
+    while (socket.state() == QAbstractSocket::ConnectedState && timer.elapsed() < 10000) {
+        if (socket.waitForReadyRead(100))
+            received += socket.readAll();
+    }
+    received += socket.readAll();
+    EXPECT_TRUE(received.startsWith("HTTP/1.1 200"));
+}
+
+TEST_F(RestServerTest, idleWorkersStopping)
+{
+    std::unique_ptr<Proof::AbstractRestServer> server(new Proof::AbstractRestServer(9096));
+    server->setSuggestedMaxThreadsCount(3);
+    server->setIdleWorkerTimeout(400);
+    EXPECT_EQ(400, server->idleWorkerTimeout());
+    EXPECT_EQ(0, server->workerThreadsCount());
+    server->startListen();
+    QTime timer;
+    timer.start();
+    while (!server->isListening() && timer.elapsed() < 10000)
+        QThread::msleep(50);
+    ASSERT_TRUE(server->isListening());
+
+    //Keep-alive connections are kept open, so each new one is given to new worker until limit is reached
+    auto openConnections = [](std::vector<std::unique_ptr<QTcpSocket>> &sockets) {
+        for (int i = 0; i < 3; ++i) {
+            sockets.emplace_back(new QTcpSocket);
+            QTcpSocket *socket = sockets.back().get();
+            socket->connectToHost("127.0.0.1", 9096);
+            ASSERT_TRUE(socket->waitForConnected(10000));
+            socket->write("GET /system/status HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+            QByteArray received;
+            QTime timer;
+            timer.start();
+            while (!received.contains("\"health\"") && timer.elapsed() < 10000) {
+                if (socket->waitForReadyRead(100))
+                    received += socket->readAll();
+            }
+            EXPECT_TRUE(received.startsWith("HTTP/1.1 200"));
+            EXPECT_EQ(QAbstractSocket::ConnectedState, socket->state());
+        }
+    };
+
+    std::vector<std::unique_ptr<QTcpSocket>> sockets;
+    openConnections(sockets);
+    EXPECT_EQ(3, server->workerThreadsCount());
+
+    //Workers with connections are not stopped
+    QThread::msleep(1000);
+    EXPECT_EQ(3, server->workerThreadsCount());
+
+    for (const auto &socket : sockets) {
+        socket->disconnectFromHost();
+        if (socket->state() != QAbstractSocket::UnconnectedState)
+            socket->waitForDisconnected(1000);
+    }
+    sockets.clear();
+    timer.start();
+    while (server->workerThreadsCount() > 1 && timer.elapsed() < 10000)
+        QThread::msleep(50);
+    EXPECT_EQ(1, server->workerThreadsCount());
+    EXPECT_GE(timer.elapsed(), 100);
+
+    openConnections(sockets);
+    EXPECT_EQ(3, server->workerThreadsCount());
+}
+
+#ifdef Q_OS_LINUX
+TEST_F(RestServerTest, epollBackend)
+{
+    std::unique_ptr<EpollTestRestServer> server(new EpollTestRestServer);
+    EXPECT_EQ(Proof::RestServerIoBackend::Epoll, server->ioBackend());
+    server->setCompressionLevel(0);
+    server->startListen();
+    QTime timer;
+    timer.start();
+    while (!server->isListening() && timer.elapsed() < 10000)
+        QThread::msleep(50);
+    ASSERT_TRUE(server->isListening());
+
+    //Pipelined requests, big answer is written by several epoll rounds
+    const QByteArray body(512 * 1024, 'e');
+    QTcpSocket socket;
+    socket.connectToHost("127.0.0.1", 9097);
+    ASSERT_TRUE(socket.waitForConnected(10000));
+    socket.write("GET /big HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n"
+                 "POST /echo HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Length: "
+                 + QByteArray::number(body.size()) + "\r\n\r\n" + body
+                 + "GET /system/status HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n");
+    QByteArray received;
+    timer.start();
+    while (socket.state() == QAbstractSocket::ConnectedState && timer.elapsed() < 10000) {
+        if (socket.waitForReadyRead(100))
+            received += socket.readAll();
+    }
+    received += socket.readAll();
+    EXPECT_NE(QAbstractSocket::ConnectedState, socket.state());
+    EXPECT_TRUE(received.startsWith("HTTP/1.1 200"));
+    EXPECT_TRUE(received.contains("Content-Length: 4194304\r\n"));
+    EXPECT_TRUE(received.contains(QByteArray(4 * 1024 * 1024, 'b') + "HTTP/1.1 200"));
+    EXPECT_TRUE(received.contains("\r\n\r\n" + body + "HTTP/1.1 200"));
+    EXPECT_TRUE(received.contains("\"health\""));
+
+    //Client that disconnects in the middle of answer
+    QTcpSocket droppedSocket;
+    droppedSocket.connectToHost("127.0.0.1", 9097);
+    ASSERT_TRUE(droppedSocket.waitForConnected(10000));
+    droppedSocket.write("GET /big HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+    ASSERT_TRUE(droppedSocket.waitForReadyRead(10000));
+    droppedSocket.abort();
+
+    auto restClient = Proof::RestClientSP::create();
+    restClient->setAuthType(Proof::RestAuthType::NoAuth);
+    restClient->setHost("127.0.0.1");
+    restClient->setPort(9097);
+    restClient->setScheme("http");
+    restClient->setClientName("Proof-test");
+    QNetworkReply *reply = restClient->post("/echo", QUrlQuery(), "echo body").result();
+    timer.start();
+    while (!reply->isFinished() && timer.elapsed() < 10000)
+        QThread::msleep(5);
+    ASSERT_TRUE(reply->isFinished());
+    EXPECT_EQ(200, reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt());
+    EXPECT_EQ("echo body", reply->readAll());
+    delete reply;
+}
+#endif
+
+TEST_F(RestServerTest, admissionControl)
+{
+    ASSERT_TRUE(restServerWithoutAuthUT->isListening());
+    EXPECT_EQ(0, restServerWithoutAuthUT->maxInFlightRequests());
+    restServerWithoutAuthUT->setMaxInFlightRequests(1);
+    EXPECT_EQ(1, restServerWithoutAuthUT->maxInFlightRequests());
+
+    auto request = [](QTcpSocket &socket, const QByteArray &path) {
+        socket.connectToHost("127.0.0.1", 9092);
+        ASSERT_TRUE(socket.waitForConnected(10000));
+        socket.write("GET " + path + " HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+        ASSERT_TRUE(socket.waitForBytesWritten(10000));
+    };
+    auto answer = [](QTcpSocket &socket) {
+        QByteArray received;
+        QTime timer;
+        timer.start();
+        while (!received.contains("\r\n\r\n") && timer.elapsed() < 10000) {
+            if (socket.waitForReadyRead(100))
+                received += socket.readAll();
+        }
+        return received;
+    };
+
+    QTcpSocket slowSocket;
+    request(slowSocket, "/slow/test-method");
+    QThread::msleep(100);
+
+    QTcpSocket rejectedSocket;
+    request(rejectedSocket, "/test-method");
+    QByteArray received = answer(rejectedSocket);
+    EXPECT_TRUE(received.startsWith("HTTP/1.1 503 Service Unavailable\r\n"));
+    EXPECT_TRUE(received.contains("Retry-After: 1\r\n"));
+    EXPECT_TRUE(received.contains("Connection: close\r\n"));
+
+    QTcpSocket statusSocket;
+    request(statusSocket, "/system/status");
+    EXPECT_TRUE(answer(statusSocket).startsWith("HTTP/1.1 200"));
+
+    EXPECT_TRUE(answer(slowSocket).startsWith("HTTP/1.1 200"));
+    restServerWithoutAuthUT->setMaxInFlightRequests(0);
+}
+
+TEST_F(RestServerTest, compression)
+{
+    ASSERT_TRUE(restServerWithoutAuthUT->isListening());
+    EXPECT_EQ(1024, restServerWithoutAuthUT->compressionThreshold());
+    EXPECT_EQ(6, restServerWithoutAuthUT->compressionLevel());
+
+    auto answer = [](const QByteArray &size, const QByteArray &acceptEncoding) {
+        QTcpSocket socket;
+        socket.connectToHost("127.0.0.1", 9092);
+        if (!socket.waitForConnected(10000))
+            return QByteArray();
+        socket.write("GET /compressible?size=" + size + " HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n"
+                     + (acceptEncoding.isEmpty() ? QByteArray() : "Accept-Encoding: " + acceptEncoding + "\r\n")
+                     + "\r\n");
+        QByteArray received;
+        QTime timer;
+        timer.start();
+        while (socket.state() == QAbstractSocket::ConnectedState && timer.elapsed() < 10000) {
+            if (socket.waitForReadyRead(100))
+                received += socket.readAll();
+        }
+        return received + socket.readAll();
+    };
+
+    QByteArray received = answer("100", "gzip");
+    EXPECT_TRUE(received.startsWith("HTTP/1.1 200"));
+    EXPECT_FALSE(received.contains("Content-Encoding"));
+    EXPECT_TRUE(received.endsWith("\r\n\r\n" + QByteArray(100, 'a')));
+
+    received = answer("2000", "");
+    EXPECT_FALSE(received.contains("Content-Encoding"));
+    EXPECT_TRUE(received.contains("Content-Length: 2000\r\n"));
+
+    received = answer("2000", "deflate;q=0.5, gzip");
+    EXPECT_TRUE(received.startsWith("HTTP/1.1 200"));
+    EXPECT_TRUE(received.contains("Content-Encoding: gzip\r\n"));
+    EXPECT_TRUE(received.contains("Vary: Accept-Encoding\r\n"));
+    QByteArray body = received.mid(received.indexOf("\r\n\r\n") + 4);
+    EXPECT_LT(body.size(), 2000);
+    EXPECT_TRUE(received.contains("Content-Length: " + QByteArray::number(body.size()) + "\r\n"));
+
+    //Compressed in thread pool
+    received = answer("1000000", "deflate");
+    EXPECT_TRUE(received.startsWith("HTTP/1.1 200"));
+    EXPECT_TRUE(received.contains("Content-Encoding: deflate\r\n"));
+    body = received.mid(received.indexOf("\r\n\r\n") + 4);
+    EXPECT_LT(body.size(), 1000000);
+    EXPECT_TRUE(received.contains("Content-Length: " + QByteArray::number(body.size()) + "\r\n"));
+
+    restServerWithoutAuthUT->setCompressionLevel(0);
+    received = answer("2000", "gzip");
+    EXPECT_FALSE(received.contains("Content-Encoding"));
+    restServerWithoutAuthUT->setCompressionLevel(6);
+}
+
+TEST_F(RestServerTest, responseCache)
+{
+    ASSERT_TRUE(restServerWithoutAuthUT->isListening());
+    EXPECT_EQ(60000, restServerWithoutAuthUT->responseCacheTtl());
+
+    auto answer = [](int port, const QByteArray &path, const QByteArray &extraHeaders = QByteArray()) {
+        QTcpSocket socket;
+        socket.connectToHost("127.0.0.1", port);
+        if (!socket.waitForConnected(10000))
+            return QByteArray();
+        socket.write("GET " + path + " HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n" + extraHeaders + "\r\n");
+        QByteArray received;
+        QTime timer;
+        timer.start();
+        while (socket.state() == QAbstractSocket::ConnectedState && timer.elapsed() < 10000) {
+            if (socket.waitForReadyRead(100))
+                received += socket.readAll();
+        }
+        return received + socket.readAll();
+    };
+    auto etag = [](const QByteArray &received) {
+        const int start = received.indexOf("ETag: ");
+        return start < 0 ? QByteArray() : received.mid(start + 6, received.indexOf("\r\n", start) - start - 6);
+    };
+
+    restServerWithoutAuthUT->cachedCalls = 0;
+    QByteArray received = answer(9092, "/cached?id=1");
+    EXPECT_TRUE(received.startsWith("HTTP/1.1 200"));
+    EXPECT_TRUE(received.endsWith("\r\n\r\n1|1"));
+    const QByteArray firstEtag = etag(received);
+    EXPECT_FALSE(firstEtag.isEmpty());
+
+    received = answer(9092, "/cached?id=1");
+    EXPECT_TRUE(received.endsWith("\r\n\r\n1|1"));
+    EXPECT_EQ(firstEtag, etag(received));
+    EXPECT_EQ(1, restServerWithoutAuthUT->cachedCalls);
+
+    received = answer(9092, "/cached?id=2");
+    EXPECT_TRUE(received.endsWith("\r\n\r\n2|2"));
+    EXPECT_NE(firstEtag, etag(received));
+
+    received = answer(9092, "/cached?id=1", "If-None-Match: " + firstEtag + "\r\n");
+    EXPECT_TRUE(received.startsWith("HTTP/1.1 304 Not Modified\r\n"));
+    EXPECT_TRUE(received.endsWith("\r\n\r\n"));
+    EXPECT_FALSE(received.contains("Content-Length"));
+    EXPECT_EQ(firstEtag, etag(received));
+    EXPECT_EQ(2, restServerWithoutAuthUT->cachedCalls);
+
+    restServerWithoutAuthUT->invalidateResponseCache("rest_get_Cached");
+    received = answer(9092, "/cached?id=1", "If-None-Match: " + firstEtag + "\r\n");
+    EXPECT_TRUE(received.startsWith("HTTP/1.1 200"));
+    EXPECT_TRUE(received.endsWith("\r\n\r\n1|3"));
+
+    restServerWithoutAuthUT->setResponseCacheTtl(50);
+    restServerWithoutAuthUT->invalidateResponseCache();
+    EXPECT_TRUE(answer(9092, "/cached?id=1").endsWith("\r\n\r\n1|4"));
+    QThread::msleep(100);
+    EXPECT_TRUE(answer(9092, "/cached?id=1").endsWith("\r\n\r\n1|5"));
+    restServerWithoutAuthUT->setResponseCacheTtl(60000);
+
+    //Cached answers are still protected by auth
+    const QByteArray authorization = "Authorization: Basic " + QByteArray("username:password").toBase64() + "\r\n";
+    EXPECT_TRUE(answer(9091, "/cached-test-method", authorization).startsWith("HTTP/1.1 200"));
+    EXPECT_TRUE(answer(9091, "/cached-test-method").startsWith("HTTP/1.1 401"));
+    EXPECT_TRUE(answer(9091, "/cached-test-method", authorization).startsWith("HTTP/1.1 200"));
+}
+
+TEST_F(RestServerTest, asyncAnswer)
+{
+    ASSERT_TRUE(restServerWithoutAuthUT->isListening());
+
+    auto answer = [](const QByteArray &path) {
+        QTcpSocket socket;
+        socket.connectToHost("127.0.0.1", 9092);
+        if (!socket.waitForConnected(10000))
+            return QByteArray();
+        socket.write("GET " + path + " HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n");
+        QByteArray received;
+        QTime timer;
+        timer.start();
+        while (socket.state() == QAbstractSocket::ConnectedState && timer.elapsed() < 10000) {
+            if (socket.waitForReadyRead(100))
+                received += socket.readAll();
+        }
+        return received + socket.readAll();
+    };
+
+    QByteArray received = answer("/async?id=42");
+    EXPECT_TRUE(received.startsWith("HTTP/1.1 201 Created\r\n"));
+    EXPECT_TRUE(received.contains("ExtraHeader: async\r\n"));
+    EXPECT_TRUE(received.endsWith("\r\n\r\n42"));
+
+    received = answer("/async/failed");
+    EXPECT_TRUE(received.startsWith("HTTP/1.1 500 Internal Server Error\r\n"));
+
+    received = answer("/async-orders/7");
+    EXPECT_TRUE(received.startsWith("HTTP/1.1 200"));
+    EXPECT_TRUE(received.endsWith("\r\n\r\n7"));
+
+    //Async answer doesn't block other sockets of the same worker
+    restServerWithoutAuthUT->canceledAnswers = 0;
+    {
+        QTcpSocket hangingSocket;
+        hangingSocket.connectToHost("127.0.0.1", 9092);
+        ASSERT_TRUE(hangingSocket.waitForConnected(10000));
+        hangingSocket.write("GET /async/hanging HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+        ASSERT_TRUE(hangingSocket.waitForBytesWritten(10000));
+        EXPECT_TRUE(answer("/test-method").startsWith("HTTP/1.1 200"));
+        EXPECT_EQ(0, restServerWithoutAuthUT->canceledAnswers);
+        hangingSocket.disconnectFromHost();
+    }
+    QTime timer;
+    timer.start();
+    while (restServerWithoutAuthUT->canceledAnswers == 0 && timer.elapsed() < 10000)
+        QThread::msleep(50);
+    EXPECT_EQ(1, restServerWithoutAuthUT->canceledAnswers);
+}
+
+TEST_F(RestServerTest, requestDeadline)
+{
+    ASSERT_TRUE(restServerWithoutAuthUT->isListening());
+    EXPECT_EQ(0, restServerWithoutAuthUT->requestTimeout());
+
+    auto answer = [](const QByteArray &request) {
+        QTcpSocket socket;
+        socket.connectToHost("127.0.0.1", 9092);
+        if (!socket.waitForConnected(10000))
+            return QByteArray();
+        socket.write(request);
+        QByteArray received;
+        QTime timer;
+        timer.start();
+        while (socket.state() == QAbstractSocket::ConnectedState && timer.elapsed() < 10000) {
+            if (socket.waitForReadyRead(100))
+                received += socket.readAll();
+        }
+        return received + socket.readAll();
+    };
+
+    restServerWithoutAuthUT->canceledAnswers = 0;
+    restServerWithoutAuthUT->canceledTokens = 0;
+    QTime timer;
+    timer.start();
+    QByteArray received = answer("GET /async/hanging HTTP/1.1\r\nHost: 127.0.0.1\r\nX-Request-Timeout: 200\r\n\r\n");
+    EXPECT_LT(timer.elapsed(), 5000);
+    EXPECT_TRUE(received.startsWith("HTTP/1.1 504 Gateway Timeout\r\n"));
+    EXPECT_TRUE(received.contains("Connection: close\r\n"));
+    timer.start();
+    while (restServerWithoutAuthUT->canceledAnswers == 0 && timer.elapsed() < 10000)
+        QThread::msleep(50);
+    EXPECT_EQ(1, restServerWithoutAuthUT->canceledAnswers);
+
+    {
+        QTcpSocket watchedSocket;
+        watchedSocket.connectToHost("127.0.0.1", 9092);
+        ASSERT_TRUE(watchedSocket.waitForConnected(10000));
+        watchedSocket.write("GET /watched HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+        ASSERT_TRUE(watchedSocket.waitForBytesWritten(10000));
+        QThread::msleep(100);
+        EXPECT_EQ(0, restServerWithoutAuthUT->canceledTokens);
+        watchedSocket.disconnectFromHost();
+    }
+    timer.start();
+    while (restServerWithoutAuthUT->canceledTokens == 0 && timer.elapsed() < 10000)
+        QThread::msleep(50);
+    EXPECT_EQ(1, restServerWithoutAuthUT->canceledTokens);
+
+    restServerWithoutAuthUT->setRequestTimeout(200);
+    received = answer("GET /watched HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+    EXPECT_TRUE(received.startsWith("HTTP/1.1 504 Gateway Timeout\r\n"));
+    timer.start();
+    while (restServerWithoutAuthUT->canceledTokens < 2 && timer.elapsed() < 10000)
+        QThread::msleep(50);
+    EXPECT_EQ(2, restServerWithoutAuthUT->canceledTokens);
+
+    //Answered requests don't cancel their tokens
+    EXPECT_TRUE(answer("GET /test-method HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n")
+                    .startsWith("HTTP/1.1 200"));
+    restServerWithoutAuthUT->setRequestTimeout(0);
+}
+
+TEST_F(RestServerTest, batchCancellation)
+{
+    ASSERT_TRUE(restServerWithoutAuthUT->isListening());
+    restServerWithoutAuthUT->setBatchRequestsEnabled(true);
+    restServerWithoutAuthUT->canceledAnswers = 0;
+    const QByteArray body = R"([{"path": "/async/hanging"}, {"path": "/async/hanging"}])";
+    {
+        QTcpSocket batchSocket;
+        batchSocket.connectToHost("127.0.0.1", 9092);
+        ASSERT_TRUE(batchSocket.waitForConnected(10000));
+        batchSocket.write("POST /system/batch HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Type: application/json\r\n"
+                          "Content-Length: "
+                          + QByteArray::number(body.size()) + "\r\n\r\n" + body);
+        ASSERT_TRUE(batchSocket.waitForBytesWritten(10000));
+        QThread::msleep(200);
+        EXPECT_EQ(0, restServerWithoutAuthUT->canceledAnswers);
+        batchSocket.disconnectFromHost();
+    }
+    //Items are canceled with batch request, not left hanging in workers
+    QTime timer;
+    timer.start();
+    while (restServerWithoutAuthUT->canceledAnswers < 2 && timer.elapsed() < 10000)
+        QThread::msleep(50);
+    EXPECT_EQ(2, restServerWithoutAuthUT->canceledAnswers);
+    restServerWithoutAuthUT->setBatchRequestsEnabled(false);
+}
+
+TEST_F(RestServerTest, sendFile)
+{
+    ASSERT_TRUE(restServerWithoutAuthUT->isListening());
+
+    QByteArray content;
+    for (int i = 0; i < 300000; ++i)
+        content += QByteArray::number(i % 10) + "abcdefghi";
+    QTemporaryFile file;
+    ASSERT_TRUE(file.open());
+    ASSERT_EQ(content.size(), file.write(content));
+    file.flush();
+    const QByteArray path = "/file?path=" + QUrl::toPercentEncoding(file.fileName());
+
+    auto answer = [](const QByteArray &path, const QByteArray &extraHeaders = QByteArray()) {
+        QTcpSocket socket;
+        socket.connectToHost("127.0.0.1", 9092);
+        if (!socket.waitForConnected(10000))
+            return QByteArray();
+        socket.write("GET " + path + " HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n" + extraHeaders + "\r\n");
+        QByteArray received;
+        QTime timer;
+        timer.start();
+        while (socket.state() == QAbstractSocket::ConnectedState && timer.elapsed() < 10000) {
+            if (socket.waitForReadyRead(100))
+                received += socket.readAll();
+        }
+        return received + socket.readAll();
+    };
+    auto header = [](const QByteArray &received, const QByteArray &name) {
+        const int start = received.indexOf("\r\n" + name + ": ");
+        if (start < 0)
+            return QByteArray();
+        const int valueStart = start + name.size() + 4;
+        return received.mid(valueStart, received.indexOf("\r\n", valueStart) - valueStart);
+    };
+    auto body = [](const QByteArray &received) { return received.mid(received.indexOf("\r\n\r\n") + 4); };
+
+    QByteArray received = answer(path);
+    EXPECT_TRUE(received.startsWith("HTTP/1.1 200"));
+    EXPECT_EQ("application/pdf", header(received, "Content-Type"));
+    EXPECT_EQ(QByteArray::number(content.size()), header(received, "Content-Length"));
+    EXPECT_EQ("bytes", header(received, "Accept-Ranges"));
+    const QByteArray etag = header(received, "ETag");
+    const QByteArray lastModified = header(received, "Last-Modified");
+    EXPECT_FALSE(etag.isEmpty());
+    EXPECT_TRUE(lastModified.endsWith(" GMT"));
+    EXPECT_EQ(content, body(received));
+
+    received = answer(path, "Range: bytes=10-19\r\n");
+    EXPECT_TRUE(received.startsWith("HTTP/1.1 206 Partial Content\r\n"));
+    EXPECT_EQ("bytes 10-19/" + QByteArray::number(content.size()), header(received, "Content-Range"));
+    EXPECT_EQ(content.mid(10, 10), body(received));
+
+    received = answer(path, "Range: bytes=-5\r\n");
+    EXPECT_TRUE(received.startsWith("HTTP/1.1 206"));
+    EXPECT_EQ(content.right(5), body(received));
+
+    received = answer(path, "Range: bytes=2000000-\r\nIf-Range: " + etag + "\r\n");
+    EXPECT_TRUE(received.startsWith("HTTP/1.1 206"));
+    EXPECT_EQ(content.mid(2000000), body(received));
+
+    received = answer(path, "Range: bytes=10-19\r\nIf-Range: \"outdated\"\r\n");
+    EXPECT_TRUE(received.startsWith("HTTP/1.1 200"));
+    EXPECT_EQ(content, body(received));
+
+    received = answer(path, "Range: bytes=" + QByteArray::number(content.size()) + "-\r\n");
+    EXPECT_TRUE(received.startsWith("HTTP/1.1 416"));
+    EXPECT_EQ("bytes */" + QByteArray::number(content.size()), header(received, "Content-Range"));
+
+    received = answer(path, "If-None-Match: " + etag + "\r\n");
+    EXPECT_TRUE(received.startsWith("HTTP/1.1 304"));
+    EXPECT_TRUE(received.endsWith("\r\n\r\n"));
+
+    received = answer(path, "If-Modified-Since: " + lastModified + "\r\n");
+    EXPECT_TRUE(received.startsWith("HTTP/1.1 304"));
+
+    received = answer("/file?path=" + QUrl::toPercentEncoding(file.fileName() + "_missing"));
+    EXPECT_TRUE(received.startsWith("HTTP/1.1 404"));
+}
+
+TEST_F(RestServerTest, streamingBody)
+{
+    ASSERT_TRUE(restServerWithoutAuthUT->isListening());
+
+    QTcpSocket socket;
+    socket.connectToHost("127.0.0.1", 9092);
+    ASSERT_TRUE(socket.waitForConnected(10000));
+    socket.write("POST /upload HTTP/1.1\r\nHost: 127.0.0.1\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhello\r\n");
+    ASSERT_TRUE(socket.waitForBytesWritten(10000));
+    QThread::msleep(100);
+    socket.write("6\r\n world\r\n0\r\n\r\nGET /test-method HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+    ASSERT_TRUE(socket.waitForBytesWritten(10000));
+
+    QByteArray received;
+    QTime timer;
+    timer.start();
+    while (received.count("HTTP/1.1 200") < 2 && timer.elapsed() < 10000) {
+        if (socket.waitForReadyRead(100))
+            received += socket.readAll();
+    }
+    EXPECT_EQ(2, received.count("HTTP/1.1 200"));
+    EXPECT_TRUE(received.contains("Content-Length: 11\r\n"));
+    EXPECT_LT(received.indexOf("\r\n\r\nhello world"), received.indexOf("rest_get_TestMethod"));
+}
+
+TEST_F(RestServerTest, spilledBody)
+{
+    ASSERT_TRUE(restServerWithoutAuthUT->isListening());
+    restServerWithoutAuthUT->setRequestBodySpillThreshold(1024);
+    EXPECT_EQ(1024, restServerWithoutAuthUT->requestBodySpillThreshold());
+
+    QByteArray body;
+    for (int i = 0; i < 10000; ++i)
+        body += QByteArray::number(i);
+
+    QTcpSocket socket;
+    socket.connectToHost("127.0.0.1", 9092);
+    ASSERT_TRUE(socket.waitForConnected(10000));
+    socket.write(QByteArrayLiteral("POST /echo HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Length: ")
+                 + QByteArray::number(body.size()) + "\r\n\r\n" + body
+                 + "GET /test-method HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+    ASSERT_TRUE(socket.waitForBytesWritten(10000));
+
+    QByteArray received;
+    QTime timer;
+    timer.start();
+    while (received.count("HTTP/1.1 200") < 2 && timer.elapsed() < 10000) {
+        if (socket.waitForReadyRead(100))
+            received += socket.readAll();
+    }
+    EXPECT_EQ(2, received.count("HTTP/1.1 200"));
+    EXPECT_TRUE(received.contains("\r\n\r\n" + body + "HTTP/1.1 200"));
+    EXPECT_TRUE(received.contains("rest_get_TestMethod"));
+}
+
+TEST_F(RestServerTest, chunkedAnswer)
+{
+    ASSERT_TRUE(restServerWithoutAuthUT->isListening());
+
+    QTcpSocket socket;
+    socket.connectToHost("127.0.0.1", 9092);
+    ASSERT_TRUE(socket.waitForConnected(10000));
+    socket.write("GET /chunked HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n"
+                 "GET /test-method HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+    ASSERT_TRUE(socket.waitForBytesWritten(10000));
+
+    QByteArray received;
+    QTime timer;
+    timer.start();
+    while (received.count("HTTP/1.1 200") < 2 && timer.elapsed() < 10000) {
+        if (socket.waitForReadyRead(100))
+            received += socket.readAll();
+    }
+    EXPECT_EQ(2, received.count("HTTP/1.1 200"));
+    EXPECT_TRUE(received.contains("Transfer-Encoding: chunked\r\n"));
+    EXPECT_TRUE(received.contains("\r\n\r\n5\r\nfirst\r\n6\r\nsecond\r\n0\r\n\r\nHTTP/1.1 200"));
+}
+
 #include "abstractrestserver_test.moc"
@@ -0,0 +1,68 @@
+// clazy:skip
+
+#include "proofnetwork/epollsocket_p.h"
+
+#include "gtest/proof/test_global.h"
+
+#include <QCoreApplication>
+#include <QTime>
+
+#ifdef Q_OS_LINUX
+#    include <sys/socket.h>
+#    include <unistd.h>
+
+using namespace Proof;
+
+TEST(EpollSocketTest, readyReadHandler)
+{
+    int descriptors[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, descriptors));
+    EpollPoller poller;
+    ASSERT_TRUE(poller.isValid());
+    QByteArray received;
+    poller.setReadyReadHandler([&received](EpollSocket *socket) { received += socket->readAll(); });
+    EpollSocket socket(&poller);
+    ASSERT_TRUE(socket.setDescriptor(descriptors[0]));
+    int readyReadCount = 0;
+    QObject::connect(&socket, &QTcpSocket::readyRead, [&readyReadCount] { ++readyReadCount; });
+
+    ASSERT_EQ(4, ::write(descriptors[1], "data", 4));
+    QTime timer;
+    timer.start();
+    while (received.isEmpty() && timer.elapsed() < 10000)
+        QCoreApplication::processEvents();
+    EXPECT_EQ("data", received);
+    EXPECT_EQ(0, readyReadCount);
+    ::close(descriptors[1]);
+}
+
+TEST(EpollSocketTest, abortDropsPendingData)
+{
+    int descriptors[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, descriptors));
+    EpollPoller poller;
+    EpollSocket socket(&poller);
+    ASSERT_TRUE(socket.setDescriptor(descriptors[0]));
+    int disconnectedCount = 0;
+    QObject::connect(&socket, &QTcpSocket::disconnected, [&disconnectedCount] { ++disconnectedCount; });
+
+    //Peer doesn't read, so most of it stays in socket buffer
+    const QByteArray data(8 * 1024 * 1024, 'a');
+    EXPECT_EQ(data.size(), socket.write(data));
+    ASSERT_GT(socket.bytesToWrite(), 0);
+    socket.abort();
+    EXPECT_EQ(QAbstractSocket::UnconnectedState, socket.state());
+    EXPECT_EQ(0, socket.bytesToWrite());
+    EXPECT_EQ(1, disconnectedCount);
+
+    //Descriptor is closed right away, peer gets only what was in kernel buffer
+    qint64 total = 0;
+    char buffer[64 * 1024];
+    ssize_t result = 0;
+    while ((result = ::read(descriptors[1], buffer, sizeof(buffer))) > 0)
+        total += result;
+    EXPECT_EQ(0, result);
+    EXPECT_LT(total, data.size());
+    ::close(descriptors[1]);
+}
+#endif
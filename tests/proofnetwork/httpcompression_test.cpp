@@ -0,0 +1,59 @@
+// clazy:skip
+
+#include "proofnetwork/httpcompression_p.h"
+
+#include "gtest/proof/test_global.h"
+
+#include <QtEndian>
+
+using namespace Proof;
+
+TEST(HttpCompressionTest, negotiate)
+{
+    using Encoding = HttpCompression::Encoding;
+    EXPECT_EQ(Encoding::Identity, HttpCompression::negotiate(""));
+    EXPECT_EQ(Encoding::Identity, HttpCompression::negotiate("identity"));
+    EXPECT_EQ(Encoding::Identity, HttpCompression::negotiate("br"));
+    EXPECT_EQ(Encoding::Gzip, HttpCompression::negotiate("gzip"));
+    EXPECT_EQ(Encoding::Gzip, HttpCompression::negotiate("GZip"));
+    EXPECT_EQ(Encoding::Gzip, HttpCompression::negotiate("deflate, gzip"));
+    EXPECT_EQ(Encoding::Gzip, HttpCompression::negotiate("*"));
+    EXPECT_EQ(Encoding::Deflate, HttpCompression::negotiate("deflate"));
+    EXPECT_EQ(Encoding::Deflate, HttpCompression::negotiate("gzip;q=0.5, deflate"));
+    EXPECT_EQ(Encoding::Deflate, HttpCompression::negotiate("gzip; q=0, *"));
+    EXPECT_EQ(Encoding::Identity, HttpCompression::negotiate("gzip;q=0, deflate;Q=0"));
+    EXPECT_EQ(Encoding::Identity, HttpCompression::negotiate("*;q=0"));
+}
+
+TEST(HttpCompressionTest, isCompressible)
+{
+    EXPECT_TRUE(HttpCompression::isCompressible("application/json"));
+    EXPECT_TRUE(HttpCompression::isCompressible("text/plain; charset=utf-8"));
+    EXPECT_TRUE(HttpCompression::isCompressible("image/svg+xml"));
+    EXPECT_FALSE(HttpCompression::isCompressible("image/png"));
+    EXPECT_FALSE(HttpCompression::isCompressible("application/zip"));
+    EXPECT_FALSE(HttpCompression::isCompressible("application/octet-stream"));
+}
+
+TEST(HttpCompressionTest, compress)
+{
+    QByteArray data;
+    for (int i = 0; i < 1000; ++i)
+        data += "some repeated text " + QByteArray::number(i % 10);
+
+    EXPECT_EQ(data, HttpCompression::compress(data, HttpCompression::Encoding::Identity, 6));
+
+    QByteArray gzipped = HttpCompression::compress(data, HttpCompression::Encoding::Gzip, 6);
+    ASSERT_GT(gzipped.size(), 2);
+    EXPECT_LT(gzipped.size(), data.size());
+    EXPECT_EQ('\x1f', gzipped[0]);
+    EXPECT_EQ('\x8b', gzipped[1]);
+
+    QByteArray deflated = HttpCompression::compress(data, HttpCompression::Encoding::Deflate, 9);
+    ASSERT_FALSE(deflated.isEmpty());
+    EXPECT_LT(deflated.size(), data.size());
+    //qUncompress expects zlib stream prefixed with big endian size of uncompressed data
+    QByteArray prefixed(4, '\0');
+    qToBigEndian<quint32>(static_cast<quint32>(data.size()), prefixed.data());
+    EXPECT_EQ(data, qUncompress(prefixed + deflated));
+}
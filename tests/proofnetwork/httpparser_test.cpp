@@ -0,0 +1,209 @@
+// clazy:skip
+
+#include "proofnetwork/httpparser_p.h"
+
+#include "gtest/proof/test_global.h"
+
+#include <QTemporaryFile>
+
+using namespace Proof;
+
+static HttpParser::Result parseFully(HttpParser &parser, const QByteArray &data)
+{
+    HttpParser::Result result = parser.parseNextPart(data);
+    if (result == HttpParser::Result::HeadersReady)
+        result = parser.parseNextPart(QByteArray());
+    return result;
+}
+
+TEST(HttpParserTest, simpleRequest)
+{
+    HttpParser parser;
+    ASSERT_EQ(HttpParser::Result::Success,
+              parser.parseNextPart("GET /some/path?a=b HTTP/1.1\r\nHost: localhost\r\nX-Custom:  value \r\n\r\n"));
+    EXPECT_EQ("GET", parser.method());
+    EXPECT_EQ("/some/path?a=b", parser.uri());
+    EXPECT_EQ((QStringList{"Host: localhost", "X-Custom: value"}), parser.headers());
+    EXPECT_EQ("value", parser.header("x-custom"));
+    EXPECT_TRUE(parser.header(HttpParser::Header::Authorization).isNull());
+    EXPECT_TRUE(parser.body().isEmpty());
+    EXPECT_TRUE(parser.keepAlive());
+}
+
+TEST(HttpParserTest, splittedRequest)
+{
+    HttpParser parser;
+    const QByteArray request = "POST /path HTTP/1.1\r\nauthorization: Basic abc\r\nContent-Length: 5\r\n\r\nhello";
+    const int headEnd = request.indexOf("\r\n\r\n") + 3;
+    for (int i = 0; i < request.size() - 1; ++i) {
+        ASSERT_EQ(i == headEnd ? HttpParser::Result::HeadersReady : HttpParser::Result::NeedMore,
+                  parser.parseNextPart(request.mid(i, 1)))
+            << i;
+    }
+    ASSERT_EQ(HttpParser::Result::Success, parser.parseNextPart(request.right(1)));
+    EXPECT_EQ("POST", parser.method());
+    EXPECT_EQ("/path", parser.uri());
+    EXPECT_EQ("Basic abc", parser.header(HttpParser::Header::Authorization));
+    EXPECT_EQ("hello", parser.body());
+}
+
+TEST(HttpParserTest, pipelinedRequests)
+{
+    HttpParser parser;
+    ASSERT_EQ(HttpParser::Result::Success,
+              parseFully(parser, "POST /first HTTP/1.1\r\nContent-Length: 3\r\n\r\nabcGET /second HTTP/1.0\r\n"));
+    EXPECT_EQ("/first", parser.uri());
+    EXPECT_EQ("abc", parser.body());
+    parser.reset();
+    EXPECT_TRUE(parser.hasPendingData());
+    ASSERT_EQ(HttpParser::Result::NeedMore, parser.parseNextPart(QByteArray()));
+    ASSERT_EQ(HttpParser::Result::Success, parser.parseNextPart("Connection: Keep-Alive\r\n\r\n"));
+    EXPECT_EQ("GET", parser.method());
+    EXPECT_EQ("/second", parser.uri());
+    EXPECT_TRUE(parser.keepAlive());
+    parser.reset();
+    EXPECT_FALSE(parser.hasPendingData());
+}
+
+TEST(HttpParserTest, connectionClose)
+{
+    HttpParser parser;
+    ASSERT_EQ(HttpParser::Result::Success,
+              parser.parseNextPart("GET / HTTP/1.1\r\nConnection: TE, close\r\n\r\n"));
+    EXPECT_FALSE(parser.keepAlive());
+    parser.reset();
+    ASSERT_EQ(HttpParser::Result::Success, parser.parseNextPart("GET / HTTP/1.0\r\n\r\n"));
+    EXPECT_FALSE(parser.keepAlive());
+}
+
+TEST(HttpParserTest, invalidRequests)
+{
+    EXPECT_EQ(HttpParser::Result::Error, HttpParser().parseNextPart("GET /\r\n"));
+    EXPECT_EQ(HttpParser::Result::Error, HttpParser().parseNextPart("GET / HTTP/2.0\r\n"));
+    EXPECT_EQ(HttpParser::Result::Error, HttpParser().parseNextPart("GET / HTTP/1.1\r\nBad header\r\n"));
+    EXPECT_EQ(HttpParser::Result::Error, HttpParser().parseNextPart("GET / HTTP/1.1\r\nContent-Length: abc\r\n\r\n"));
+    EXPECT_EQ(HttpParser::Result::Error, HttpParser().parseNextPart(QByteArray(70 * 1024, 'a')));
+}
+
+TEST(HttpParserTest, chunkedBody)
+{
+    HttpParser parser;
+    ASSERT_EQ(HttpParser::Result::HeadersReady,
+              parser.parseNextPart("POST /upload HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhel"));
+    ASSERT_EQ(HttpParser::Result::NeedMore, parser.parseNextPart("lo\r\n6;name=value\r\n world\r\n0\r\n"));
+    ASSERT_EQ(HttpParser::Result::Success, parser.parseNextPart("Checksum: 42\r\n\r\nGET"));
+    EXPECT_EQ("hello world", parser.body());
+    EXPECT_EQ("42", parser.header("checksum"));
+    EXPECT_TRUE(parser.headers().contains("Checksum: 42"));
+    parser.reset();
+    EXPECT_TRUE(parser.hasPendingData());
+}
+
+TEST(HttpParserTest, chunkedBodyErrors)
+{
+    {
+        HttpParser parser;
+        EXPECT_EQ(HttpParser::Result::Error,
+                  parseFully(parser, "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\nxyz\r\n"));
+        EXPECT_EQ(400, parser.errorHttpCode());
+    }
+    {
+        HttpParser parser;
+        EXPECT_EQ(HttpParser::Result::Error,
+                  parseFully(parser, "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n2\r\nabc\r\n"));
+        EXPECT_EQ(400, parser.errorHttpCode());
+    }
+    {
+        HttpParser parser;
+        EXPECT_EQ(HttpParser::Result::Error,
+                  parser.parseNextPart("POST / HTTP/1.1\r\nTransfer-Encoding: gzip\r\n\r\n"));
+        EXPECT_EQ(501, parser.errorHttpCode());
+    }
+    {
+        HttpParser parser;
+        parser.setMaxBodySize(8);
+        EXPECT_EQ(HttpParser::Result::Error,
+                  parseFully(parser, "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhello\r\n5\r\n"));
+        EXPECT_EQ(413, parser.errorHttpCode());
+    }
+    {
+        HttpParser parser;
+        parser.setMaxBodySize(8);
+        EXPECT_EQ(HttpParser::Result::Error, parser.parseNextPart("POST / HTTP/1.1\r\nContent-Length: 9\r\n\r\n"));
+        EXPECT_EQ(413, parser.errorHttpCode());
+    }
+}
+
+TEST(HttpParserTest, takeBody)
+{
+    HttpParser parser;
+    ASSERT_EQ(HttpParser::Result::HeadersReady,
+              parser.parseNextPart("PUT /file HTTP/1.1\r\nContent-Length: 10\r\nExpect: 100-continue\r\n\r\n01"));
+    EXPECT_EQ("100-continue", parser.header(HttpParser::Header::Expect));
+    ASSERT_EQ(HttpParser::Result::NeedMore, parser.parseNextPart("234"));
+    EXPECT_EQ("01234", parser.takeBody());
+    EXPECT_TRUE(parser.takeBody().isEmpty());
+    ASSERT_EQ(HttpParser::Result::Success, parser.parseNextPart("56789GET / HTTP/1.1\r\n\r\n"));
+    EXPECT_EQ("56789", parser.takeBody());
+    parser.reset();
+    ASSERT_EQ(HttpParser::Result::Success, parser.parseNextPart(QByteArray()));
+    EXPECT_EQ("GET", parser.method());
+}
+
+TEST(HttpParserTest, takeChunkedBodyOverLimit)
+{
+    HttpParser parser;
+    parser.setMaxBodySize(8);
+    ASSERT_EQ(HttpParser::Result::HeadersReady,
+              parser.parseNextPart("POST /upload HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhel"));
+    ASSERT_EQ(HttpParser::Result::NeedMore, parser.parseNextPart("lo\r\n"));
+    EXPECT_EQ("hello", parser.takeBody());
+    EXPECT_EQ(HttpParser::Result::Error, parser.parseNextPart("5\r\nworld\r\n0\r\n\r\n"));
+    EXPECT_EQ(413, parser.errorHttpCode());
+}
+
+TEST(HttpParserTest, spilledBody)
+{
+    HttpParser parser;
+    parser.setBodySpillThreshold(4);
+    ASSERT_EQ(HttpParser::Result::HeadersReady,
+              parser.parseNextPart("POST /upload HTTP/1.1\r\nContent-Length: 10\r\n\r\n012"));
+    ASSERT_EQ(HttpParser::Result::NeedMore, parser.parseNextPart("3456"));
+    ASSERT_EQ(HttpParser::Result::Success, parser.parseNextPart("789GET / HTTP/1.1\r\n\r\n"));
+    EXPECT_EQ("0123456789", parser.body());
+    QSharedPointer<QTemporaryFile> spilledBody = parser.spilledBody();
+    ASSERT_TRUE(spilledBody);
+    EXPECT_EQ(10, spilledBody->size());
+    QByteArray body = parser.body();
+
+    parser.reset();
+    EXPECT_FALSE(parser.spilledBody());
+    EXPECT_EQ("0123456789", body);
+    spilledBody.reset();
+    ASSERT_EQ(HttpParser::Result::Success, parser.parseNextPart(QByteArray()));
+    EXPECT_EQ("GET", parser.method());
+    EXPECT_TRUE(parser.body().isEmpty());
+    EXPECT_FALSE(parser.spilledBody());
+}
+
+TEST(HttpParserTest, spilledChunkedBody)
+{
+    HttpParser parser;
+    parser.setBodySpillThreshold(4);
+    ASSERT_EQ(HttpParser::Result::HeadersReady,
+              parser.parseNextPart("POST /upload HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nhel\r\n"));
+    ASSERT_EQ(HttpParser::Result::NeedMore, parser.parseNextPart("8\r\nlo world\r\n"));
+    EXPECT_TRUE(parser.spilledBody());
+    ASSERT_EQ(HttpParser::Result::Success, parser.parseNextPart("0\r\n\r\n"));
+    EXPECT_EQ("hello world", parser.body());
+}
+
+TEST(HttpParserTest, smallBodyIsNotSpilled)
+{
+    HttpParser parser;
+    parser.setBodySpillThreshold(10);
+    ASSERT_EQ(HttpParser::Result::Success,
+              parseFully(parser, "POST /upload HTTP/1.1\r\nContent-Length: 10\r\n\r\n0123456789"));
+    EXPECT_EQ("0123456789", parser.body());
+    EXPECT_FALSE(parser.spilledBody());
+}
@@ -0,0 +1,156 @@
+// clazy:skip
+
+#include "proofnetwork/restresponsecache_p.h"
+
+#include "gtest/proof/test_global.h"
+
+#include <QThread>
+
+using namespace Proof;
+
+TEST(RestResponseCacheTest, insertAndFind)
+{
+    RestResponseCache cache;
+    EXPECT_FALSE(cache.find("/orders?limit=1").has_value());
+
+    RestResponseCache::Answer inserted = cache.insert("/orders?limit=1", "rest_get_Orders", "body", "text/plain",
+                                                      {{"X-Custom", "value"}});
+    EXPECT_EQ(RestResponseCache::etag("body"), inserted.etag);
+    EXPECT_EQ(QString::fromLatin1(inserted.etag), inserted.headers.value("ETag"));
+    EXPECT_EQ("value", inserted.headers.value("X-Custom"));
+
+    auto found = cache.find("/orders?limit=1");
+    ASSERT_TRUE(found.has_value());
+    EXPECT_EQ("body", found->body);
+    EXPECT_EQ("text/plain", found->contentType);
+    EXPECT_EQ(inserted.etag, found->etag);
+    EXPECT_FALSE(cache.find("/orders?limit=2").has_value());
+}
+
+TEST(RestResponseCacheTest, ttl)
+{
+    RestResponseCache cache;
+    cache.setTtl(50);
+    EXPECT_EQ(50, cache.ttl());
+    cache.insert("/orders", "rest_get_Orders", "body", "text/plain", {});
+    EXPECT_TRUE(cache.find("/orders").has_value());
+    QThread::msleep(100);
+    EXPECT_FALSE(cache.find("/orders").has_value());
+
+    cache.insert("/items", "rest_get_Items", "body", "text/plain", {});
+    QThread::msleep(100);
+    EXPECT_EQ(1, cache.count());
+    EXPECT_FALSE(cache.find("/items").has_value());
+    EXPECT_EQ(0, cache.count());
+
+    cache.setTtl(0);
+    cache.insert("/orders", "rest_get_Orders", "body", "text/plain", {});
+    QThread::msleep(100);
+    EXPECT_TRUE(cache.find("/orders").has_value());
+}
+
+TEST(RestResponseCacheTest, expiredPurge)
+{
+    RestResponseCache cache;
+    cache.setTtl(50);
+    cache.insert("/a", "rest_get_A", "a", "text/plain", {});
+    cache.insert("/b", "rest_get_B", "b", "text/plain", {});
+    QThread::msleep(1100);
+    cache.insert("/c", "rest_get_C", "c", "text/plain", {});
+    EXPECT_EQ(1, cache.count());
+}
+
+TEST(RestResponseCacheTest, invalidate)
+{
+    RestResponseCache cache;
+    cache.insert("/orders/1", "rest_get_Orders", "1", "text/plain", {});
+    cache.insert("/orders/2", "rest_get_Orders", "2", "text/plain", {});
+    cache.insert("/items", "GET /items", "3", "text/plain", {});
+    EXPECT_EQ(3, cache.count());
+
+    cache.invalidate("rest_get_Orders");
+    EXPECT_EQ(1, cache.count());
+    EXPECT_TRUE(cache.find("/items").has_value());
+
+    cache.invalidate();
+    EXPECT_EQ(0, cache.count());
+}
+
+TEST(RestResponseCacheTest, insertAfterInvalidation)
+{
+    RestResponseCache cache;
+    quint64 generation = cache.generation("rest_get_Orders");
+    const quint64 itemsGeneration = cache.generation("GET /items");
+    cache.invalidate("rest_get_Orders");
+    RestResponseCache::Answer answer = cache.insert("/orders", "rest_get_Orders", "stale", "text/plain", {},
+                                                    generation);
+    EXPECT_EQ("stale", answer.body);
+    EXPECT_FALSE(cache.find("/orders").has_value());
+    cache.insert("/items", "GET /items", "items", "text/plain", {}, itemsGeneration);
+    EXPECT_TRUE(cache.find("/items").has_value());
+
+    generation = cache.generation("rest_get_Orders");
+    cache.insert("/orders", "rest_get_Orders", "fresh", "text/plain", {}, generation);
+    EXPECT_TRUE(cache.find("/orders").has_value());
+
+    cache.invalidate();
+    cache.insert("/orders", "rest_get_Orders", "stale", "text/plain", {}, generation);
+    EXPECT_FALSE(cache.find("/orders").has_value());
+}
+
+TEST(RestResponseCacheTest, bodyIsCopied)
+{
+    RestResponseCache cache;
+    QByteArray buffer = "body";
+    cache.insert("/orders", "rest_get_Orders", QByteArray::fromRawData(buffer.constData(), buffer.size()),
+                 "text/plain", {});
+    buffer.fill('x');
+    EXPECT_EQ("body", cache.find("/orders")->body);
+}
+
+TEST(RestResponseCacheTest, encodedBodies)
+{
+    RestResponseCache cache;
+    RestResponseCache::Answer answer = cache.insert("/orders", "rest_get_Orders", "body", "text/plain", {});
+    EXPECT_TRUE(answer.encodedBodies.isEmpty());
+    cache.insertEncodedBody("/orders", answer.etag, "gzip", "gzipped body");
+    cache.insertEncodedBody("/orders", RestResponseCache::etag("other body"), "deflate", "deflated other body");
+    cache.insertEncodedBody("/items", answer.etag, "deflate", "deflated body");
+    auto found = cache.find("/orders");
+    ASSERT_TRUE(found.has_value());
+    EXPECT_EQ(1, found->encodedBodies.count());
+    EXPECT_EQ("gzipped body", found->encodedBodies.value("gzip"));
+    EXPECT_FALSE(cache.find("/items").has_value());
+
+    cache.insert("/orders", "rest_get_Orders", "new body", "text/plain", {});
+    EXPECT_TRUE(cache.find("/orders")->encodedBodies.isEmpty());
+}
+
+TEST(RestResponseCacheTest, eviction)
+{
+    RestResponseCache cache(2);
+    cache.insert("/a", "rest_get_A", "a", "text/plain", {});
+    cache.insert("/b", "rest_get_B", "b", "text/plain", {});
+    cache.insert("/a", "rest_get_A", "new a", "text/plain", {});
+    EXPECT_EQ(2, cache.count());
+    EXPECT_EQ("new a", cache.find("/a")->body);
+    cache.insert("/c", "rest_get_C", "c", "text/plain", {});
+    EXPECT_EQ(2, cache.count());
+    EXPECT_TRUE(cache.find("/c").has_value());
+}
+
+TEST(RestResponseCacheTest, isNotModified)
+{
+    const QByteArray etag = RestResponseCache::etag("body");
+    const QByteArray opaqueTag = etag.mid(2);
+    EXPECT_TRUE(etag.startsWith("W/\""));
+    EXPECT_NE(etag, RestResponseCache::etag("other body"));
+
+    EXPECT_TRUE(RestResponseCache::isNotModified(etag, etag));
+    EXPECT_TRUE(RestResponseCache::isNotModified(opaqueTag, etag));
+    EXPECT_TRUE(RestResponseCache::isNotModified("\"other\", " + etag, etag));
+    EXPECT_TRUE(RestResponseCache::isNotModified("*", etag));
+    EXPECT_FALSE(RestResponseCache::isNotModified("", etag));
+    EXPECT_FALSE(RestResponseCache::isNotModified("\"other\"", etag));
+    EXPECT_FALSE(RestResponseCache::isNotModified(RestResponseCache::etag("other body"), etag));
+}
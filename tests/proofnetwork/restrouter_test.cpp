@@ -0,0 +1,140 @@
+// clazy:skip
+
+#include "proofnetwork/restrouter_p.h"
+
+#include "gtest/proof/test_global.h"
+
+using namespace Proof;
+
+static RestRouter::Route makeRoute(const QByteArray &name, const QStringList &tags = QStringList())
+{
+    RestRouter::Route route;
+    route.name = name;
+    route.tags = tags;
+    return route;
+}
+
+TEST(RestRouterTest, longestPrefixMatch)
+{
+    RestRouter router;
+    EXPECT_TRUE(router.isEmpty());
+    router.addRoute({"get", "test-method"}, makeRoute("rest_get_TestMethod"));
+    router.addRoute({"get", "test-method", "sub-method"},
+                    makeRoute("rest_get_TestMethod_SubMethod", {"NO_AUTH_REQUIRED"}));
+    router.addRoute({"post", "test-method"}, makeRoute("rest_post_TestMethod"));
+    EXPECT_FALSE(router.isEmpty());
+
+    int variablePartsStart = -1;
+    const RestRouter::Route *route = router.findRoute("GET", "/Test-Method/abc/%20d", &variablePartsStart);
+    ASSERT_TRUE(route);
+    EXPECT_EQ("rest_get_TestMethod", route->name);
+    EXPECT_EQ(QStringList({"abc", " d"}), RestRouter::variableParts("/Test-Method/abc/%20d", variablePartsStart));
+
+    route = router.findRoute("get", "//test-method//sub-method/", &variablePartsStart);
+    ASSERT_TRUE(route);
+    EXPECT_EQ("rest_get_TestMethod_SubMethod", route->name);
+    EXPECT_TRUE(route->hasTag("NO_AUTH_REQUIRED"));
+    EXPECT_TRUE(RestRouter::variableParts("//test-method//sub-method/", variablePartsStart).isEmpty());
+
+    route = router.findRoute("POST", "/test-method");
+    ASSERT_TRUE(route);
+    EXPECT_EQ("rest_post_TestMethod", route->name);
+}
+
+TEST(RestRouterTest, notFound)
+{
+    RestRouter router;
+    router.addRoute({"get", "system", "status"}, makeRoute("rest_get_System_Status"));
+
+    EXPECT_FALSE(router.findRoute("GET", "/"));
+    EXPECT_FALSE(router.findRoute("GET", "/system"));
+    EXPECT_FALSE(router.findRoute("GET", "/systemstatus"));
+    EXPECT_FALSE(router.findRoute("PUT", "/system/status"));
+    EXPECT_TRUE(router.findRoute("GET", "/system/status"));
+
+    router.clear();
+    EXPECT_TRUE(router.isEmpty());
+    EXPECT_FALSE(router.findRoute("GET", "/system/status"));
+}
+
+TEST(RestRouterTest, typedAndMocRoutes)
+{
+    RestRouter router;
+    RestRouter::Route typedRoute = makeRoute("GET /orders/{id:int}/items");
+    typedRoute.invoker = [](AbstractRestServer *, const RestRouteArguments &) { return true; };
+    router.addRoute({"get", "orders", "{int}", "items"}, typedRoute);
+    router.addRoute({"get", "orders"}, makeRoute("rest_get_Orders"));
+
+    int variablePartsStart = -1;
+    QVarLengthArray<QByteArray, 4> pathValues;
+    const RestRouter::Route *route = router.findRoute("GET", "/orders/5", &variablePartsStart, &pathValues);
+    ASSERT_TRUE(route);
+    EXPECT_EQ("rest_get_Orders", route->name);
+    EXPECT_EQ(QStringList{"5"}, RestRouter::variableParts("/orders/5", variablePartsStart));
+    EXPECT_TRUE(pathValues.isEmpty());
+
+    route = router.findRoute("GET", "/orders/5/other", &variablePartsStart, &pathValues);
+    ASSERT_TRUE(route);
+    EXPECT_EQ("rest_get_Orders", route->name);
+    EXPECT_EQ(QStringList({"5", "other"}), RestRouter::variableParts("/orders/5/other", variablePartsStart));
+    EXPECT_TRUE(pathValues.isEmpty());
+
+    pathValues.clear();
+    route = router.findRoute("GET", "/orders/5/items", &variablePartsStart, &pathValues);
+    ASSERT_TRUE(route);
+    EXPECT_EQ("GET /orders/{id:int}/items", route->name);
+    ASSERT_EQ(1, pathValues.count());
+    EXPECT_EQ("5", pathValues[0]);
+
+    route = router.findRoute("GET", "/orders/5/items/more", &variablePartsStart);
+    ASSERT_TRUE(route);
+    EXPECT_EQ("rest_get_Orders", route->name);
+    EXPECT_EQ(QStringList({"5", "items", "more"}),
+              RestRouter::variableParts("/orders/5/items/more", variablePartsStart));
+}
+
+TEST(RestRouterTest, parameters)
+{
+    RestRouter router;
+    RestRouter::Route typedRoute = makeRoute("GET /orders/{id:int}");
+    typedRoute.invoker = [](AbstractRestServer *, const RestRouteArguments &) { return true; };
+    typedRoute.queryParameters = {"limit", "filter"};
+    router.addRoute({"get", "orders", "{int}"}, typedRoute);
+    router.addRoute({"get", "orders", "{string}"}, makeRoute("byName"));
+    router.addRoute({"get", "orders", "list"}, makeRoute("list"));
+
+    QVarLengthArray<QByteArray, 4> pathValues;
+    const RestRouter::Route *route = router.findRoute("GET", "/orders/42", nullptr, &pathValues);
+    ASSERT_TRUE(route);
+    EXPECT_EQ("GET /orders/{id:int}", route->name);
+    ASSERT_EQ(1, pathValues.count());
+    EXPECT_EQ("42", pathValues[0]);
+    EXPECT_FALSE(router.findRoute("GET", "/orders/42/more"));
+
+    route = router.findRoute("GET", "/orders/list");
+    ASSERT_TRUE(route);
+    EXPECT_EQ("list", route->name);
+    route = router.findRoute("GET", "/orders/some%20name");
+    ASSERT_TRUE(route);
+    EXPECT_EQ("byName", route->name);
+
+    QVarLengthArray<QByteArray, 4> queryValues;
+    RestRouter::queryValues("filter=a%20b&limit=10&limit=20&other", typedRoute.queryParameters, queryValues);
+    ASSERT_EQ(2, queryValues.count());
+    EXPECT_EQ("10", queryValues[0]);
+    EXPECT_EQ("a%20b", queryValues[1]);
+    RestRouter::queryValues("filter", typedRoute.queryParameters, queryValues);
+    EXPECT_TRUE(queryValues[0].isNull());
+    EXPECT_FALSE(queryValues[1].isNull());
+    EXPECT_TRUE(queryValues[1].isEmpty());
+
+    QString name;
+    EXPECT_TRUE(RestRouteHelpers::convert(QByteArray("a%20b"), name));
+    EXPECT_EQ("a b", name);
+    int number = 0;
+    EXPECT_FALSE(RestRouteHelpers::convert(QByteArray("99999999999"), number));
+    std::optional<uint> optionalNumber;
+    EXPECT_TRUE(RestRouteHelpers::convert(QByteArray(), optionalNumber));
+    EXPECT_FALSE(optionalNumber.has_value());
+    EXPECT_FALSE(RestRouteHelpers::convert(QByteArray("-1"), optionalNumber));
+}
@@ -0,0 +1,58 @@
+// clazy:skip
+
+#include "proofnetwork/restservermetrics_p.h"
+
+#include "gtest/proof/test_global.h"
+
+using namespace Proof;
+
+TEST(RestServerMetricsTest, merge)
+{
+    RestServerMetrics first(2);
+    RestServerMetrics second(2);
+    EXPECT_EQ(3, first.routesCount());
+    EXPECT_EQ(2, first.unmatchedRoute());
+
+    first.requestStarted(0);
+    first.bytesReceived(0, 100);
+    first.addDuration(0, RestServerMetrics::Phase::Parse, 50);
+    first.answerStarted(0, 200);
+    first.bytesSent(0, 1000);
+    first.requestFinished(0);
+    second.requestStarted(0);
+    second.addDuration(0, RestServerMetrics::Phase::Parse, 2000000);
+    second.answerStarted(0, 404);
+    second.requestStarted(1);
+    second.requestStarted(first.unmatchedRoute());
+    second.answerStarted(first.unmatchedRoute(), 400);
+    second.requestFinished(first.unmatchedRoute());
+
+    QByteArray result = RestServerMetrics::toPrometheus({&first, &second}, {"first", "second \"quoted\""});
+    EXPECT_TRUE(result.contains("proof_rest_requests_total{route=\"first\",code=\"2xx\"} 1\n"));
+    EXPECT_TRUE(result.contains("proof_rest_requests_total{route=\"first\",code=\"4xx\"} 1\n"));
+    EXPECT_TRUE(result.contains("proof_rest_requests_total{route=\"unmatched\",code=\"4xx\"} 1\n"));
+    EXPECT_TRUE(result.contains("proof_rest_requests_in_flight{route=\"first\"} 1\n"));
+    EXPECT_TRUE(result.contains("proof_rest_requests_in_flight{route=\"second \\\"quoted\\\"\"} 1\n"));
+    EXPECT_TRUE(result.contains("proof_rest_received_bytes_total{route=\"first\"} 100\n"));
+    EXPECT_TRUE(result.contains("proof_rest_sent_bytes_total{route=\"first\"} 1000\n"));
+    const QByteArray parse = "{route=\"first\",phase=\"parse\"";
+    EXPECT_TRUE(result.contains("proof_rest_phase_duration_seconds_bucket" + parse + ",le=\"0.0001\"} 1\n"));
+    EXPECT_TRUE(result.contains("proof_rest_phase_duration_seconds_bucket" + parse + ",le=\"1\"} 1\n"));
+    EXPECT_TRUE(result.contains("proof_rest_phase_duration_seconds_bucket" + parse + ",le=\"2.5\"} 2\n"));
+    EXPECT_TRUE(result.contains("proof_rest_phase_duration_seconds_bucket" + parse + ",le=\"+Inf\"} 2\n"));
+    EXPECT_TRUE(result.contains("proof_rest_phase_duration_seconds_sum" + parse + "} 2.00005\n"));
+    EXPECT_TRUE(result.contains("proof_rest_phase_duration_seconds_count" + parse + "} 2\n"));
+}
+
+TEST(RestServerMetricsTest, inactiveRoutesSkipped)
+{
+    RestServerMetrics metrics(2);
+    metrics.requestStarted(1);
+    metrics.answerStarted(1, 200);
+    metrics.requestFinished(1);
+
+    QByteArray result = RestServerMetrics::toPrometheus({&metrics}, {"first", "second"});
+    EXPECT_FALSE(result.contains("route=\"first\""));
+    EXPECT_FALSE(result.contains("route=\"unmatched\""));
+    EXPECT_TRUE(result.contains("proof_rest_requests_in_flight{route=\"second\"} 0\n"));
+}